@@ -68,13 +68,16 @@ static RETSIGTYPE authentication_timeout(int sig);
 static int send_params(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend);
 static void send_frontend_exits(void);
 static int s_do_auth(POOL_CONNECTION_POOL_SLOT *cp, char *password);
+static POOL_CONNECTION_POOL_SLOT *start_persistent_db_connection(
+	int node_id, int fd, char *dbname, char *user);
 static void connection_count_up(void);
 static void connection_count_down(void);
 static void init_system_db_connection(void);
 static bool connect_using_existing_connection(POOL_CONNECTION *frontend,
 											  POOL_CONNECTION_POOL *backend,
 											  StartupPacket *sp);
-static void initialize_private_backend_status(void);
+static void check_backend_status(void);
+static void discard_down_nodes(POOL_BACKEND_STATUS_SNAPSHOT *snapshot);
 
 /*
  * non 0 means SIGTERM(smart shutdown) or SIGINT(fast shutdown) has arrived
@@ -92,9 +95,12 @@ char remote_ps_data[NI_MAXHOST];		/* used for set_ps_display */
 volatile sig_atomic_t got_sighup = 0;
 
 /*
- * Private copy of backend status
+ * Generation of the backend status snapshot last looked at by
+ * check_down_nodes(). my_backend_status may be older than this, since
+ * nodes attached during a session are taken only when the session
+ * ends.
  */
-static BACKEND_STATUS private_backend_status[MAX_NUM_BACKENDS];
+static unsigned int checked_generation;
 
 /*
 * child main loop
@@ -137,16 +143,20 @@ void do_child(int unix_fd, int inet_fd)
 #endif
 
 	/* Initialize my backend status */
-	initialize_private_backend_status();
+	pool_refresh_backend_status();
+	checked_generation = my_backend_status.generation;
 
 	/* Initialize per process context */
 	pool_init_process_context();
 
+	/* Write log messages to my log ring buffer if enabled */
+	pool_set_log_ring(pool_get_log_ring(pool_get_process_context()->proc_id));
+
 	/* initialize random seed */
 	gettimeofday(&now, &tz);
 	srandom((unsigned int) now.tv_usec);
 
-	/* initialize system db connection */
+	/* forget system db connections of pgpool main */
 	init_system_db_connection();
 
 	/* initialize connection pool */
@@ -163,23 +173,19 @@ void do_child(int unix_fd, int inet_fd)
 		StartupPacket *sp;
 
 		idle = 1;
+		pool_get_my_process_info()->idle = 1;
 
 		/* pgpool stop request already sent? */
 		check_stop_request();
 
-		/* Check if restart request is set because of failback event
-		 * happend.  If so, exit myself with exit code 1 to be
-		 * restarted by pgpool parent.
-		 */
-		if (pool_get_my_process_info()->need_to_restart)
-		{
-			pool_log("do_child: failback event found. restart myself.");
-			pool_get_my_process_info()->need_to_restart = 0;
-			child_exit(1);
-		}
-
 		accepted = 0;
 
+		/* take nodes attached or detached by failback or failover */
+		check_backend_status();
+
+		/* create connections for recently used startup packets */
+		pool_prewarm_connections();
+
 		/* perform accept() */
 		frontend = do_accept(unix_fd, inet_fd, &timeout);
 
@@ -204,6 +210,7 @@ void do_child(int unix_fd, int inet_fd)
 
 		/* reset busy flag */
 		idle = 0;
+		pool_get_my_process_info()->idle = 0;
 
 		/* check backend timer is expired */
 		if (backend_timer_expired)
@@ -272,17 +279,11 @@ void do_child(int unix_fd, int inet_fd)
 		 * Authentication is also done in this step.
 		 */
 
-		/* Check if restart request is set because of failback event
-		 * happend.  If so, exit myself with exit code 1 to be
-		 * restarted by pgpool parent.
+		/*
+		 * Backend status may have been changed while waiting for the
+		 * connection request.
 		 */
-		if (pool_get_my_process_info()->need_to_restart)
-		{
-			pool_log("do_child: failback event found. discard existing connections");
-			pool_get_my_process_info()->need_to_restart = 0;
-			close_idle_connection(0);
-			initialize_private_backend_status();
-		}
+		check_backend_status();
 
 		/*
 		 * if there's no connection associated with user and database,
@@ -339,6 +340,9 @@ void do_child(int unix_fd, int inet_fd)
 
 		connected = 1;
 
+		/* remember the startup packet for prewarming */
+		pool_prewarm_register(backend);
+
  		/* show ps status */
 		sp = MASTER_CONNECTION(backend)->sp;
 		snprintf(psbuf, sizeof(psbuf), "%s %s %s idle",
@@ -485,6 +489,9 @@ static POOL_CONNECTION *do_accept(int unix_fd, int inet_fd, struct timeval *time
 #endif
 	struct timeval *timeoutval;
 	struct timeval tv1, tv2, tmback = {0, 0};
+	int serialize;
+	int queue_fd;
+	int nfds;
 
 	char remote_host[NI_MAXHOST];
 	char remote_port[NI_MAXSERV];
@@ -494,10 +501,51 @@ static POOL_CONNECTION *do_accept(int unix_fd, int inet_fd, struct timeval *time
 	/* Destroy session context for just in case... */
 	pool_session_context_destroy();
 
+	/*
+	 * If serialize_accept is enabled, only the child holding
+	 * ACCEPT_SEM waits for a connection request. Other idle children
+	 * sleep on the semaphore, thus a connection request wakes up only
+	 * one child instead of all idle children. Time spent waiting for
+	 * the semaphore is not counted in child_life_time.
+	 */
+	serialize = pool_config->serialize_accept;
+
+	/*
+	 * If accept_queue_size is set, the acceptor process accepts
+	 * connections and hands them off to idle children. Wait for a
+	 * connection from the acceptor instead of the listen sockets.
+	 */
+	queue_fd = pool_accept_queue_fd();
+	if (queue_fd >= 0)
+		pool_accept_queue_wait();
+
+	if (serialize)
+	{
+		pool_semaphore_lock(ACCEPT_SEM);
+
+		/* shutdown request may have arrived while waiting */
+		if (exit_request)
+		{
+			pool_semaphore_unlock(ACCEPT_SEM);
+			if (queue_fd >= 0)
+				pool_accept_queue_cancel();
+			return NULL;
+		}
+	}
+
 	FD_ZERO(&readmask);
-	FD_SET(unix_fd, &readmask);
-	if (inet_fd)
-		FD_SET(inet_fd, &readmask);
+	if (queue_fd >= 0)
+	{
+		FD_SET(queue_fd, &readmask);
+		nfds = queue_fd;
+	}
+	else
+	{
+		FD_SET(unix_fd, &readmask);
+		if (inet_fd)
+			FD_SET(inet_fd, &readmask);
+		nfds = Max(unix_fd, inet_fd);
+	}
 
 	if (timeout->tv_sec == 0 && timeout->tv_usec == 0)
 		timeoutval = NULL;
@@ -514,7 +562,7 @@ static POOL_CONNECTION *do_accept(int unix_fd, int inet_fd, struct timeval *time
 #endif
 	}
 
-	fds = select(Max(unix_fd, inet_fd)+1, &readmask, NULL, NULL, timeoutval);
+	fds = select(nfds+1, &readmask, NULL, NULL, timeoutval);
 
 	save_errno = errno;
 	/* check backend timer is expired */
@@ -558,6 +606,18 @@ static POOL_CONNECTION *do_accept(int unix_fd, int inet_fd, struct timeval *time
 
 	errno = save_errno;
 
+	if (serialize && fds <= 0)
+	{
+		pool_semaphore_unlock(ACCEPT_SEM);
+		errno = save_errno;
+	}
+
+	if (queue_fd >= 0 && fds <= 0)
+	{
+		pool_accept_queue_cancel();
+		errno = save_errno;
+	}
+
 	if (fds == -1)
 	{
 		if (errno == EAGAIN || errno == EINTR)
@@ -603,9 +663,18 @@ static POOL_CONNECTION *do_accept(int unix_fd, int inet_fd, struct timeval *time
 		pause();
 	}
 
-	afd = accept(fd, (struct sockaddr *)&saddr.addr, &saddr.salen);
+	if (queue_fd >= 0)
+	{
+		afd = pool_accept_queue_receive(&saddr);
+		if (afd >= 0 && saddr.addr.ss_family != AF_UNIX)
+			inet++;
+	}
+	else
+		afd = accept(fd, (struct sockaddr *)&saddr.addr, &saddr.salen);
 
 	save_errno = errno;
+	if (serialize && !(afd < 0 && save_errno == EINTR && *InRecovery && queue_fd < 0))
+		pool_semaphore_unlock(ACCEPT_SEM);
 	/* check backend timer is expired */
 	if (backend_timer_expired)
 	{
@@ -615,7 +684,7 @@ static POOL_CONNECTION *do_accept(int unix_fd, int inet_fd, struct timeval *time
 	errno = save_errno;
 	if (afd < 0)
 	{
-		if (errno == EINTR && *InRecovery)
+		if (errno == EINTR && *InRecovery && queue_fd < 0)
 			goto retry_accept;
 
 		/*
@@ -1031,26 +1100,28 @@ static bool connect_using_existing_connection(POOL_CONNECTION *frontend,
 	if (MAJOR(backend) == 3)
 	{
 		char command_buf[1024];
+		char *value;
+		int pos;
 
 		/* If we have received application_name in the start up
 		 * packet, we send SET command to backend. Also we add or
-		 * replace existing application_name data.
+		 * replace existing application_name data. If the backend
+		 * already has the same application_name, which is usual
+		 * since the start up packet is identical, SET is not needed.
 		 */
-		if (sp->application_name)
+		if (sp->application_name &&
+			!((value = pool_find_name(&MASTER(backend)->params, "application_name", &pos)) &&
+			  !strcmp(value, sp->application_name)))
 		{
+			char *command = command_buf;
+
 			snprintf(command_buf, sizeof(command_buf), "SET application_name TO '%s'", sp->application_name);
 
-			for (i=0;i<NUM_BACKENDS;i++)
+			/* send the command to all backends at once */
+			if (pool_pipeline_commands(backend, &command, 1) != POOL_CONTINUE)
 			{
-				if (VALID_BACKEND(i))
-					if (do_command(frontend, CONNECTION(backend, i),
-							   command_buf, MAJOR(backend),
-								   MASTER_CONNECTION(backend)->pid,
-								   MASTER_CONNECTION(backend)->key, 0) != POOL_CONTINUE)
-					{
-						pool_error("connect_using_existing_connection: do_command failed. command: %s", command_buf);
-						return false;
-					}
+				pool_error("connect_using_existing_connection: pool_pipeline_commands failed. command: %s", command_buf);
+				return false;
 			}
 
 			pool_add_param(&MASTER(backend)->params, "application_name", sp->application_name);
@@ -1094,45 +1165,32 @@ void cancel_request(CancelPacket *sp)
 {
 	int	len;
 	int fd;
-	POOL_CONNECTION *con;
-	int i,j,k;
-	ConnectionInfo *c = NULL;
+	POOL_CONNECTION *con[MAX_NUM_BACKENDS];
+	int i;
+	ConnectionInfo *c;
 	CancelPacket cp;
-	bool found = false;
+	struct timeval delay;
+	bool delayed = false;
 
 	pool_debug("Cancel request received");
 
 	/* look for cancel key from shmem info */
-	for (i=0;i<pool_config->num_init_children;i++)
-	{
-		for (j=0;j<pool_config->max_pool;j++)
-		{
-			for (k=0;k<NUM_BACKENDS;k++)
-			{
-				c = pool_coninfo(i, j, k);
-				pool_debug("con_info: address:%p database:%s user:%s pid:%d key:%d i:%d",
-						   c, c->database, c->user, ntohl(c->pid), ntohl(c->key),i);
-
-				if (c->pid == sp->pid && c->key == sp->key)
-				{
-					pool_debug("found pid:%d key:%d i:%d",ntohl(c->pid), ntohl(c->key),i);
-					c = pool_coninfo(i, j, 0);
-					found = true;
-					goto found;
-				}
-			}
-		}
-	}
-
- found:
-	if (!found)
+	c = pool_coninfo_lookup(sp->pid, sp->key);
+	if (c == NULL)
 	{
 		pool_error("cancel_request: invalid cancel key: pid:%d key:%d",ntohl(sp->pid), ntohl(sp->key));
 		return;	/* invalid key */
 	}
+	pool_debug("found pid:%d key:%d", ntohl(sp->pid), ntohl(sp->key));
 
-	for (i=0;i<NUM_BACKENDS;i++,c++)
+	/*
+	 * Connect to all DB nodes first, so that cancel requests reach
+	 * them at once.
+	 */
+	for (i=0;i<NUM_BACKENDS;i++)
 	{
+		con[i] = NULL;
+
 		if (!VALID_BACKEND(i))
 			continue;
 
@@ -1144,32 +1202,44 @@ void cancel_request(CancelPacket *sp)
 		if (fd < 0)
 		{
 			pool_error("Could not create socket for sending cancel request for backend %d", i);
-			return;
+			continue;
 		}
 
-		con = pool_open(fd);
-		if (con == NULL)
-			return;
+		con[i] = pool_open(fd);
+	}
+
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		if (con[i] == NULL)
+			continue;
+
+		/*
+		 * In replication mode, other nodes execute the query after
+		 * the master completes it. Give them a while to receive the
+		 * query supposed to be canceled.
+		 */
+		if (REPLICATION && !IS_MASTER_NODE_ID(i) && !delayed &&
+			pool_config->cancel_request_delay > 0)
+		{
+			delay.tv_sec = pool_config->cancel_request_delay / 1000;
+			delay.tv_usec = (pool_config->cancel_request_delay % 1000) * 1000;
+			select(0, NULL, NULL, NULL, &delay);
+			delayed = true;		/* wait only once */
+		}
 
 		len = htonl(sizeof(len) + sizeof(CancelPacket));
-		pool_write(con, &len, sizeof(len));
+		pool_write(con[i], &len, sizeof(len));
 
 		cp.protoVersion = sp->protoVersion;
-		cp.pid = c->pid;
-		cp.key = c->key;
+		cp.pid = c[i].pid;
+		cp.key = c[i].key;
 
 		pool_log("cancel_request: canceling backend pid:%d key: %d", ntohl(cp.pid),ntohl(cp.key));
 
-		if (pool_write_and_flush(con, &cp, sizeof(CancelPacket)) < 0)
+		if (pool_write_and_flush(con[i], &cp, sizeof(CancelPacket)) < 0)
 			pool_error("Could not send cancel request packet for backend %d", i);
 
-		pool_close(con);
-
-		/*
-		 * this is needed to enure that the next DB node executes the
-		 * query supposed to be canceled.
-		 */
-		sleep(1);
+		pool_close(con[i]);
 	}
 }
 
@@ -1298,7 +1368,7 @@ static RETSIGTYPE close_idle_connection(int sig)
 			info = p->info;
 			memset(p, 0, sizeof(POOL_CONNECTION_POOL));
 			p->info = info;
-			memset(p->info, 0, sizeof(ConnectionInfo));
+			pool_coninfo_clear(p->info);
 		}
 	}
 }
@@ -1345,26 +1415,25 @@ static void send_frontend_exits(void)
 	POOL_SETMASK(&oldmask);
 }
 
+/*
+ * Send saved ParameterStatus messages to frontend. They are not
+ * flushed here.
+ */
 static int send_params(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend)
 {
-	int index;
-	char *name, *value;
-	int len, sendlen;
+	char *messages;
+	int len;
 
-	index = 0;
-	while (pool_get_param(&MASTER(backend)->params, index++, &name, &value) == 0)
+	messages = pool_get_param_messages(&MASTER(backend)->params, &len);
+	if (messages == NULL)
 	{
-		pool_write(frontend, "S", 1);
-		len = sizeof(sendlen) + strlen(name) + 1 + strlen(value) + 1;
-		sendlen = htonl(len);
-		pool_write(frontend, &sendlen, sizeof(sendlen));
-		pool_write(frontend, name, strlen(name) + 1);
-		pool_write(frontend, value, strlen(value) + 1);
+		pool_error("pool_send_params: pool_get_param_messages() failed");
+		return -1;
 	}
 
-	if (pool_flush(frontend))
+	if (pool_write(frontend, messages, len))
 	{
-		pool_error("pool_send_params: pool_flush() failed");
+		pool_error("pool_send_params: pool_write() failed");
 		return -1;
 	}
 	return 0;
@@ -1399,8 +1468,8 @@ void child_exit(int code)
 	{
 		if (system_db_info->pgconn)
 			pool_close_libpq_connection();
-		if (pool_system_db_connection())
-			pool_close(pool_system_db_connection()->con);
+		if (system_db_info->connection)
+			pool_close(system_db_info->connection->con);
 	}
 
 	/* let backend know now we are exiting */
@@ -1410,14 +1479,108 @@ void child_exit(int code)
 }
 
 /*
- * create a persistent connection
+ * create a persistent connection. node_id is the DB node id against
+ * which errors on the connection are reported, or -1 if the
+ * connection is not to a DB node.
  */
 POOL_CONNECTION_POOL_SLOT *make_persistent_db_connection(
-	char *hostname, int port, char *dbname, char *user, char *password)
+	int node_id, char *hostname, int port, char *dbname, char *user, char *password)
 {
 	POOL_CONNECTION_POOL_SLOT *cp;
 	int fd;
 
+	/*
+	 * create socket
+	 */
+	if (*hostname == '/')
+	{
+		fd = connect_unix_domain_socket_by_port(port, hostname, TRUE);
+	}
+	else
+	{
+		fd = connect_inet_domain_socket_by_port(hostname, port, TRUE);
+	}
+
+	if (fd < 0)
+	{
+		pool_error("make_persistent_db_connection: connection to %s(%d) failed", hostname, port);
+		return NULL;
+	}
+
+	cp = start_persistent_db_connection(node_id, fd, dbname, user);
+	if (cp == NULL)
+		return NULL;
+
+	/*
+	 * do authentication
+	 */
+	if (s_do_auth(cp, password))
+	{
+		pool_error("make_persistent_db_connection: s_do_auth failed");
+		return NULL;
+	}
+
+	return cp;
+}
+
+/*
+ * Create persistent connections to all valid DB nodes. Connecting,
+ * sending startup packets and authentication proceed on all nodes at
+ * once, so that the time does not add up as the number of nodes
+ * increases. slots[i] is set to NULL if node i is not valid or
+ * connecting to it failed.
+ */
+void make_persistent_db_connections(POOL_CONNECTION_POOL_SLOT **slots,
+									char *dbname, char *user, char *password)
+{
+	int fds[MAX_NUM_BACKENDS];
+	bool in_progress[MAX_NUM_BACKENDS];
+	int i;
+
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		slots[i] = NULL;
+		fds[i] = -1;
+		in_progress[i] = false;
+
+		if (VALID_BACKEND(i))
+			fds[i] = start_connect_backend(i, &in_progress[i]);
+	}
+
+	wait_for_connect_backends(fds, in_progress);
+
+	/* send startup packets to all nodes before waiting for any reply */
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		if (fds[i] < 0)
+			continue;
+
+		slots[i] = start_persistent_db_connection(i, fds[i], dbname, user);
+	}
+
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		if (slots[i] == NULL)
+			continue;
+
+		if (s_do_auth(slots[i], password))
+		{
+			pool_error("make_persistent_db_connections: s_do_auth failed for DB node %d", i);
+			discard_persistent_db_connection(slots[i]);
+			slots[i] = NULL;
+		}
+	}
+}
+
+/*
+ * Start a persistent connection on the connected socket by sending a
+ * startup packet. Authentication is left to the caller.
+ */
+static POOL_CONNECTION_POOL_SLOT *start_persistent_db_connection(
+	int node_id, int fd, char *dbname, char *user)
+{
+	POOL_CONNECTION_POOL_SLOT *cp;
+
 #define MAX_USER_AND_DATABASE	1024
 
 	/* V3 startup packet */
@@ -1447,27 +1610,10 @@ POOL_CONNECTION_POOL_SLOT *make_persistent_db_connection(
 	memset(startup_packet, 0, sizeof(*startup_packet));
 	startup_packet->protoVersion = htonl(0x00030000);	/* set V3 proto major/minor */
 
-	/*
-	 * create socket
-	 */
-	if (*hostname == '/')
-	{
-		fd = connect_unix_domain_socket_by_port(port, hostname, TRUE);
-	}
-	else
-	{
-		fd = connect_inet_domain_socket_by_port(hostname, port, TRUE);
-	}
-
-	if (fd < 0)
-	{
-		pool_error("make_persistent_db_connection: connection to %s(%d) failed", hostname, port);
-		return NULL;
-	}
-
 	cp->con = pool_open(fd);
 	cp->closetime = 0;
 	cp->con->isbackend = 1;
+	cp->con->db_node_id = node_id;
 	pool_ssl_negotiate_clientserver(cp->con);
 
 	/*
@@ -1533,15 +1679,6 @@ POOL_CONNECTION_POOL_SLOT *make_persistent_db_connection(
 		return NULL;
 	}
 
-	/*
-	 * do authentication
-	 */
-	if (s_do_auth(cp, password))
-	{
-		pool_error("make_persistent_db_connection: s_do_auth failed");
-		return NULL;
-	}
-
 	return cp;
 }
 
@@ -1856,6 +1993,17 @@ static void connection_count_down(void)
 	 */
 	if (Req_info->conn_counter > 0)
 		Req_info->conn_counter--;
+
+	/*
+	 * Wake up online recovery waiting for all frontends to go. The
+	 * pipe is non-blocking, so this never blocks even if the pipe is
+	 * full, in which case the recovery has been woken up already.
+	 */
+	if (Req_info->conn_counter == 0 && *InRecovery)
+	{
+		if (write(conn_closed_fds[1], "", 1) < 0 && errno != EAGAIN)
+			pool_error("connection_count_down: write() failed: %s", strerror(errno));
+	}
 	pool_semaphore_unlock(CONN_COUNTER_SEM);
 }
 
@@ -1932,43 +2080,104 @@ void check_stop_request(void)
 }
 
 /*
- * Initialize system DB connection
+ * Check if DB nodes have been detached while I am alive. If neither
+ * the master nor the primary node is detached, pgpool main does not
+ * restart children. Mark the node down in my backend status and
+ * discard connections to it, keeping connections to other nodes.
+ * This may be called in the middle of a session, so nodes attached
+ * are not taken here (see check_backend_status()).
  */
-static void init_system_db_connection(void)
-{	
-	if (pool_config->parallel_mode || pool_config->enable_query_cache)
+void check_down_nodes(void)
+{
+	POOL_BACKEND_STATUS_SNAPSHOT snapshot;
+
+	/* nothing has been changed since the last check */
+	if (Backend_status->generation == checked_generation)
+		return;
+
+	if (!pool_get_backend_status(&snapshot))
 	{
-		system_db_connect();
-		if (PQstatus(system_db_info->pgconn) != CONNECTION_OK)
-		{
-			pool_error("Could not make persistent libpq system DB connection");
-		}
+		checked_generation = my_backend_status.generation;
+		return;
+	}
+
+	discard_down_nodes(&snapshot);
+	checked_generation = snapshot.generation;
+}
 
-		system_db_info->connection = make_persistent_db_connection(pool_config->system_db_hostname,
-																   pool_config->system_db_port,
-																   pool_config->system_db_dbname,
-																   pool_config->system_db_user,
-																   pool_config->system_db_password);
-		if (system_db_info->connection == NULL)
+/*
+ * Take the latest backend status published by pgpool main. Called
+ * between sessions. If nodes have been attached, pooled connections
+ * do not have connections to them, so discard them all. A node
+ * detached and attached again since the last check has still valid
+ * bit set, so attach_epoch is compared rather than the bits.
+ */
+static void check_backend_status(void)
+{
+	POOL_BACKEND_STATUS_SNAPSHOT snapshot;
+	int i;
+
+	if (!pool_get_backend_status(&snapshot))
+		return;
+
+	discard_down_nodes(&snapshot);
+
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		if (snapshot.attach_epoch[i] != my_backend_status.attach_epoch[i])
 		{
-			pool_error("Could not make persistent system DB connection");
+			pool_log("do_child: failback event found. discard existing connections");
+			close_idle_connection(0);
+			break;
 		}
 	}
+
+	my_backend_status = snapshot;
+	checked_generation = snapshot.generation;
 }
 
 /*
- * Initialize my backend status.
- * We copy the backend status to private area so that
- * they are not changed while I am alive.
+ * Discard connections to nodes which are valid in my backend status
+ * but not in the snapshot, and mark them down in my backend status.
  */
-static void initialize_private_backend_status(void)
+static void discard_down_nodes(POOL_BACKEND_STATUS_SNAPSHOT *snapshot)
 {
 	int i;
 
 	for (i=0;i<NUM_BACKENDS;i++)
 	{
-		private_backend_status[i] = BACKEND_INFO(i).backend_status;
-		/* my_backend_status is referred to by VALID_BACKEND macro. */
-		my_backend_status[i] = &private_backend_status[i];
+		if (!BACKEND_MASK_BIT(my_backend_status.valid, i) ||
+			BACKEND_MASK_BIT(snapshot->valid, i))
+			continue;
+
+		/* pgpool main is restarting me */
+		if (i == REAL_MASTER_NODE_ID || i == PRIMARY_NODE_ID)
+			continue;
+
+		pool_log("check_down_nodes: node %d is detached. discard connections to it", i);
+		pool_discard_node_connections(i);
+		my_backend_status.valid[i >> 5] &= ~(1U << (i & 31));
+	}
+}
+
+/*
+ * Initialize system DB connection. Connections to the system DB are
+ * made on first use rather than here, so that respawning a child
+ * after child_life_time or child_max_connections, or forking a new
+ * child on demand, does not wait for the system DB. A libpq
+ * connection made by pgpool main before forking is shared with it
+ * and must not be used or terminated by the child. Just close our
+ * copy of the socket.
+ */
+static void init_system_db_connection(void)
+{
+	if (pool_config->parallel_mode || pool_config->enable_query_cache)
+	{
+		if (system_db_info->pgconn)
+		{
+			close(PQsocket(system_db_info->pgconn));
+			system_db_info->pgconn = NULL;
+		}
+		system_db_info->connection = NULL;
 	}
 }
@@ -21,6 +21,7 @@
 #include "pool.h"
 #include "pool_config.h"
 #include "pool_process_context.h"
+#include "pool_stream.h"
 
 #include <ctype.h>
 #include <sys/types.h>
@@ -59,6 +60,8 @@
 #include "parser/pool_memory.h"
 #include "parser/pool_string.h"
 #include "pool_passwd.h"
+#include "pool_sequence.h"
+#include "pool_lobj.h"
 
 /*
  * Process pending signal actions.
@@ -84,10 +87,26 @@
 			reload_config(); \
 			reload_config_request = 0; \
 		} \
+		if (restart_request) \
+		{ \
+			restart_me(); \
+			restart_request = 0; \
+		} \
     } while (0)
 
 
 #define PGPOOLMAXLITSENQUEUELENGTH 10000
+
+/*
+ * Environment variable to pass listen sockets to the new pgpool on
+ * graceful restart. The value is "old_pid unix_fd inet_fd
+ * pcp_unix_fd pcp_inet_fd".
+ */
+#define INHERITED_SOCKETS_ENV "PGPOOL_INHERITED_SOCKETS"
+
+/* interval in milliseconds to look for the primary node on failover */
+#define PRIMARY_SEARCH_INTERVAL 100
+
 static void daemonize(void);
 static int read_pid_file(void);
 static void write_pid_file(void);
@@ -96,6 +115,8 @@ static int write_status_file(void);
 static pid_t pcp_fork_a_child(int unix_fd, int inet_fd, char *pcp_conf_file);
 static pid_t fork_a_child(int unix_fd, int inet_fd, int id);
 static pid_t worker_fork_a_child(void);
+static pid_t logger_fork_a_child(void);
+static pid_t acceptor_fork_a_child(int unix_fd, int inet_fd);
 static int create_unix_domain_socket(struct sockaddr_un un_addr_tmp);
 static int create_inet_domain_socket(const char *hostname, const int port);
 static void myexit(int code);
@@ -107,6 +128,9 @@ static int pool_pause(struct timeval *timeout);
 static void kill_all_children(int sig);
 static int get_next_master_node(void);
 static pid_t fork_follow_child(int old_master, int new_master, int old_primary);
+static int num_children_to_fork(void);
+static void get_spare_limits(int *min_spare, int *max_spare);
+static void maintain_spare_children(void);
 
 static RETSIGTYPE exit_handler(int sig);
 static RETSIGTYPE reap_handler(int sig);
@@ -118,12 +142,19 @@ static RETSIGTYPE wakeup_handler(int sig);
 static void usage(void);
 static void show_version(void);
 static void stop_me(void);
+static void restart_me(void);
+static void read_inherited_sockets(void);
+static int take_over_socket(int fd, struct sockaddr_un *addr, const char *hostname, int port);
+static bool pid_file_is_mine(void);
+static RETSIGTYPE restart_handler(int sig);
 
 static int trigger_failover_command(int node, const char *command_line,
 									int old_master, int new_master, int old_primary);
 
 static int find_primary_node(void);
 static int find_primary_node_repeatedly(void);
+static void pool_sleep_msec(int msec);
+static void sleep_until(struct timeval *until);
 
 static struct sockaddr_un un_addr;		/* unix domain socket path */
 static struct sockaddr_un pcp_un_addr;  /* unix domain socket path for PCP */
@@ -159,11 +190,14 @@ static int stop_sig = SIGTERM;	/* stopping signal default value */
 static volatile sig_atomic_t health_check_timer_expired;		/* non 0 if health check timer expired */
 
 POOL_REQUEST_INFO *Req_info;		/* request info area in shared memory */
+POOL_BACKEND_STATUS_SNAPSHOT *Backend_status;	/* backend status in shared memory */
 volatile sig_atomic_t *InRecovery; /* non 0 if recovery is started */
+int conn_closed_fds[2];	/* pipe to tell recovery that all frontends have gone */
 volatile sig_atomic_t reload_config_request = 0;
 static volatile sig_atomic_t failover_request = 0;
 static volatile sig_atomic_t sigchld_request = 0;
 static volatile sig_atomic_t wakeup_request = 0;
+static volatile sig_atomic_t restart_request = 0;
 
 static int pipe_fds[2]; /* for delivering signals */
 
@@ -172,8 +206,16 @@ int my_proc_id;
 static BackendStatusRecord backend_rec;	/* Backend status record */
 
 static pid_t worker_pid; /* pid of worker process */
+static pid_t logger_pid; /* pid of logger process */
+static pid_t acceptor_pid; /* pid of acceptor process */
 
-BACKEND_STATUS* my_backend_status[MAX_NUM_BACKENDS];		/* Backend status buffer */
+static char startup_cwd[POOLMAXPATHLEN+1];	/* working directory at start up */
+static pid_t old_pgpool_pid;	/* pid of pgpool which handed over sockets to me */
+static int inherited_fds[4] = {-1, -1, -1, -1};	/* unix, inet, pcp unix, pcp inet */
+static char stale_socket_paths[2][sizeof(un_addr.sun_path)];	/* old socket paths not used any more */
+
+POOL_BACKEND_STATUS_SNAPSHOT my_backend_status;		/* my copy of Backend_status */
+static unsigned int attach_epoch[MAX_NUM_BACKENDS];	/* advanced on failback */
 
 int myargc;
 char **myargv;
@@ -210,6 +252,13 @@ int main(int argc, char **argv)
 	myargc = argc;
 	myargv = argv;
 
+	/* remember working directory to execute myself on graceful restart */
+	if (getcwd(startup_cwd, sizeof(startup_cwd)) == NULL)
+		startup_cwd[0] = '\0';
+
+	/* listen sockets handed over by old pgpool if any */
+	read_inherited_sockets();
+
 	snprintf(conf_file, sizeof(conf_file), "%s/%s", DEFAULT_CONFIGDIR, POOL_CONF_FILE_NAME);
 	snprintf(pcp_conf_file, sizeof(pcp_conf_file), "%s/%s", DEFAULT_CONFIGDIR, PCP_PASSWD_FILE_NAME);
 	snprintf(hba_file, sizeof(hba_file), "%s/%s", DEFAULT_CONFIGDIR, HBA_CONF_FILE_NAME);
@@ -368,6 +417,28 @@ int main(int argc, char **argv)
 			pool_shmem_exit(0);
 			exit(0);
 		}
+		if (!strcmp(argv[optind], "restart"))
+		{
+				pid_t pid;
+
+				pid = read_pid_file();
+				if (pid < 0)
+				{
+					pool_error("could not read pid file");
+					pool_shmem_exit(1);
+					exit(1);
+				}
+
+				if (kill(pid, SIGURG) == -1)
+				{
+					pool_error("could not restart pid: %d. reason: %s", pid, strerror(errno));
+					pool_shmem_exit(1);
+					exit(1);
+				}
+				fprintf(stderr, "restart request sent to pgpool(%d).\n", pid);
+				pool_shmem_exit(0);
+				exit(0);
+		}
 		else
 		{
 			usage();
@@ -381,7 +452,7 @@ int main(int argc, char **argv)
 	else if (optind == argc)
 	{
 		pid = read_pid_file();
-		if (pid > 0)
+		if (pid > 0 && pid != old_pgpool_pid)
 		{
 			if (kill(pid, 0) == 0)
 			{
@@ -404,8 +475,16 @@ int main(int argc, char **argv)
 	/* set signal masks */
 	poolinitmask();
 
+	/*
+	 * On graceful restart, the pid file is written after start up
+	 * completes. Until then, the old pgpool is the one to be stopped
+	 * and its files are not removed even if we fail.
+	 */
 	if (not_detach)
-		write_pid_file();
+	{
+		if (!old_pgpool_pid)
+			write_pid_file();
+	}
 	else
 		daemonize();
 
@@ -433,12 +512,13 @@ int main(int argc, char **argv)
 	}
 
 	/*
-	 * Restore previous backend status if possible
+	 * Restore previous backend status if possible. On graceful
+	 * restart, the old pgpool has just written its status.
 	 */
-	read_status_file(discard_status);
+	read_status_file(discard_status && !old_pgpool_pid);
 
 	/* clear cache */
-	if (clear_cache && pool_config->enable_query_cache && SYSDB_STATUS == CON_UP)
+	if (clear_cache && !old_pgpool_pid && pool_config->enable_query_cache && SYSDB_STATUS == CON_UP)
 	{
 		Interval interval[1];
 
@@ -457,13 +537,19 @@ int main(int argc, char **argv)
 	pool_signal(SIGPIPE, SIG_IGN);
 
 	/* create unix domain socket */
-	unix_fd = create_unix_domain_socket(un_addr);
+	unix_fd = take_over_socket(inherited_fds[0], &un_addr, NULL, 0);
+	if (unix_fd < 0)
+		unix_fd = create_unix_domain_socket(un_addr);
 
 	/* create inet domain socket if any */
 	if (pool_config->listen_addresses[0])
 	{
-		inet_fd = create_inet_domain_socket(pool_config->listen_addresses, pool_config->port);
+		inet_fd = take_over_socket(inherited_fds[1], NULL, pool_config->listen_addresses, pool_config->port);
+		if (inet_fd < 0)
+			inet_fd = create_inet_domain_socket(pool_config->listen_addresses, pool_config->port);
 	}
+	else
+		take_over_socket(inherited_fds[1], NULL, NULL, -1);
 
 	/*
 	 * con_info is a 3 dimension array: i corresponds to pgpool child
@@ -483,6 +569,9 @@ int main(int argc, char **argv)
 	}
 	memset(con_info, 0, size);
 
+	if (pool_coninfo_init_index() < 0)
+		myexit(1);
+
 	size = pool_config->num_init_children * (sizeof(ProcessInfo));
 	process_info = pool_shared_memory_create(size);
 	if (process_info == NULL)
@@ -509,11 +598,14 @@ int main(int argc, char **argv)
 	 * From now on, VALID_BACKEND macro can be used.
 	 * (get_next_master_node() uses VALID_BACKEND)
 	 */
-
-	for (i=0;i<NUM_BACKENDS;i++)
+	Backend_status = pool_shared_memory_create(sizeof(POOL_BACKEND_STATUS_SNAPSHOT));
+	if (Backend_status == NULL)
 	{
-		my_backend_status[i] = &(BACKEND_INFO(i).backend_status);
+		pool_error("failed to allocate Backend_status");
+		myexit(1);
 	}
+	memset(Backend_status, 0, sizeof(POOL_BACKEND_STATUS_SNAPSHOT));
+	pool_publish_backend_status();
 
 	/* initialize Req_info */
 	Req_info->kind = NODE_UP_REQUEST;
@@ -529,6 +621,42 @@ int main(int argc, char **argv)
 	}
 	*InRecovery = 0;
 
+	/*
+	 * create pipe for telling online recovery that all frontends
+	 * have gone. Children write to it, and the PCP child waiting for
+	 * the frontends reads from it.
+	 */
+	if (pipe(conn_closed_fds) < 0)
+	{
+		pool_error("failed to create pipe");
+		myexit(1);
+	}
+	pool_set_nonblock(conn_closed_fds[0]);
+	pool_set_nonblock(conn_closed_fds[1]);
+
+	/* create preallocated sequence block area */
+	if (pool_init_sequence_blocks() < 0)
+		myexit(1);
+
+	/* create preallocated large object id block area */
+	if (pool_init_lobj_blocks() < 0)
+		myexit(1);
+
+	/* create log ring buffers */
+	if (pool_init_log_rings() < 0)
+		myexit(1);
+
+	/* create startup packet table for prewarming connection pools */
+	if (pool_init_prewarm() < 0)
+		myexit(1);
+
+	/* create accept queue status and socket to hand off connections */
+	if (pool_init_accept_queue() < 0)
+		myexit(1);
+
+	/* create SSL contexts shared by children */
+	pool_ssl_init_ctx();
+
 	/*
 	 * We need to block signal here. Otherwise child might send some
 	 * signals, for example SIGUSR1(fail over).  Children will inherit
@@ -537,8 +665,16 @@ int main(int argc, char **argv)
 	 */
 	POOL_SETMASK(&BlockSig);
 
+	/* fork logger process before children start logging */
+	if (pool_config->log_buffer_size > 0)
+		logger_pid = logger_fork_a_child();
+
+	/* fork acceptor process */
+	if (pool_config->accept_queue_size > 0)
+		acceptor_pid = acceptor_fork_a_child(unix_fd, inet_fd);
+
 	/* fork the children */
-	for (i=0;i<pool_config->num_init_children;i++)
+	for (i=0;i<num_children_to_fork();i++)
 	{
 		process_info[i].pid = fork_a_child(unix_fd, inet_fd, i);
 		process_info[i].start_time = time(NULL);
@@ -553,6 +689,7 @@ int main(int argc, char **argv)
 	pool_signal(SIGUSR1, failover_handler);
 	pool_signal(SIGUSR2, wakeup_handler);
 	pool_signal(SIGHUP, reload_config_handler);
+	pool_signal(SIGURG, restart_handler);
 
 	/* create pipe for delivering event */
 	if (pipe(pipe_fds) < 0)
@@ -567,9 +704,13 @@ int main(int argc, char **argv)
 	snprintf(pcp_un_addr.sun_path, sizeof(pcp_un_addr.sun_path), "%s/.s.PGSQL.%d",
 			 pool_config->pcp_socket_dir,
 			 pool_config->pcp_port);
-	pcp_unix_fd = create_unix_domain_socket(pcp_un_addr);
+	pcp_unix_fd = take_over_socket(inherited_fds[2], &pcp_un_addr, NULL, 0);
+	if (pcp_unix_fd < 0)
+		pcp_unix_fd = create_unix_domain_socket(pcp_un_addr);
     /* maybe change "*" to pool_config->pcp_listen_addresses */
-	pcp_inet_fd = create_inet_domain_socket("*", pool_config->pcp_port);
+	pcp_inet_fd = take_over_socket(inherited_fds[3], NULL, "*", pool_config->pcp_port);
+	if (pcp_inet_fd < 0)
+		pcp_inet_fd = create_inet_domain_socket("*", pool_config->pcp_port);
 	pcp_pid = pcp_fork_a_child(pcp_unix_fd, pcp_inet_fd, pcp_conf_file);
 
 	/* Fork worker process */
@@ -581,6 +722,26 @@ int main(int argc, char **argv)
 	/* Save primary node id */
 	Req_info->primary_node_id = find_primary_node();
 
+	/*
+	 * We are ready to accept connections. Ask the old pgpool to let
+	 * its children finish their current sessions and exit.
+	 */
+	if (old_pgpool_pid)
+	{
+		write_pid_file();
+
+		for (i=0;i<2;i++)
+		{
+			if (stale_socket_paths[i][0])
+				unlink(stale_socket_paths[i]);
+		}
+
+		pool_log("graceful restart: requesting old pgpool(%d) smart shutdown", old_pgpool_pid);
+		if (kill(old_pgpool_pid, SIGTERM) == -1)
+			pool_error("graceful restart: could not stop old pgpool(%d). reason: %s",
+					   old_pgpool_pid, strerror(errno));
+	}
+
 	/*
 	 * This is the main loop
 	 */
@@ -698,6 +859,51 @@ int main(int argc, char **argv)
 				pool_signal(SIGALRM, SIG_IGN);
 			}
 
+			/*
+			 * If there was no primary node when failover finished,
+			 * a standby may have been promoted since then. Look for
+			 * the primary node so that writes are resumed without
+			 * waiting for the next failover.
+			 */
+			if (Req_info->primary_node_id < 0 && MASTER_SLAVE &&
+				!strcmp(pool_config->master_slave_sub_mode, MODE_STREAMREP))
+			{
+				int primary;
+
+				/*
+				 * A node which accepts connections but never replies
+				 * must not block main, so this is bound by the health
+				 * check timer as well.
+				 */
+				health_check_timer_expired = 0;
+				if (pool_config->health_check_timeout > 0)
+				{
+					pool_signal(SIGALRM, health_check_timer_handler);
+					alarm(pool_config->health_check_timeout);
+				}
+
+				POOL_SETMASK(&UnBlockSig);
+				primary = find_primary_node();
+				POOL_SETMASK(&BlockSig);
+
+				if (pool_config->health_check_timeout > 0)
+				{
+					alarm(0);
+					pool_signal(SIGALRM, SIG_IGN);
+				}
+
+				if (health_check_timer_expired)
+				{
+					pool_log("find_primary_node: health check timer expired");
+					health_check_timer_expired = 0;
+				}
+				else if (primary >= 0)
+				{
+					pool_log("new primary node %d has been found", primary);
+					Req_info->primary_node_id = primary;
+				}
+			}
+
 			sleep_time = pool_config->health_check_period;
 			pool_sleep(sleep_time);
 		}
@@ -711,6 +917,7 @@ int main(int argc, char **argv)
 				POOL_SETMASK(&UnBlockSig);
 				r = pool_pause(&t);
 				POOL_SETMASK(&BlockSig);
+				maintain_spare_children();
 				if (r > 0)
 					break;
 			}
@@ -734,7 +941,8 @@ static void usage(void)
 	fprintf(stderr, "         [ -n ] [ -D ] [ -d ]\n");
 	fprintf(stderr, "  pgpool [ -f CONFIG_FILE ] [ -F PCP_CONFIG_FILE ] [ -a HBA_CONFIG_FILE ]\n");
 	fprintf(stderr, "         [ -m SHUTDOWN-MODE ] stop\n");
-	fprintf(stderr, "  pgpool [ -f CONFIG_FILE ] [ -F PCP_CONFIG_FILE ] [ -a HBA_CONFIG_FILE ] reload\n\n");
+	fprintf(stderr, "  pgpool [ -f CONFIG_FILE ] [ -F PCP_CONFIG_FILE ] [ -a HBA_CONFIG_FILE ] reload\n");
+	fprintf(stderr, "  pgpool [ -f CONFIG_FILE ] [ -F PCP_CONFIG_FILE ] [ -a HBA_CONFIG_FILE ] restart\n\n");
 	fprintf(stderr, "Common options:\n");
 	fprintf(stderr, "  -a, --hba-file=HBA_CONFIG_FILE\n");
 	fprintf(stderr, "                      Sets the path to the pool_hba.conf configuration file\n");
@@ -804,9 +1012,16 @@ static void daemonize(void)
 
     fdlimit = sysconf(_SC_OPEN_MAX);
     for (i = 3; i < fdlimit; i++)
+	{
+		/* keep listen sockets handed over by old pgpool */
+		if (i == inherited_fds[0] || i == inherited_fds[1] ||
+			i == inherited_fds[2] || i == inherited_fds[3])
+			continue;
 		close(i);
+	}
 
-	write_pid_file();
+	if (!old_pgpool_pid)
+		write_pid_file();
 }
 
 
@@ -842,6 +1057,175 @@ static void stop_me(void)
 	fprintf(stderr, "done.\n");
 }
 
+/*
+ * Graceful restart. Execute pgpool again with the same arguments
+ * and hand over the listen sockets. The new pgpool reads the
+ * backend status file written here, and requests smart shutdown of
+ * me when it is ready to accept connections. Until then, my children
+ * keep accepting connections.
+ */
+static void restart_me(void)
+{
+	pid_t pid;
+	char buf[128];
+
+	if (exiting)
+		return;
+
+	pool_log("received graceful restart request");
+
+	/* let the new pgpool know the latest backend status */
+	write_status_file();
+
+	pid = fork();
+	if (pid == -1)
+	{
+		pool_error("restart_me: fork() failed. reason: %s", strerror(errno));
+		return;
+	}
+	else if (pid > 0)
+		return;
+
+	/* fork again so that the new pgpool is not my child */
+	pid = fork();
+	if (pid != 0)
+		_exit(pid == -1 ? 1 : 0);
+
+	close(pipe_fds[0]);
+	close(pipe_fds[1]);
+	close(conn_closed_fds[0]);
+	close(conn_closed_fds[1]);
+
+	snprintf(buf, sizeof(buf), "%d %d %d %d %d", (int)mypid,
+			 unix_fd, inet_fd, pcp_unix_fd, pcp_inet_fd);
+	setenv(INHERITED_SOCKETS_ENV, buf, 1);
+
+	if (startup_cwd[0] && chdir(startup_cwd) < 0)
+		pool_error("restart_me: chdir(%s) failed. reason: %s", startup_cwd, strerror(errno));
+
+	POOL_SETMASK(&UnBlockSig);
+	execvp(myargv[0], myargv);
+
+	pool_error("restart_me: could not execute %s. reason: %s", myargv[0], strerror(errno));
+	_exit(1);
+}
+
+/*
+ * Read listen sockets handed over by the old pgpool on graceful
+ * restart.
+ */
+static void read_inherited_sockets(void)
+{
+	char *env;
+	int pid;
+	int fds[4];
+	int i;
+
+	env = getenv(INHERITED_SOCKETS_ENV);
+	if (env == NULL)
+		return;
+
+	if (sscanf(env, "%d %d %d %d %d", &pid, &fds[0], &fds[1], &fds[2], &fds[3]) == 5)
+	{
+		old_pgpool_pid = pid;
+		for (i=0;i<4;i++)
+			inherited_fds[i] = fds[i] > 0 ? fds[i] : -1;
+	}
+
+	/* do not pass them to processes we execute */
+	unsetenv(INHERITED_SOCKETS_ENV);
+}
+
+/*
+ * Use a listen socket handed over by the old pgpool if it listens on
+ * the UNIX domain socket path specified by addr, or on the TCP port
+ * and the address of hostname if addr is NULL. Otherwise close the
+ * socket. Returns the socket, or -1 if it cannot be used.
+ */
+static int take_over_socket(int fd, struct sockaddr_un *addr, const char *hostname, int port)
+{
+	union {
+		struct sockaddr_un un;
+		struct sockaddr_in in;
+	} sa;
+	socklen_t len = sizeof(sa);
+	struct in_addr in_addr;
+	struct hostent *hostinfo;
+	int i;
+
+	if (fd < 0)
+		return -1;
+
+	memset(&sa, 0, sizeof(sa));
+	if (getsockname(fd, (struct sockaddr *)&sa, &len) < 0)
+	{
+		pool_error("take_over_socket: getsockname() failed. reason: %s", strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	if (addr && sa.un.sun_family == AF_UNIX)
+	{
+		if (!strcmp(sa.un.sun_path, addr->sun_path))
+		{
+			pool_log("graceful restart: take over socket %s", addr->sun_path);
+			return fd;
+		}
+
+		/*
+		 * The old path is not used any more. It is removed when start
+		 * up completes, since the old pgpool still serves it.
+		 */
+		for (i=0;i<2;i++)
+		{
+			if (stale_socket_paths[i][0] == '\0')
+			{
+				strlcpy(stale_socket_paths[i], sa.un.sun_path, sizeof(stale_socket_paths[i]));
+				break;
+			}
+		}
+	}
+	else if (!addr && hostname && sa.in.sin_family == AF_INET && ntohs(sa.in.sin_port) == port)
+	{
+		/* same as create_inet_domain_socket() */
+		if (strcmp(hostname, "*") == 0)
+			in_addr.s_addr = htonl(INADDR_ANY);
+		else
+		{
+			hostinfo = gethostbyname(hostname);
+			if (!hostinfo)
+			{
+				pool_error("take_over_socket: could not resolve host name \"%s\": %s", hostname, hstrerror(h_errno));
+				close(fd);
+				return -1;
+			}
+			in_addr = *(struct in_addr *) hostinfo->h_addr;
+		}
+
+		if (sa.in.sin_addr.s_addr == in_addr.s_addr)
+		{
+			pool_log("graceful restart: take over socket for %s port %d", hostname, port);
+			return fd;
+		}
+		pool_log("graceful restart: listen address has been changed. do not take over socket for port %d", port);
+	}
+
+	close(fd);
+	return -1;
+}
+
+/*
+ * Returns true unless a new pgpool has written its pid to the pid
+ * file by graceful restart.
+ */
+static bool pid_file_is_mine(void)
+{
+	pid_t pid;
+
+	pid = read_pid_file();
+	return pid < 0 || pid == mypid;
+}
+
 /*
 * read the pid file
 */
@@ -1038,6 +1422,9 @@ pid_t fork_a_child(int unix_fd, int inet_fd, int id)
 {
 	pid_t pid;
 
+	/* a new child in the slot */
+	process_info[id].need_refork = 0;
+
 	pid = fork();
 
 	if (pid == 0)
@@ -1113,6 +1500,68 @@ pid_t worker_fork_a_child()
 	return pid;
 }
 
+/*
+* fork logger child process
+*/
+pid_t logger_fork_a_child()
+{
+	pid_t pid;
+
+	pid = fork();
+
+	if (pid == 0)
+	{
+		if (pipe_fds[0] > 0)
+		{
+			close(pipe_fds[0]);
+			close(pipe_fds[1]);
+		}
+
+		myargv = save_ps_display_args(myargc, myargv);
+
+		/* call child main */
+		POOL_SETMASK(&UnBlockSig);
+		do_logger_child();
+	}
+	else if (pid == -1)
+	{
+		pool_error("fork() failed. reason: %s", strerror(errno));
+		myexit(1);
+	}
+	return pid;
+}
+
+/*
+* fork acceptor child process
+*/
+pid_t acceptor_fork_a_child(int unix_fd, int inet_fd)
+{
+	pid_t pid;
+
+	pid = fork();
+
+	if (pid == 0)
+	{
+		if (pipe_fds[0] > 0)
+		{
+			close(pipe_fds[0]);
+			close(pipe_fds[1]);
+		}
+
+		myargv = save_ps_display_args(myargc, myargv);
+
+		/* call child main */
+		POOL_SETMASK(&UnBlockSig);
+		do_acceptor_child(unix_fd, inet_fd);
+	}
+	else if (pid == -1)
+	{
+		pool_error("fork() failed. reason: %s", strerror(errno));
+		myexit(1);
+	}
+	return pid;
+}
+
 /*
 * create inet domain socket
 */
@@ -1259,11 +1708,20 @@ static void myexit(int code)
 		POOL_SETMASK(&UnBlockSig);
 	}
 
-	myunlink(un_addr.sun_path);
-	myunlink(pcp_un_addr.sun_path);
-	myunlink(pool_config->pid_file_name);
+	/*
+	 * If a new pgpool has taken over by graceful restart, the socket
+	 * files, pid file and status file are its own.
+	 */
+	if (pid_file_is_mine())
+	{
+		myunlink(un_addr.sun_path);
+		myunlink(pcp_un_addr.sun_path);
+		myunlink(pool_config->pid_file_name);
 
-	write_status_file();
+		write_status_file();
+	}
+	else
+		pool_log("graceful restart: pid file is not mine. leave socket and status files to the other pgpool");
 
 	pool_shmem_exit(code);
 	exit(code);
@@ -1403,6 +1861,10 @@ static RETSIGTYPE exit_handler(int sig)
 
 	kill(pcp_pid, sig);
 	kill(worker_pid, sig);
+	if (logger_pid)
+		kill(logger_pid, sig);
+	if (acceptor_pid)
+		kill(acceptor_pid, sig);
 
 	POOL_SETMASK(&UnBlockSig);
 
@@ -1546,6 +2008,8 @@ static void failover(void)
 				 BACKEND_INFO(node_id).backend_hostname,
 				 BACKEND_INFO(node_id).backend_port);
 		BACKEND_INFO(node_id).backend_status = CON_CONNECT_WAIT;	/* unset down status */
+		attach_epoch[node_id]++;
+		pool_publish_backend_status();
 		trigger_failover_command(node_id, pool_config->failback_command,
 								 MASTER_NODE_ID, get_next_master_node(), PRIMARY_NODE_ID);
 	}
@@ -1581,6 +2045,7 @@ static void failover(void)
 
 
 				BACKEND_INFO(Req_info->node_id[i]).backend_status = CON_DOWN;	/* set down status */
+				pool_publish_backend_status();
 				/* save down node */
 				nodes[Req_info->node_id[i]] = 1;
 				cnt++;
@@ -1665,6 +2130,44 @@ static void failover(void)
 				 BACKEND_INFO(node_id).backend_hostname,
 				 BACKEND_INFO(node_id).backend_port);
 
+		/*
+		 * Children notice the new backend status published above by
+		 * themselves when they start the next session (see
+		 * check_backend_status()).
+		 */
+		need_to_restart_children = false;
+	}
+	/*
+	 * In master/slave mode, if neither the master nor the primary
+	 * node is detached, sessions on the surviving nodes can continue.
+	 * Children notice the down status by themselves and discard only
+	 * connections to the detached node (see check_backend_status()). Busy
+	 * children whose session uses the detached node as the load
+	 * balancing node are restarted, since they may wait for a node
+	 * which never responds.
+	 */
+	else if (MASTER_SLAVE && Req_info->kind == NODE_DOWN_REQUEST &&
+			 new_master == Req_info->master_node_id &&
+			 !nodes[Req_info->master_node_id] &&
+			 (Req_info->primary_node_id < 0 || !nodes[Req_info->primary_node_id]))
+	{
+		pool_log("Do not restart children because neither master nor primary node is detached");
+
+		for (i = 0; i < pool_config->num_init_children; i++)
+		{
+			pid_t pid = process_info[i].pid;
+			int lb_node = process_info[i].connection_info->load_balancing_node;
+
+			if (pid && !process_info[i].idle && pool_config->load_balance_mode &&
+				lb_node >= 0 && lb_node < MAX_NUM_BACKENDS && nodes[lb_node])
+			{
+				/* it exits with status 0. fork a new one in reaper() anyway */
+				process_info[i].need_refork = 1;
+				kill(pid, SIGQUIT);
+				pool_debug("failover_handler: kill %d using node %d", pid, lb_node);
+			}
+		}
+
 		need_to_restart_children = false;
 	}
 	else
@@ -1744,6 +2247,8 @@ static void failover(void)
 				}
 				else
 				{
+					pool_publish_backend_status();
+
 					/* update new master node */
 					new_master = get_next_master_node();
 					pool_log("failover: %d follow backends have been degenerated", follow_cnt);
@@ -1778,18 +2283,14 @@ static void failover(void)
 	{
 		for (i=0;i<pool_config->num_init_children;i++)
 		{
-			process_info[i].pid = fork_a_child(unix_fd, inet_fd, i);
-			process_info[i].start_time = time(NULL);
-		}
-	}
-	else
-	{
-		/* Set restart request to each child. Children will exit(1)
-		 * whenever they are idle to restart.
-		 */
-		for (i=0;i<pool_config->num_init_children;i++)
-		{
-			process_info[i].need_to_restart = 1;
+			process_info[i].retiring = 0;
+			if (i < num_children_to_fork())
+			{
+				process_info[i].pid = fork_a_child(unix_fd, inet_fd, i);
+				process_info[i].start_time = time(NULL);
+			}
+			else
+				process_info[i].pid = 0;
 		}
 	}
 
@@ -1831,6 +2332,16 @@ static RETSIGTYPE health_check_timer_handler(int sig)
 }
 
 
+/*
+ * Return true if the health check timer has expired in pgpool main
+ * process. Blocking I/O done under the timer gives up on EINTR then.
+ * Children may have inherited the flag, so it is ignored in them.
+ */
+bool health_check_timed_out(void)
+{
+	return health_check_timer_expired && getpid() == mypid;
+}
+
 /*
  * check if we can connect to the backend
  * returns 0 for ok. otherwise returns backend id + 1
@@ -2107,6 +2618,32 @@ static void reaper(void)
 
 			pool_log("fork a new worker child pid %d", worker_pid);
 			break;
+		}
+
+		/* exiting process was logger process */
+		else if (logger_pid && pid == logger_pid)
+		{
+			if (WIFSIGNALED(status))
+				pool_log("logger child %d exits with status %d by signal %d", pid, status, WTERMSIG(status));
+			else
+				pool_log("logger child %d exits with status %d", pid, status);
+
+			logger_pid = logger_fork_a_child();
+			pool_log("fork a new logger child pid %d", logger_pid);
+			break;
+		}
+
+		/* exiting process was acceptor process */
+		else if (acceptor_pid && pid == acceptor_pid)
+		{
+			if (WIFSIGNALED(status))
+				pool_log("acceptor child %d exits with status %d by signal %d", pid, status, WTERMSIG(status));
+			else
+				pool_log("acceptor child %d exits with status %d", pid, status);
+
+			acceptor_pid = acceptor_fork_a_child(unix_fd, inet_fd);
+			pool_log("fork a new acceptor child pid %d", acceptor_pid);
+			break;
 		} else
 		{
 			if (WIFSIGNALED(status))
@@ -2119,14 +2656,29 @@ static void reaper(void)
 			{
 				if (pid == process_info[i].pid)
 				{
-					/* if found, fork a new child */
-					if (!switching && !exiting && status)
+					/* the child may have been killed while waiting for a connection */
+					pool_accept_queue_child_exited(&process_info[i]);
+
+					/*
+					 * if found, fork a new child. If the child pool
+					 * is dynamic, leave the slot empty.
+					 * maintain_spare_children() forks a new child
+					 * if needed.
+					 */
+					if (!switching && !exiting &&
+						(status || process_info[i].need_refork) &&
+						pool_config->max_spare_children <= 0)
 					{
 						process_info[i].pid = fork_a_child(unix_fd, inet_fd, i);
 						process_info[i].start_time = time(NULL);
 						pool_debug("fork a new child pid %d", process_info[i].pid);
 						break;
 					}
+					process_info[i].pid = 0;
+					process_info[i].idle = 0;
+					process_info[i].retiring = 0;
+					process_info[i].need_refork = 0;
+					break;
 				}
 			}
 		}
@@ -2134,6 +2686,104 @@ static void reaper(void)
 	pool_debug("reap_handler: normally exited");
 }
 
+/*
+ * Number of children forked at startup or when all children are
+ * restarted. If the child pool is dynamic, only min_spare_children
+ * are forked and the rest are forked on demand.
+ */
+static int num_children_to_fork(void)
+{
+	int min_spare, max_spare;
+
+	if (pool_config->max_spare_children <= 0)
+		return pool_config->num_init_children;
+
+	get_spare_limits(&min_spare, &max_spare);
+	return Min(min_spare, pool_config->num_init_children);
+}
+
+/*
+ * Get the range of number of idle children. At least one idle child
+ * is always kept to accept connection requests.
+ */
+static void get_spare_limits(int *min_spare, int *max_spare)
+{
+	*min_spare = Max(pool_config->min_spare_children, 1);
+	*max_spare = Max(pool_config->max_spare_children, *min_spare);
+}
+
+/*
+ * Keep the number of idle children between min_spare_children and
+ * max_spare_children, up to num_init_children children. If there
+ * are too few idle children, fork new ones. If there are too many,
+ * request one idle child per second to exit. The child closes its
+ * pooled backend connections by smart shutdown. Called by the main
+ * loop at least once a second while signals are blocked.
+ */
+static void maintain_spare_children(void)
+{
+	static time_t last_retired;
+	int min_spare, max_spare;
+	int nidle = 0;
+	int victim = -1;
+	time_t now;
+	int i;
+
+	if (pool_config->max_spare_children <= 0 || exiting || switching)
+		return;
+
+	get_spare_limits(&min_spare, &max_spare);
+
+	for (i=0;i<pool_config->num_init_children;i++)
+	{
+		if (process_info[i].pid == 0)
+			continue;
+
+		if (process_info[i].retiring)
+		{
+			/*
+			 * The child may have received the signal before it
+			 * started waiting for a connection request. Tell it
+			 * again.
+			 */
+			if (process_info[i].idle)
+				kill(process_info[i].pid, SIGTERM);
+			continue;
+		}
+
+		if (process_info[i].idle)
+		{
+			nidle++;
+			victim = i;
+		}
+	}
+
+	/* fork new children into empty slots */
+	for (i=0;i<pool_config->num_init_children && nidle < min_spare;i++)
+	{
+		if (process_info[i].pid)
+			continue;
+
+		/* the child becomes idle soon. count it as idle now */
+		process_info[i].idle = 1;
+		process_info[i].retiring = 0;
+		process_info[i].pid = fork_a_child(unix_fd, inet_fd, i);
+		process_info[i].start_time = time(NULL);
+		pool_debug("maintain_spare_children: fork a new child pid %d", process_info[i].pid);
+		nidle++;
+	}
+
+	now = time(NULL);
+	if (nidle > max_spare && victim >= 0 && now != last_retired)
+	{
+		pool_debug("maintain_spare_children: %d idle children. retire child pid %d",
+				   nidle, process_info[victim].pid);
+		process_info[victim].retiring = 1;
+		kill(process_info[victim].pid, SIGTERM);
+		last_retired = now;
+	}
+}
+
 /*
  * get node information specified by node_number
  */
@@ -2155,6 +2805,69 @@ pool_get_node_count(void)
 	return NUM_BACKENDS;
 }
 
+/*
+ * Publish the current status of DB nodes as a new snapshot on shared
+ * memory, and take it as my own copy. Must be called by pgpool main
+ * whenever it changes backend_status.
+ */
+void
+pool_publish_backend_status(void)
+{
+	POOL_BACKEND_STATUS_SNAPSHOT snapshot;
+	int i;
+
+	memset(&snapshot, 0, sizeof(snapshot));
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		if (BACKEND_INFO(i).backend_status == CON_UP ||
+			BACKEND_INFO(i).backend_status == CON_CONNECT_WAIT)
+			snapshot.valid[i >> 5] |= 1U << (i & 31);
+		snapshot.attach_epoch[i] = attach_epoch[i];
+	}
+
+	pool_semaphore_lock(BACKEND_STATUS_SEM);
+	snapshot.generation = Backend_status->generation + 1;
+	*Backend_status = snapshot;
+	pool_semaphore_unlock(BACKEND_STATUS_SEM);
+
+	my_backend_status = snapshot;
+}
+
+/*
+ * Copy the snapshot of backend status into *snapshot if its
+ * generation is different from my copy. Returns true if copied. The
+ * generation is compared without lock, so this costs almost nothing
+ * while the status is not changed.
+ */
+bool
+pool_get_backend_status(POOL_BACKEND_STATUS_SNAPSHOT *snapshot)
+{
+	if (((volatile POOL_BACKEND_STATUS_SNAPSHOT *)Backend_status)->generation ==
+		my_backend_status.generation)
+		return false;
+
+	pool_semaphore_lock(BACKEND_STATUS_SEM);
+	*snapshot = *Backend_status;
+	pool_semaphore_unlock(BACKEND_STATUS_SEM);
+	return true;
+}
+
+/*
+ * Take the latest snapshot of backend status as my own copy. Returns
+ * true if the status has been changed since the last call.
+ */
+bool
+pool_refresh_backend_status(void)
+{
+	POOL_BACKEND_STATUS_SNAPSHOT snapshot;
+
+	if (!pool_get_backend_status(&snapshot))
+		return false;
+
+	my_backend_status = snapshot;
+	return true;
+}
+
 /*
  * get process ids
  */
@@ -2164,10 +2877,14 @@ pool_get_process_list(int *array_size)
 	int	   *array;
 	int		i;
 
-	*array_size = pool_config->num_init_children;
-	array = calloc(*array_size, sizeof(int));
-	for (i = 0; i < *array_size; i++)
-		array[i] = process_info[i].pid;
+	array = calloc(pool_config->num_init_children, sizeof(int));
+	*array_size = 0;
+	for (i = 0; i < pool_config->num_init_children; i++)
+	{
+		/* skip empty slots of the dynamic child pool */
+		if (process_info[i].pid)
+			array[(*array_size)++] = process_info[i].pid;
+	}
 
 	return array;
 }
@@ -2218,6 +2935,18 @@ static RETSIGTYPE wakeup_handler(int sig)
 	POOL_SETMASK(&UnBlockSig);
 }
 
+/*
+ * handle SIGURG
+ * Graceful restart
+ */
+static RETSIGTYPE restart_handler(int sig)
+{
+	POOL_SETMASK(&BlockSig);
+	restart_request = 1;
+	write(pipe_fds[1], "\0", 1);
+	POOL_SETMASK(&UnBlockSig);
+}
+
 /*
  * handle SIGHUP
  *
@@ -2234,8 +2963,12 @@ static void reload_config(void)
 {
 	pool_log("reload config files.");
 	pool_get_config(conf_file, RELOAD_CONFIG);
+	/* DB nodes may have been added */
+	pool_publish_backend_status();
 	if (pool_config->enable_pool_hba)
 		load_hba(hba_file);
+	/* reload pool_passwd so that new children inherit it */
+	pool_reload_pool_passwd();
 	if (pool_config->parallel_mode)
 		pool_memset_system_db_info(system_db_info->info);
 	kill_all_children(SIGHUP);
@@ -2277,6 +3010,18 @@ static int pool_pause(struct timeval *timeout)
 	fd_set rfds;
 	int n;
 	char dummy;
+	struct timeval t;
+
+	/*
+	 * If the child pool is dynamic, wake up at least once a second
+	 * so that the caller adjusts the number of idle children.
+	 */
+	if (pool_config->max_spare_children > 0 && timeout->tv_sec >= 1)
+	{
+		t.tv_sec = 1;
+		t.tv_usec = 0;
+		timeout = &t;
+	}
 
 	FD_ZERO(&rfds);
 	FD_SET(pipe_fds[0], &rfds);
@@ -2296,20 +3041,51 @@ static int pool_pause(struct timeval *timeout)
  */
 void pool_sleep(unsigned int second)
 {
-	struct timeval current_time, sleep_time;
+	struct timeval until;
+
+	gettimeofday(&until, NULL);
+	until.tv_sec += second;
+	sleep_until(&until);
+}
+
+/*
+ * Same as pool_sleep() but sleeps for milliseconds specified by
+ * "msec".
+ */
+static void pool_sleep_msec(int msec)
+{
+	struct timeval until;
+
+	gettimeofday(&until, NULL);
+	until.tv_sec += msec / 1000;
+	until.tv_usec += (msec % 1000) * 1000;
+	if (until.tv_usec >= 1000000)
+	{
+		until.tv_sec++;
+		until.tv_usec -= 1000000;
+	}
+	sleep_until(&until);
+}
+
+/*
+ * Sleep until the time specified by "until" while processing pending
+ * signal events. Used by pool_sleep() and pool_sleep_msec().
+ */
+static void sleep_until(struct timeval *until)
+{
+	struct timeval current_time;
 
 	gettimeofday(&current_time, NULL);
-	sleep_time.tv_sec = second + current_time.tv_sec;
-	sleep_time.tv_usec = current_time.tv_usec;
 
 	POOL_SETMASK(&UnBlockSig);
-	while (sleep_time.tv_sec > current_time.tv_sec)
+	while (until->tv_sec > current_time.tv_sec ||
+		   (until->tv_sec == current_time.tv_sec && until->tv_usec > current_time.tv_usec))
 	{
 		struct timeval timeout;
 		int r;
 
-		timeout.tv_sec = sleep_time.tv_sec - current_time.tv_sec;
-		timeout.tv_usec = sleep_time.tv_usec - current_time.tv_usec;
+		timeout.tv_sec = until->tv_sec - current_time.tv_sec;
+		timeout.tv_usec = until->tv_usec - current_time.tv_usec;
 		if (timeout.tv_usec < 0)
 		{
 			timeout.tv_sec--;
@@ -2320,6 +3096,7 @@ void pool_sleep(unsigned int second)
 		POOL_SETMASK(&BlockSig);
 		if (r > 0)
 			CHECK_REQUEST;
+		maintain_spare_children();
 		POOL_SETMASK(&UnBlockSig);
 		gettimeofday(&current_time, NULL);
 	}
@@ -2457,16 +3234,17 @@ static int trigger_failover_command(int node, const char *command_line,
 
 /*
  * Find the primary node (i.e. not standby node) and returns its node
- * id. If no primary node is found, returns -1.
+ * id. If no primary node is found, returns -1. Connections to all
+ * valid nodes are made at once, so that an unreachable node does not
+ * delay checking the other nodes. Nodes which cannot be connected to
+ * are skipped.
  */
 static int find_primary_node(void)
 {
-	BackendInfo *bkinfo;
-	POOL_CONNECTION_POOL_SLOT *s;
-	POOL_CONNECTION *con; 
+	POOL_CONNECTION_POOL_SLOT *slots[MAX_NUM_BACKENDS];
 	POOL_STATUS status;
 	POOL_SELECT_RESULT *res;
-	bool is_standby;
+	int primary = -1;
 	int i;
 
 	/* Streaming replication mode? */
@@ -2480,98 +3258,82 @@ static int find_primary_node(void)
 		return -1;
 	}
 
+	make_persistent_db_connections(slots, "postgres",
+								   pool_config->health_check_user, "");
+
 	for(i=0;i<NUM_BACKENDS;i++)
 	{
-		if (!VALID_BACKEND(i))
+		if (slots[i] == NULL)
+		{
+			if (VALID_BACKEND(i))
+				pool_error("find_primary_node: make_persistent_connection to node %d failed", i);
 			continue;
+		}
 
 		/*
 		 * Check to see if this is a standby node or not.
 		 */
-		is_standby = false;
-
-		bkinfo = pool_get_node_info(i);
-		s = make_persistent_db_connection(bkinfo->backend_hostname, 
-										  bkinfo->backend_port,
-										  "postgres",
-										  pool_config->health_check_user,
-										  "");
-		if (!s)
-		{
-			pool_error("find_primary_node: make_persistent_connection failed");
-			return -1;
-		}
-		con = s->con;
-#ifdef NOT_USED
-		status = do_query(con, "SELECT count(*) FROM pg_catalog.pg_proc AS p WHERE p.proname = 'pgpool_walrecrunning'",
-						  &res, PROTO_MAJOR_V3);
-		if (res->numrows <= 0)
-		{
-			pool_log("find_primary_node: do_query returns no rows");
-		}
-		if (res->data[0] == NULL)
-		{
-			pool_log("find_primary_node: do_query returns no data");
-		}
-		if (res->nullflags[0] == -1)
-		{
-			pool_log("find_primary_node: do_query returns NULL");
-		}
-		if (res->data[0] && !strcmp(res->data[0], "0"))
-		{
-			pool_log("find_primary_node: pgpool_walrecrunning does not exist");
-			free_select_result(res);
-			discard_persistent_db_connection(s);
-			return -1;
-		}
-#endif
-		status = do_query(con, "SELECT pg_is_in_recovery()",
-						  &res, PROTO_MAJOR_V3);
-		if (res->numrows <= 0)
-		{
-			pool_log("find_primary_node: do_query returns no rows");
-		}
-		if (res->data[0] == NULL)
+		if (primary < 0)
 		{
-			pool_log("find_primary_node: do_query returns no data");
-		}
-		if (res->nullflags[0] == -1)
-		{
-			pool_log("find_primary_node: do_query returns NULL");
-		}
-		if (res->data[0] && !strcmp(res->data[0], "t"))
-		{
-			is_standby = true;
-		}   
-		free_select_result(res);
-		discard_persistent_db_connection(s);
+			res = NULL;
+			status = do_query(slots[i]->con, "SELECT pg_is_in_recovery()",
+							  &res, PROTO_MAJOR_V3);
+			if (status != POOL_CONTINUE || res == NULL)
+			{
+				pool_error("find_primary_node: do_query failed on node %d", i);
+				if (res)
+					free_select_result(res);
+				discard_persistent_db_connection(slots[i]);
+				continue;
+			}
+			if (res->numrows <= 0)
+			{
+				pool_log("find_primary_node: do_query returns no rows");
+			}
+			else if (res->data[0] == NULL)
+			{
+				pool_log("find_primary_node: do_query returns no data");
+			}
+			else if (res->nullflags[0] == -1)
+			{
+				pool_log("find_primary_node: do_query returns NULL");
+			}
 
-		/*
-		 * If this is a standby, we continue to look for primary node.
-		 */
-		if (is_standby)
-		{
-			pool_debug("find_primary_node: %d node is standby", i);
-		}
-		else
-		{
-			break;
+			/*
+			 * If this is a standby, we continue to look for primary node.
+			 */
+			if (res->numrows > 0 && res->data[0] && !strcmp(res->data[0], "t"))
+			{
+				pool_debug("find_primary_node: %d node is standby", i);
+			}
+			else
+			{
+				primary = i;
+			}
+			free_select_result(res);
 		}
+		discard_persistent_db_connection(slots[i]);
 	}
 
-	if (i == NUM_BACKENDS)
+	if (primary < 0)
 	{
 		pool_debug("find_primary_node: no primary node found");
 		return -1;
 	}
 
-	pool_log("find_primary_node: primary node id is %d", i);
-	return i;
+	pool_log("find_primary_node: primary node id is %d", primary);
+	return primary;
 }
 
+/*
+ * Look for the primary node until it's found or recovery_timeout
+ * seconds have passed. Nodes are checked every
+ * PRIMARY_SEARCH_INTERVAL milliseconds so that a standby promoted by
+ * failover_command is found as soon as it is ready.
+ */
 static int find_primary_node_repeatedly(void)
 {
-	int sec;
+	struct timeval start, now;
 	int node_id = -1;
 
 	/* Streaming replication mode? */
@@ -2586,12 +3348,18 @@ static int find_primary_node_repeatedly(void)
 	}
 
 	pool_log("find_primary_node_repeatedly: waiting for finding a primary node");
-	for (sec = 0; sec < pool_config->recovery_timeout; sec++)
+	gettimeofday(&start, NULL);
+	for (;;)
 	{
 		node_id = find_primary_node();
 		if (node_id != -1)
 			break;
-		pool_sleep(1);
+
+		gettimeofday(&now, NULL);
+		if (now.tv_sec - start.tv_sec >= pool_config->recovery_timeout)
+			break;
+
+		pool_sleep_msec(PRIMARY_SEARCH_INTERVAL);
 	}
 	return node_id;
 }
@@ -99,12 +99,17 @@ typedef struct {
 	pid_t pid; /* OS's process id */
 	time_t start_time; /* fork() time */
 	ConnectionInfo *connection_info; /* head of the connection info for this process */
-	char need_to_restart;		/* If non 0, exit this child process
-								 * as soon as current session ends.
-								 * Typical case this flag being set is
-								 * failback a node in streaming
-								 * replication mode.
-								 */
+	char idle;			/* non 0 if waiting for a connection request */
+	char retiring;		/* non 0 if pgpool main requested this child
+						 * to exit because there are too many idle
+						 * children. See max_spare_children.
+						 */
+	char queue_waiting;	/* non 0 if counted in idle_children of the
+						 * accept queue. See accept_queue_size.
+						 */
+	char need_refork;	/* non 0 if pgpool main killed this child on
+						 * failover and forks a new one when it exits.
+						 */
 } ProcessInfo;
 
 /*
@@ -194,6 +199,7 @@ typedef struct {
 	char username[POOLCONFIG_MAXIDENTLEN+1];
 	char create_time[POOLCONFIG_MAXDATELEN+1];
 	char pool_counter[POOLCONFIG_MAXCOUNTLEN+1];
+	char status[POOLCONFIG_MAXIDENTLEN+1];
 } POOL_REPORT_PROCESSES;
 
 /* pools reporting struct */
@@ -232,6 +238,7 @@ extern int pcp_attach_node(int nid);
 extern POOL_REPORT_CONFIG* pcp_pool_status(int *array_size);
 extern void pcp_set_timeout(long sec);
 extern int pcp_recovery_node(int nid);
+extern int pcp_recovery_node_with_progress(int nid, void (*progress)(char *msg));
 extern void pcp_enable_debug(void);
 extern void pcp_disable_debug(void);
 extern int pcp_promote_node(int nid);
@@ -54,6 +54,7 @@ static int pcp_authorize(char *username, char *password);
 
 static int _pcp_detach_node(int nid, bool gracefully);
 static int _pcp_promote_node(int nid, bool gracefully);
+static int _pcp_recovery_node(int nid, void (*progress)(char *msg));
 
 /* --------------------------------
  * pcp_connect - open connection to pgpool using given arguments
@@ -1381,6 +1382,25 @@ pcp_set_timeout(long sec)
 
 int
 pcp_recovery_node(int nid)
+{
+	return _pcp_recovery_node(nid, NULL);
+}
+
+/* --------------------------------
+ * pcp_recovery_node_with_progress - recover a node, calling "progress"
+ * with each progress report message sent by pgpool
+ *
+ * return 0 on success, -1 otherwise
+ * --------------------------------
+ */
+int
+pcp_recovery_node_with_progress(int nid, void (*progress)(char *msg))
+{
+	return _pcp_recovery_node(nid, progress);
+}
+
+static int
+_pcp_recovery_node(int nid, void (*progress)(char *msg))
 {
 	int wsize;
 	char node_id[16];
@@ -1397,7 +1417,7 @@ pcp_recovery_node(int nid)
 
 	snprintf(node_id, sizeof(node_id), "%d", nid);
 
-	pcp_write(pc, "O", 1);
+	pcp_write(pc, progress ? "o" : "O", 1);
 	wsize = htonl(strlen(node_id)+1 + sizeof(int));
 	pcp_write(pc, &wsize, sizeof(int));
 	pcp_write(pc, node_id, strlen(node_id)+1);
@@ -1408,23 +1428,34 @@ pcp_recovery_node(int nid)
 	}
 	if (debug) fprintf(stderr, "DEBUG: send: tos=\"D\", len=%d\n", ntohl(wsize));
 
-	if (pcp_read(pc, &tos, 1))
-		return -1;
-	if (pcp_read(pc, &rsize, sizeof(int)))
-		return -1;
-	rsize = ntohl(rsize);
-	buf = (char *)malloc(rsize);
-	if (buf == NULL)
-	{
-		errorcode = NOMEMERR;
-		return -1;
-	}
-	if (pcp_read(pc, buf, rsize - sizeof(int)))
+	for (;;)
 	{
+		if (pcp_read(pc, &tos, 1))
+			return -1;
+		if (pcp_read(pc, &rsize, sizeof(int)))
+			return -1;
+		rsize = ntohl(rsize);
+		buf = (char *)malloc(rsize);
+		if (buf == NULL)
+		{
+			errorcode = NOMEMERR;
+			return -1;
+		}
+		if (pcp_read(pc, buf, rsize - sizeof(int)))
+		{
+			free(buf);
+			return -1;
+		}
+		if (debug) fprintf(stderr, "DEBUG: recv: tos=\"%c\", len=%d, data=%s\n", tos, rsize, buf);
+
+		/* progress report. wait for the result */
+		if (tos != 'p')
+			break;
+
+		if (progress)
+			progress(buf);
 		free(buf);
-		return -1;
 	}
-	if (debug) fprintf(stderr, "DEBUG: recv: tos=\"%c\", len=%d, data=%s\n", tos, rsize, buf);
 
 	if (tos == 'e')
 	{
@@ -34,6 +34,7 @@
 
 static void usage(void);
 static void myexit(ErrorCode e);
+static void print_progress(char *msg);
 
 int
 main(int argc, char **argv)
@@ -46,19 +47,26 @@ main(int argc, char **argv)
 	int nodeID;
 	int ch;
 	int	optindex;
+	int verbose = 0;
+	int r;
 
 	static struct option long_options[] = {
 		{"debug", no_argument, NULL, 'd'},
+		{"verbose", no_argument, NULL, 'v'},
 		{"help", no_argument, NULL, 'h'},
 		{NULL, 0, NULL, 0}
 	};
 	
-    while ((ch = getopt_long(argc, argv, "hd", long_options, &optindex)) != -1) {
+    while ((ch = getopt_long(argc, argv, "hdv", long_options, &optindex)) != -1) {
 		switch (ch) {
 		case 'd':
 			pcp_enable_debug();
 			break;
 
+		case 'v':
+			verbose = 1;
+			break;
+
 		case 'h':
 		case '?':
 		default:
@@ -131,7 +139,12 @@ main(int argc, char **argv)
 		myexit(errorcode);
 	}
 
-	if (pcp_recovery_node(nodeID))
+	if (verbose)
+		r = pcp_recovery_node_with_progress(nodeID, print_progress);
+	else
+		r = pcp_recovery_node(nodeID);
+
+	if (r)
 	{
 		pcp_errorstr(errorcode);
 		pcp_disconnect();
@@ -143,13 +156,21 @@ main(int argc, char **argv)
 	return 0;
 }
 
+static void
+print_progress(char *msg)
+{
+	printf("%s\n", msg);
+	fflush(stdout);
+}
+
 static void
 usage(void)
 {
 	fprintf(stderr, "pcp_recovery_node - recovery a node\n\n");
-	fprintf(stderr, "Usage: pcp_recovery_node [-d] timeout hostname port# username password nodeID\n");
+	fprintf(stderr, "Usage: pcp_recovery_node [-d] [-v] timeout hostname port# username password nodeID\n");
 	fprintf(stderr, "Usage: pcp_recovery_node -h\n\n");
 	fprintf(stderr, "  -d, --debug : enable debug message (optional)\n");
+	fprintf(stderr, "  -v, --verbose : print progress of the recovery (optional)\n");
 	fprintf(stderr, "  timeout     : connection timeout value in seconds. command exits on timeout\n");
 	fprintf(stderr, "  hostname    : pgpool-II hostname\n");
 	fprintf(stderr, "  port#       : PCP port number\n");
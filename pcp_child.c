@@ -78,6 +78,9 @@ extern char **myargv;
 static volatile sig_atomic_t pcp_got_sighup = 0;
 volatile sig_atomic_t pcp_wakeup_request = 0;
 
+/* frontend which asked for progress reports of online recovery */
+static PCP_CONNECTION *progress_frontend = NULL;
+
 void
 pcp_do_child(int unix_fd, int inet_fd, char *pcp_conf_file)
 {
@@ -781,6 +784,7 @@ pcp_do_child(int unix_fd, int inet_fd, char *pcp_conf_file)
 			}
 
 			case 'O': /* recovery request */
+			case 'o': /* recovery request with progress reports */
 			{
 				int node_id;
 				int wsize;
@@ -814,7 +818,10 @@ pcp_do_child(int unix_fd, int inet_fd, char *pcp_conf_file)
 				{
 					pool_debug("pcp_child: start online recovery");
 
+					if (tos == 'o')
+						progress_frontend = frontend;
 					r = start_recovery(node_id);
+					progress_frontend = NULL;
 					finish_recovery();
 
 					if (r == 0) /* success */
@@ -1030,6 +1037,31 @@ wakeup_handler(int sig)
 	pcp_wakeup_request = 1;
 }
 
+/*
+ * Send a progress report of online recovery to the frontend if it
+ * asked for them. The recovery goes on even if the frontend has gone.
+ */
+void
+pcp_report_progress(char *msg)
+{
+	int len;
+	int wsize;
+
+	if (progress_frontend == NULL)
+		return;
+
+	len = strlen(msg) + 1;
+	pcp_write(progress_frontend, "p", 1);
+	wsize = htonl(sizeof(int) + len);
+	pcp_write(progress_frontend, &wsize, sizeof(int));
+	pcp_write(progress_frontend, msg, len);
+	if (pcp_flush(progress_frontend) < 0)
+	{
+		pool_debug("pcp_report_progress: pcp_flush() failed. reason: %s", strerror(errno));
+		progress_frontend = NULL;
+	}
+}
+
 static PCP_CONNECTION *
 pcp_do_accept(int unix_fd, int inet_fd)
 {
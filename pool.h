@@ -134,6 +134,9 @@ typedef struct {
 	int num;	/* number of entries */
 	char **names;		/* parameter names */
 	char **values;		/* values */
+	short *hash;		/* hash table on names. entry number + 1, 0 if unused */
+	char *messages;		/* ParameterStatus messages for all entries, or NULL */
+	int messages_len;	/* length of messages */
 } ParamStatus;
 
 /*
@@ -259,20 +262,41 @@ typedef struct {
 #define BACKEND_INFO(backend_id) (pool_config->backend_desc->backend_info[(backend_id)])
 #define LOAD_BALANCE_STATUS(backend_id) (pool_config->load_balance_status[(backend_id)])
 
+/*
+ * Snapshot of backend status. pgpool main publishes a new snapshot on
+ * shared memory whenever it changes the status of DB nodes, and
+ * advances generation. Each process looks at its own copy of the
+ * snapshot and takes a new copy only when generation has been
+ * advanced (see pool_refresh_backend_status()). valid has a bit set
+ * for each DB node which is up or waiting for connection. attach_epoch
+ * is advanced each time a DB node is failed back, so that a process
+ * which missed both the detach and the re-attach still notices it.
+ */
+#define BACKEND_MASK_WORDS ((MAX_NUM_BACKENDS + 31) / 32)
+#define BACKEND_MASK_BIT(mask, backend_id) \
+	((mask)[(backend_id) >> 5] & (1U << ((backend_id) & 31)))
+
+typedef struct {
+	unsigned int generation;
+	unsigned int valid[BACKEND_MASK_WORDS];
+	unsigned int attach_epoch[MAX_NUM_BACKENDS];
+} POOL_BACKEND_STATUS_SNAPSHOT;
+
 /*
  * This macro returns true if:
  *   current query is in progress and the DB node is healthy OR
  *   no query is in progress and the DB node is healthy
+ * The bitmask is tested first so that DB nodes not in use cost
+ * nothing more.
  */
 extern bool pool_is_node_to_be_sent_in_current_query(int node_id);
 extern int pool_virtual_master_db_node_id(void);
-extern BACKEND_STATUS* my_backend_status[];
+extern POOL_BACKEND_STATUS_SNAPSHOT my_backend_status;
 
 #define VALID_BACKEND(backend_id) \
 	((RAW_MODE && (backend_id) == REAL_MASTER_NODE_ID) ||		\
-	(pool_is_node_to_be_sent_in_current_query((backend_id)) &&	\
-	 ((*(my_backend_status[(backend_id)]) == CON_UP) ||			\
-	  (*(my_backend_status[(backend_id)]) == CON_CONNECT_WAIT))))
+	 (BACKEND_MASK_BIT(my_backend_status.valid, (backend_id)) &&	\
+	  pool_is_node_to_be_sent_in_current_query((backend_id))))
 
 #define CONNECTION_SLOT(p, slot) ((p)->slots[(slot)])
 #define CONNECTION(p, slot) (CONNECTION_SLOT(p, slot)->con)
@@ -329,9 +353,16 @@ extern BACKEND_STATUS* my_backend_status[];
 #define NO_LOAD_BALANCE "/*NO LOAD BALANCE*/"
 #define NO_LOAD_BALANCE_COMMENT_SZ (sizeof(NO_LOAD_BALANCE)-1)
 
-#define MAX_NUM_SEMAPHORES		3
+#define MAX_NUM_SEMAPHORES		9
 #define CONN_COUNTER_SEM 0
 #define REQUEST_INFO_SEM 1
+#define SEQUENCE_BLOCK_SEM 2
+#define LOBJ_BLOCK_SEM 3
+#define CONINFO_INDEX_SEM 4
+#define PREWARM_SEM 5
+#define ACCEPT_SEM 6
+#define ACCEPT_QUEUE_SEM 7
+#define BACKEND_STATUS_SEM 8
 
 /*
  * number specified when semaphore is locked/unlocked
@@ -398,7 +429,9 @@ extern POOL_SYSTEMDB_CONNECTION_POOL *system_db_info; /* systemdb */
 extern ProcessInfo *process_info; /* shmem process information table */
 extern ConnectionInfo *con_info; /* shmem connection info table */
 extern POOL_REQUEST_INFO *Req_info;
+extern POOL_BACKEND_STATUS_SNAPSHOT *Backend_status; /* shmem backend status */
 extern volatile sig_atomic_t *InRecovery;
+extern int conn_closed_fds[2];
 extern char remote_ps_data[];		/* used for set_ps_display */
 extern volatile sig_atomic_t got_sighup;
 extern volatile sig_atomic_t exit_request;
@@ -425,6 +458,7 @@ extern void pool_log(const char *fmt,...);
 #endif
 extern void do_child(int unix_fd, int inet_fd);
 extern void pcp_do_child(int unix_fd, int inet_fd, char *pcp_conf_file);
+extern void pcp_report_progress(char *msg);
 extern int select_load_balancing_node(void);
 extern int pool_init_cp(void);
 extern POOL_STATUS pool_process_query(POOL_CONNECTION *frontend,
@@ -433,10 +467,12 @@ extern POOL_STATUS pool_process_query(POOL_CONNECTION *frontend,
 
 extern int pool_do_auth(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend);
 extern int pool_do_reauth(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *cp);
+extern int pool_do_prewarm_auth(POOL_CONNECTION_POOL *cp);
 
 /* SSL functionality */
 extern void pool_ssl_negotiate_serverclient(POOL_CONNECTION *cp);
 extern void pool_ssl_negotiate_clientserver(POOL_CONNECTION *cp);
+extern void pool_ssl_init_ctx(void);
 extern void pool_ssl_close(POOL_CONNECTION *cp);
 extern int pool_ssl_read(POOL_CONNECTION *cp, void *buf, int size);
 extern int pool_ssl_write(POOL_CONNECTION *cp, const void *buf, int size);
@@ -452,6 +488,7 @@ extern void notice_backend_error(int node_id);
 extern void degenerate_backend_set(int *node_id_set, int count);
 extern void promote_backend(int node_id);
 extern void send_failback_request(int node_id);
+extern bool health_check_timed_out(void);
 
 
 extern void pool_set_timeout(int timeoutval);
@@ -473,6 +510,7 @@ extern void pool_discard_params(ParamStatus *params);
 extern char *pool_find_name(ParamStatus *params, char *name, int *pos);
 extern int pool_get_param(ParamStatus *params, int index, char **name, char **value);
 extern int pool_add_param(ParamStatus *params, char *name, char *value);
+extern char *pool_get_param_messages(ParamStatus *params, int *len);
 extern void pool_param_debug_print(ParamStatus *params);
 
 extern void pool_send_error_message(POOL_CONNECTION *frontend, int protoMajor,
@@ -516,6 +554,9 @@ extern void pool_semaphore_unlock(int semNum);
 
 extern BackendInfo *pool_get_node_info(int node_number);
 extern int pool_get_node_count(void);
+extern void pool_publish_backend_status(void);
+extern bool pool_get_backend_status(POOL_BACKEND_STATUS_SNAPSHOT *snapshot);
+extern bool pool_refresh_backend_status(void);
 extern int *pool_get_process_list(int *array_size);
 extern ProcessInfo *pool_get_process_info(pid_t pid);
 extern SystemDBInfo *pool_get_system_db_info(void);
@@ -523,7 +564,9 @@ extern POOL_STATUS OneNode_do_command(POOL_CONNECTION *frontend, POOL_CONNECTION
 
 /* child.c */
 extern POOL_CONNECTION_POOL_SLOT *make_persistent_db_connection(
-	char *hostname, int port, char *dbname, char *user, char *password);
+	int node_id, char *hostname, int port, char *dbname, char *user, char *password);
+extern void make_persistent_db_connections(POOL_CONNECTION_POOL_SLOT **slots,
+										   char *dbname, char *user, char *password);
 extern void discard_persistent_db_connection(POOL_CONNECTION_POOL_SLOT *cp);
 
 /* define pool_system.c */
@@ -565,9 +608,13 @@ extern int start_recovery(int recovery_node);
 extern void finish_recovery(void);
 extern int wait_connection_closed(void);
 
+/* pool_base_backup.c */
+extern int pool_base_backup(BackendInfo *primary, BackendInfo *target, bool standby);
+
 /* child.c */
 extern void cancel_request(CancelPacket *sp);
 extern void check_stop_request(void);
+extern void check_down_nodes(void);
 
 /* pool_process_query.c */
 extern void reset_variables(void);
@@ -578,6 +625,7 @@ extern int pool_extract_error_message(bool read_kind, POOL_CONNECTION *backend,
 extern POOL_STATUS do_command(POOL_CONNECTION *frontend, POOL_CONNECTION *backend,
 					   char *query, int protoMajor, int pid, int key, int no_ready_for_query);
 extern POOL_STATUS do_query(POOL_CONNECTION *backend, char *query, POOL_SELECT_RESULT **result, int major);
+extern POOL_STATUS pool_pipeline_commands(POOL_CONNECTION_POOL *backend, char **commands, int n);
 extern void free_select_result(POOL_SELECT_RESULT *result);
 extern int compare(const void *p1, const void *p2);
 extern POOL_STATUS do_error_execute_command(POOL_CONNECTION_POOL *backend, int node_id, int major);
@@ -592,6 +640,62 @@ extern void pool_sleep(unsigned int second);
 /* pool_worker_child.c */
 extern void do_worker_child(void);
 
+/*
+ * Per child log ring buffer placed on shared memory. The owning child
+ * is the only writer, advancing head. The logger process is the only
+ * reader, advancing tail. head and tail are free running counters,
+ * size is a power of 2.
+ */
+typedef struct {
+	volatile unsigned int head;		/* next write position */
+	volatile unsigned int tail;		/* next read position */
+	volatile unsigned int dropped;	/* number of messages dropped */
+	unsigned int size;				/* size of data */
+	char data[1];					/* ring data, actually size bytes */
+} POOL_LOG_RING;
+
+#ifdef __GNUC__
+#define POOL_MEMORY_BARRIER()	__sync_synchronize()
+#else
+#define POOL_MEMORY_BARRIER()
+#endif
+
+/* pool_error.c */
+extern void pool_set_log_ring(POOL_LOG_RING *ring);
+
+/* pool_logger.c */
+extern int pool_init_log_rings(void);
+extern POOL_LOG_RING *pool_get_log_ring(int proc_id);
+extern void do_logger_child(void);
+
+/*
+ * Accept queue status placed on shared memory. Protected by
+ * ACCEPT_QUEUE_SEM.
+ */
+typedef struct {
+	int idle_children;		/* children waiting for a connection from the queue */
+	int in_flight;			/* connections handed off but not received yet */
+	int queue_length;		/* number of connections in the queue */
+	long long handed_off;	/* number of connections handed off to children */
+	long long total_wait;	/* total time connections waited in the queue in usec */
+	long long max_wait;		/* max time a connection waited in the queue in usec */
+} POOL_ACCEPT_QUEUE_STATUS;
+
+/* pool_accept_queue.c */
+extern int pool_init_accept_queue(void);
+extern POOL_ACCEPT_QUEUE_STATUS *pool_get_accept_queue_status(void);
+extern int pool_accept_queue_fd(void);
+extern void pool_accept_queue_wait(void);
+extern void pool_accept_queue_cancel(void);
+extern int pool_accept_queue_receive(SockAddr *saddr);
+extern void pool_accept_queue_child_exited(ProcessInfo *pi);
+extern void do_acceptor_child(int unix_fd, int inet_fd);
+
+/* pool_prewarm.c */
+extern int pool_init_prewarm(void);
+extern void pool_prewarm_register(POOL_CONNECTION_POOL *backend);
+extern void pool_prewarm_connections(void);
+
 /* md5.c */
 extern bool pg_md5_encrypt(const char *passwd, const char *salt, size_t salt_len, char *buf);
 
@@ -600,6 +704,9 @@ extern int pool_init_cp(void);
 extern POOL_CONNECTION_POOL *pool_create_cp(void);
 extern POOL_CONNECTION_POOL *pool_get_cp(char *user, char *database, int protoMajor, int check_socket);
 extern void pool_discard_cp(char *user, char *database, int protoMajor);
+extern bool pool_cp_exists(char *user, char *database, int protoMajor);
+extern bool pool_cp_has_free_slot(void);
+extern void pool_discard_node_connections(int node_id);
 extern void pool_backend_timer(void);
 extern void pool_connection_pool_timer(POOL_CONNECTION_POOL *backend);
 extern RETSIGTYPE pool_backend_timer_handler(int sig);
@@ -607,6 +714,8 @@ extern int connect_inet_domain_socket(int slot, bool retry);
 extern int connect_unix_domain_socket(int slot, bool retry);
 extern int connect_inet_domain_socket_by_port(char *host, int port, bool retry);
 extern int connect_unix_domain_socket_by_port(int port, char *socket_dir, bool retry);
+extern int start_connect_backend(int slot, bool *in_progress);
+extern void wait_for_connect_backends(int *fds, bool *in_progress);
 extern int pool_pool_index(void);
 
 #endif /* POOL_H */
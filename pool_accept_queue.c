@@ -0,0 +1,478 @@
+/* -*-pgsql-c-*- */
+/*
+ * $Header$
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2011	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_accept_queue.c: acceptor process. The acceptor process
+ * accepts connections from frontends and keeps them in a FIFO
+ * queue. Connections are handed off to idle children in arrival
+ * order through a UNIX domain datagram socket (SCM_RIGHTS).
+ *
+ * Idle children count themselves in idle_children on shared memory
+ * and send a byte to wake up the acceptor. The acceptor counts
+ * connections handed off in in_flight, and the child receiving one
+ * uncounts both. Thus idle_children minus in_flight is the number of
+ * children which can take a connection. Each child remembers whether
+ * it is counted in its ProcessInfo, so that pgpool main can uncount
+ * a child killed while waiting.
+ */
+#include "config.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#ifdef HAVE_SYS_SELECT_H
+#include <sys/select.h>
+#endif
+
+#include "pool.h"
+#include "pool_config.h"
+#include "pool_stream.h"
+#include "pool_process_context.h"
+
+/* interval in micro seconds to retry handing off queued connections */
+#define ACCEPTOR_RETRY_INTERVAL 100000
+
+/*
+ * A connection in the queue
+ */
+typedef struct {
+	int fd;		/* accepted socket */
+	struct timeval accept_time;	/* time when the connection was accepted */
+} QUEUED_CONNECTION;
+
+static int accept_connections(int fd);
+static void hand_off_connections(void);
+static int send_fd(int fd);
+static RETSIGTYPE acceptor_exit_handler(int sig);
+static void uncount_idle_child(ProcessInfo *pi);
+
+static int queue_fds[2] = {-1, -1};	/* [0]: acceptor side, [1]: children side */
+static POOL_ACCEPT_QUEUE_STATUS *queue_status;	/* on shared memory */
+
+static QUEUED_CONNECTION *queue;	/* ring buffer of accept_queue_size entries */
+static int queue_head;	/* next position to dequeue */
+static int queue_len;	/* number of queued connections */
+
+static volatile sig_atomic_t acceptor_exit_request = 0;
+
+/*
+ * Create the socket pair to hand off connections and the queue
+ * status on shared memory. Called by pgpool main before forking
+ * children. Returns 0 on success.
+ */
+int pool_init_accept_queue(void)
+{
+	int i;
+
+	if (pool_config->accept_queue_size <= 0)
+		return 0;
+
+	queue_status = pool_shared_memory_create(sizeof(POOL_ACCEPT_QUEUE_STATUS));
+	if (queue_status == NULL)
+	{
+		pool_error("pool_init_accept_queue: failed to allocate accept queue status");
+		return -1;
+	}
+	memset(queue_status, 0, sizeof(POOL_ACCEPT_QUEUE_STATUS));
+
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, queue_fds) < 0)
+	{
+		pool_error("pool_init_accept_queue: socketpair() failed. reason: %s", strerror(errno));
+		return -1;
+	}
+
+	/* nobody should block on sending or receiving */
+	for (i=0;i<2;i++)
+	{
+		if (fcntl(queue_fds[i], F_SETFL, fcntl(queue_fds[i], F_GETFL) | O_NONBLOCK) < 0)
+		{
+			pool_error("pool_init_accept_queue: fcntl() failed. reason: %s", strerror(errno));
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Return accept queue status. NULL if the acceptor is not used.
+ */
+POOL_ACCEPT_QUEUE_STATUS *pool_get_accept_queue_status(void)
+{
+	return queue_status;
+}
+
+/*
+ * Return the socket on which children receive connections. -1 if the
+ * acceptor is not used.
+ */
+int pool_accept_queue_fd(void)
+{
+	return queue_fds[1];
+}
+
+/*
+ * Called by a child before waiting for a connection from the
+ * acceptor.
+ */
+void pool_accept_queue_wait(void)
+{
+	ProcessInfo *pi = pool_get_my_process_info();
+	char c = 0;
+
+	pool_semaphore_lock(ACCEPT_QUEUE_SEM);
+	if (!pi->queue_waiting)
+	{
+		pi->queue_waiting = 1;
+		queue_status->idle_children++;
+	}
+	pool_semaphore_unlock(ACCEPT_QUEUE_SEM);
+
+	/*
+	 * Wake up the acceptor. If the acceptor's buffer is full, it
+	 * will look at idle_children anyway.
+	 */
+	send(queue_fds[1], &c, 1, 0);
+}
+
+/*
+ * Called by a child which stops waiting without receiving a
+ * connection.
+ */
+void pool_accept_queue_cancel(void)
+{
+	pool_semaphore_lock(ACCEPT_QUEUE_SEM);
+	uncount_idle_child(pool_get_my_process_info());
+	pool_semaphore_unlock(ACCEPT_QUEUE_SEM);
+}
+
+/*
+ * Called by pgpool main when it reaps a child. If the child was
+ * killed while waiting for a connection, it is still counted in
+ * idle_children. Uncount it, otherwise the acceptor would hand off
+ * connections nobody receives.
+ */
+void pool_accept_queue_child_exited(ProcessInfo *pi)
+{
+	if (queue_status == NULL)
+		return;
+
+	pool_semaphore_lock(ACCEPT_QUEUE_SEM);
+	uncount_idle_child(pi);
+	pool_semaphore_unlock(ACCEPT_QUEUE_SEM);
+}
+
+/*
+ * Caller must hold ACCEPT_QUEUE_SEM.
+ */
+static void uncount_idle_child(ProcessInfo *pi)
+{
+	if (pi->queue_waiting)
+	{
+		pi->queue_waiting = 0;
+		queue_status->idle_children--;
+	}
+}
+
+/*
+ * Receive a connection handed off by the acceptor. The peer address
+ * is stored in saddr. Returns the socket, or -1 with errno set if
+ * there's no connection to receive. Another idle child may have
+ * received it, in which case errno is EAGAIN.
+ */
+int pool_accept_queue_receive(SockAddr *saddr)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char cmsgbuf[CMSG_SPACE(sizeof(int))];
+	sigset_t mask, oldmask;
+	char c;
+	int fd;
+	int rtn;
+	int save_errno;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &c;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cmsgbuf;
+	msg.msg_controllen = sizeof(cmsgbuf);
+
+	/*
+	 * Do not die between receiving a connection and uncounting it.
+	 * Otherwise in_flight would never be decremented.
+	 */
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGTERM);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGQUIT);
+	sigprocmask(SIG_BLOCK, &mask, &oldmask);
+
+	rtn = recvmsg(queue_fds[1], &msg, 0);
+	save_errno = errno;
+
+	pool_semaphore_lock(ACCEPT_QUEUE_SEM);
+	if (rtn >= 0)
+		queue_status->in_flight--;
+	uncount_idle_child(pool_get_my_process_info());
+	pool_semaphore_unlock(ACCEPT_QUEUE_SEM);
+
+	sigprocmask(SIG_SETMASK, &oldmask, NULL);
+
+	if (rtn < 0)
+	{
+		errno = save_errno;
+		return -1;
+	}
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	if (cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+	{
+		pool_error("pool_accept_queue_receive: no socket is received");
+		errno = EAGAIN;
+		return -1;
+	}
+	memcpy(&fd, CMSG_DATA(cmsg), sizeof(fd));
+
+	if (getpeername(fd, (struct sockaddr *)&saddr->addr, &saddr->salen) < 0)
+	{
+		pool_error("pool_accept_queue_receive: getpeername() failed. reason: %s", strerror(errno));
+		close(fd);
+		errno = EAGAIN;
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * acceptor child main loop
+ */
+void do_acceptor_child(int unix_fd, int inet_fd)
+{
+	fd_set readmask;
+	struct timeval timeout;
+	char buf[1024];
+	int nfds;
+	int fds;
+
+	pool_debug("I am %d", getpid());
+
+	/* Identify myself via ps */
+	init_ps_display("", "", "", "");
+	set_ps_display("acceptor process", false);
+
+	/* set up signal handlers */
+	signal(SIGALRM, SIG_DFL);
+	signal(SIGTERM, acceptor_exit_handler);
+	signal(SIGINT, acceptor_exit_handler);
+	signal(SIGQUIT, acceptor_exit_handler);
+	signal(SIGHUP, SIG_IGN);
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGUSR1, SIG_IGN);
+	signal(SIGUSR2, SIG_IGN);
+	signal(SIGPIPE, SIG_IGN);
+
+	queue = malloc(sizeof(QUEUED_CONNECTION) * pool_config->accept_queue_size);
+	if (queue == NULL)
+	{
+		pool_error("do_acceptor_child: malloc failed");
+		exit(1);
+	}
+
+	/* listen sockets are used only by us */
+	pool_set_nonblock(unix_fd);
+	if (inet_fd)
+		pool_set_nonblock(inet_fd);
+
+	pool_semaphore_lock(ACCEPT_QUEUE_SEM);
+	queue_status->queue_length = 0;
+	pool_semaphore_unlock(ACCEPT_QUEUE_SEM);
+
+	for (;;)
+	{
+		if (acceptor_exit_request)
+			exit(0);
+
+		FD_ZERO(&readmask);
+		FD_SET(queue_fds[0], &readmask);
+		nfds = queue_fds[0];
+
+		/* leave connections in the kernel's backlog if the queue is full */
+		if (queue_len < pool_config->accept_queue_size)
+		{
+			FD_SET(unix_fd, &readmask);
+			nfds = Max(nfds, unix_fd);
+			if (inet_fd)
+			{
+				FD_SET(inet_fd, &readmask);
+				nfds = Max(nfds, inet_fd);
+			}
+		}
+
+		/* retry handing off periodically if there are queued connections */
+		timeout.tv_sec = 0;
+		timeout.tv_usec = ACCEPTOR_RETRY_INTERVAL;
+
+		fds = select(nfds+1, &readmask, NULL, NULL, queue_len > 0 ? &timeout : NULL);
+		if (fds < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			pool_error("do_acceptor_child: select() failed. reason: %s", strerror(errno));
+			exit(1);
+		}
+
+		/* drain wake up requests from children */
+		if (fds > 0 && FD_ISSET(queue_fds[0], &readmask))
+		{
+			while (recv(queue_fds[0], buf, sizeof(buf), 0) > 0)
+				;
+		}
+
+		if (fds > 0 && FD_ISSET(unix_fd, &readmask))
+			accept_connections(unix_fd);
+
+		if (fds > 0 && inet_fd && FD_ISSET(inet_fd, &readmask))
+			accept_connections(inet_fd);
+
+		hand_off_connections();
+	}
+}
+
+/*
+ * Accept connections on the listen socket and add them to the
+ * queue while there's room. Returns the number of connections
+ * accepted.
+ */
+static int accept_connections(int fd)
+{
+	QUEUED_CONNECTION *q;
+	int afd;
+	int n = 0;
+
+	while (queue_len < pool_config->accept_queue_size)
+	{
+		afd = accept(fd, NULL, NULL);
+		if (afd < 0)
+		{
+			if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR &&
+				errno != ECONNABORTED)
+				pool_error("do_acceptor_child: accept() failed. reason: %s", strerror(errno));
+			break;
+		}
+
+		q = &queue[(queue_head + queue_len) % pool_config->accept_queue_size];
+		q->fd = afd;
+		gettimeofday(&q->accept_time, NULL);
+		queue_len++;
+		n++;
+	}
+	return n;
+}
+
+/*
+ * Hand off queued connections to idle children in arrival order, and
+ * update the queue status.
+ */
+static void hand_off_connections(void)
+{
+	QUEUED_CONNECTION *q;
+	struct timeval now;
+	long long wait;
+
+	gettimeofday(&now, NULL);
+
+	pool_semaphore_lock(ACCEPT_QUEUE_SEM);
+
+	while (queue_len > 0 && queue_status->idle_children - queue_status->in_flight > 0)
+	{
+		q = &queue[queue_head];
+
+		if (send_fd(q->fd) < 0)
+			break;
+
+		close(q->fd);
+		queue_head = (queue_head + 1) % pool_config->accept_queue_size;
+		queue_len--;
+
+		queue_status->in_flight++;
+		queue_status->handed_off++;
+
+		wait = (now.tv_sec - q->accept_time.tv_sec) * 1000000LL +
+			(now.tv_usec - q->accept_time.tv_usec);
+		queue_status->total_wait += wait;
+		if (wait > queue_status->max_wait)
+			queue_status->max_wait = wait;
+	}
+
+	queue_status->queue_length = queue_len;
+
+	pool_debug("hand_off_connections: queue length %d idle children %d in flight %d",
+			   queue_len, queue_status->idle_children, queue_status->in_flight);
+
+	pool_semaphore_unlock(ACCEPT_QUEUE_SEM);
+}
+
+/*
+ * Send the socket to children. Returns 0 on success, -1 if the
+ * socket could not be sent at this moment.
+ */
+static int send_fd(int fd)
+{
+	struct msghdr msg;
+	struct iovec iov;
+	struct cmsghdr *cmsg;
+	char cmsgbuf[CMSG_SPACE(sizeof(int))];
+	char c = 0;
+
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = &c;
+	iov.iov_len = 1;
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cmsgbuf;
+	msg.msg_controllen = sizeof(cmsgbuf);
+
+	cmsg = CMSG_FIRSTHDR(&msg);
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+	memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+
+	if (sendmsg(queue_fds[0], &msg, 0) < 0)
+	{
+		if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+			pool_error("do_acceptor_child: sendmsg() failed. reason: %s", strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+static RETSIGTYPE acceptor_exit_handler(int sig)
+{
+	acceptor_exit_request = 1;
+}
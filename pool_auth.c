@@ -26,6 +26,7 @@
 #include "pool_stream.h"
 #include "pool_config.h"
 #include "pool_passwd.h"
+#include "pool_process_context.h"
 
 #ifdef HAVE_SYS_TYPES_H
 #include <sys/types.h>
@@ -37,19 +38,24 @@
 #include <param.h>
 #endif
 #include <errno.h>
+#include <fcntl.h>
 #include <string.h>
 #include <stdlib.h>
 
 #define AUTHFAIL_ERRORCODE "28000"
 
 static POOL_STATUS pool_send_backend_key_data(POOL_CONNECTION *frontend, int pid, int key, int protoMajor);
+static int read_backend_key_data(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *cp, int protoMajor);
 static int do_clear_text_password(POOL_CONNECTION *backend, POOL_CONNECTION *frontend, int reauth, int protoMajor);
 static void pool_send_auth_fail(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *cp);
 static int do_crypt(POOL_CONNECTION *backend, POOL_CONNECTION *frontend, int reauth, int protoMajor);
 static int do_md5(POOL_CONNECTION *backend, POOL_CONNECTION *frontend, int reauth, int protoMajor);
+static int md5_auth_responses(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *cp, int protoMajor);
 static int send_md5auth_request(POOL_CONNECTION *frontend, int protoMajor, char *salt);
 static int read_password_packet(POOL_CONNECTION *frontend, int protoMajor, 	char *password, int *pwdSize);
 static int send_password_packet(POOL_CONNECTION *backend, int protoMajor, char *password);
+static void write_password_packet(POOL_CONNECTION *backend, int protoMajor, char *password);
+static int read_password_response(POOL_CONNECTION *backend, int protoMajor);
 static int send_auth_ok(POOL_CONNECTION *frontend, int protoMajor);
 
 /*
@@ -60,13 +66,9 @@ static int send_auth_ok(POOL_CONNECTION *frontend, int protoMajor);
 int pool_do_auth(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *cp)
 {
 	signed char kind;
-	int pid;
-	int key;
 	int protoMajor;
-	int length;
 	int authkind;
 	int i;
-	StartupPacket *sp;
 
 	protoMajor = MAJOR(cp);
 
@@ -228,6 +230,16 @@ from pool_read_message_length and recheck the pg_hba.conf settings.");
 				return -1;
 			}
 		}
+
+		if (NUM_BACKENDS > 1)
+		{
+			authkind = md5_auth_responses(frontend, cp, protoMajor);
+			if (authkind < 0)
+			{
+				pool_send_auth_fail(frontend, cp);
+				return -1;
+			}
+		}
 	}
 
 	else
@@ -242,9 +254,25 @@ from pool_read_message_length and recheck the pg_hba.conf settings.");
 		return -1;
 	}
 
+	return read_backend_key_data(frontend, cp, protoMajor);
+}
+
+/*
+ * Authentication has been done. Read parameter status, pid and secret
+ * key from the backend and send them to frontend. if success return 0
+ * otherwise non 0.
+ */
+static int read_backend_key_data(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *cp, int protoMajor)
+{
+	signed char kind;
+	int pid;
+	int key;
+	int length;
+	int i;
+	StartupPacket *sp;
+
 	/*
-	 * authentication ok. now read pid and secret key from the
-	 * backend
+	 * now read pid and secret key from the backend
 	 */
 	for (;;)
 	{
@@ -376,6 +404,9 @@ from pool_read_message_length and recheck the pg_hba.conf settings.");
 			strncpy(cp->info[i].database, sp->database, sizeof(cp->info[i].database) - 1);
 			strncpy(cp->info[i].user, sp->user, sizeof(cp->info[i].user) - 1);
 			cp->info[i].counter = 1;
+
+			/* register to cancel key index */
+			pool_coninfo_index_add(&cp->info[i]);
 		}
 	}
 
@@ -392,6 +423,7 @@ from pool_read_message_length and recheck the pg_hba.conf settings.");
 
 /*
 * do re-authentication for reused connection. if success return 0 otherwise non 0.
+* Messages sent to frontend after authentication are left in the write buffer.
 */
 int pool_do_reauth(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *cp)
 {
@@ -431,7 +463,13 @@ int pool_do_reauth(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *cp)
 	if (status == 0)
 	{
 		int msglen;
+		int pid, key;
 
+		/*
+		 * Send AuthenticationOk and BackendKeyData. They are not
+		 * flushed here. The caller sends ParameterStatus and
+		 * ReadyForQuery, then flushes all of them at once.
+		 */
 		pool_write(frontend, "R", 1);
 
 		if (protoMajor == PROTO_MAJOR_V3)
@@ -441,7 +479,22 @@ int pool_do_reauth(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *cp)
 		}
 
 		msglen = htonl(0);
-		if (pool_write_and_flush(frontend, &msglen, sizeof(msglen)) < 0)
+		if (pool_write(frontend, &msglen, sizeof(msglen)) < 0)
+		{
+			return -1;
+		}
+
+		pool_write(frontend, "K", 1);
+		if (protoMajor == PROTO_MAJOR_V3)
+		{
+			msglen = htonl(12);
+			pool_write(frontend, &msglen, sizeof(msglen));
+		}
+
+		pid = MASTER_CONNECTION(cp)->pid;
+		key = MASTER_CONNECTION(cp)->key;
+		pool_write(frontend, &pid, sizeof(pid));
+		if (pool_write(frontend, &key, sizeof(key)) < 0)
 		{
 			return -1;
 		}
@@ -453,7 +506,158 @@ int pool_do_reauth(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *cp)
 		return -1;
 	}
 
-	return (pool_send_backend_key_data(frontend, MASTER_CONNECTION(cp)->pid, MASTER_CONNECTION(cp)->key, protoMajor) != POOL_CONTINUE);
+	return 0;
+}
+
+/*
+ * Authenticate a connection to backend without frontend, for
+ * prewarming the connection pool. Only trust and md5 authentication
+ * using pool_passwd are possible. Authentication info is saved so
+ * that pool_do_reauth() authenticates a frontend later. Protocol V3
+ * only. if success return 0 otherwise non 0.
+ */
+int pool_do_prewarm_auth(POOL_CONNECTION_POOL *cp)
+{
+	POOL_CONNECTION *dummy;
+	StartupPacket *sp;
+	char *pool_passwd = NULL;
+	char salt[4];
+	char encbuf[POOL_PASSWD_LEN+1];
+	signed char kind;
+	char tstate;
+	int authkind = -1;
+	int len;
+	int fd;
+	int i;
+
+	sp = MASTER_CONNECTION(cp)->sp;
+
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		POOL_CONNECTION *con;
+		int ak;
+
+		if (!VALID_BACKEND(i))
+			continue;
+
+		con = CONNECTION(cp, i);
+
+		if (pool_read(con, &kind, sizeof(kind)) < 0 ||
+			pool_read(con, &len, sizeof(len)) < 0)
+			return -1;
+
+		if (kind != 'R')
+		{
+			pool_debug("pool_do_prewarm_auth: expect \"R\" got %c", kind);
+			return -1;
+		}
+
+		if (pool_read(con, &ak, sizeof(ak)) < 0)
+			return -1;
+		ak = ntohl(ak);
+
+		if (authkind >= 0 && ak != authkind)
+		{
+			pool_debug("pool_do_prewarm_auth: auth kind differs among DB nodes");
+			return -1;
+		}
+		authkind = ak;
+
+		if (authkind == 0)
+			continue;
+		else if (authkind != 5)
+		{
+			pool_debug("pool_do_prewarm_auth: auth kind %d cannot be used without frontend", authkind);
+			return -1;
+		}
+
+		/* md5. use pool_passwd */
+		if (pool_passwd == NULL)
+		{
+			pool_passwd = pool_get_passwd(sp->user);
+			if (pool_passwd == NULL)
+			{
+				pool_debug("pool_do_prewarm_auth: %s does not exist in pool_passwd", sp->user);
+				return -1;
+			}
+		}
+
+		if (pool_read(con, salt, sizeof(salt)))
+			return -1;
+
+		/* responses are read below so that backends work in parallel */
+		pg_md5_encrypt(pool_passwd+strlen("md5"), salt, sizeof(salt), encbuf);
+		write_password_packet(con, PROTO_MAJOR_V3, encbuf);
+	}
+
+	for (i=0;i<NUM_BACKENDS && authkind == 5;i++)
+	{
+		if (!VALID_BACKEND(i))
+			continue;
+
+		if (read_password_response(CONNECTION(cp, i), PROTO_MAJOR_V3) != 0)
+		{
+			pool_debug("pool_do_prewarm_auth: md5 authentication failed in slot %d", i);
+			return -1;
+		}
+	}
+
+	/* Save the auth info for pool_do_reauth() */
+	MASTER(cp)->auth_kind = authkind;
+	if (authkind == 5)
+	{
+		pool_random_salt(MASTER(cp)->salt);
+		pg_md5_encrypt(pool_passwd+strlen("md5"), MASTER(cp)->salt, sizeof(MASTER(cp)->salt), encbuf);
+		MASTER(cp)->pwd_size = strlen(encbuf) + 1;
+		memcpy(MASTER(cp)->password, encbuf, MASTER(cp)->pwd_size);
+	}
+
+	/*
+	 * Messages to be sent to frontend are thrown away. They are
+	 * emulated when the connection is reused.
+	 */
+	fd = open("/dev/null", O_WRONLY);
+	if (fd < 0)
+	{
+		pool_error("pool_do_prewarm_auth: failed to open /dev/null: %s", strerror(errno));
+		return -1;
+	}
+	dummy = pool_open(fd);
+	if (dummy == NULL)
+	{
+		close(fd);
+		return -1;
+	}
+
+	if (read_backend_key_data(dummy, cp, PROTO_MAJOR_V3))
+	{
+		pool_close(dummy);
+		return -1;
+	}
+	pool_close(dummy);
+
+	/* read ReadyForQuery */
+	kind = pool_read_kind(cp);
+	if (kind != 'Z')
+	{
+		pool_debug("pool_do_prewarm_auth: expect \"Z\" got %c", kind);
+		return -1;
+	}
+
+	if (pool_read_message_length(cp) != 5)
+		return -1;
+
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		if (!VALID_BACKEND(i))
+			continue;
+
+		if (pool_read(CONNECTION(cp, i), &tstate, sizeof(tstate)) < 0)
+			return -1;
+		CONNECTION(cp, i)->tstate = tstate;
+	}
+
+	return 0;
 }
 
 /*
@@ -834,6 +1038,45 @@ static int do_crypt(POOL_CONNECTION *backend, POOL_CONNECTION *frontend, int rea
 /*
  * perform MD5 authetication
  */
+/*
+ * With more than one backend, do_md5() sends the password packet to
+ * each backend without waiting for the response, so that backends
+ * check the password in parallel. Read the auth responses from all
+ * backends and send auth ok to frontend. Returns the last field of
+ * authentication response (0 if ok) or -1 on error.
+ */
+static int md5_auth_responses(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *cp, int protoMajor)
+{
+	int kind;
+	int i;
+
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		if (!VALID_BACKEND(i))
+			continue;
+
+		kind = read_password_response(CONNECTION(cp, i), protoMajor);
+		if (kind < 0)
+		{
+			pool_debug("md5_auth_responses: authentication failed in slot %d", i);
+			return -1;
+		}
+		else if (kind != 0)
+			return kind;
+
+		/* Save the auth info */
+		CONNECTION(cp, i)->auth_kind = 5;
+	}
+
+	/* Send auth ok to frontend */
+	if (send_auth_ok(frontend, protoMajor) < 0)
+	{
+		pool_error("md5_auth_responses: send_auth_ok failed");
+		return -1;
+	}
+	return 0;
+}
+
 static int do_md5(POOL_CONNECTION *backend, POOL_CONNECTION *frontend, int reauth, int protoMajor)
 {
 	char salt[4];
@@ -899,28 +1142,12 @@ static int do_md5(POOL_CONNECTION *backend, POOL_CONNECTION *frontend, int reaut
 			/* Encrypt password in pool_passwd using the salt */
 			pg_md5_encrypt(pool_passwd+strlen("md5"), salt, sizeof(salt), encbuf);
 
-			/* Send password packet to backend and receive auth response */
-			kind = send_password_packet(backend, protoMajor, encbuf);
-			if (kind < 0)
-			{
-				return -1;
-			}
-		}
-
-		if (!reauth && kind == 0)
-		{
-			if (IS_MASTER_NODE_ID(backend->db_node_id))
-			{
-				/* Send auth ok to frontend */
-				if (send_auth_ok(frontend, protoMajor) < 0)
-				{
-					pool_error("do_md5: send_auth_ok failed");
-					return -1;
-				}
-			}
-
-			/* Save the auth info */
-			backend->auth_kind = 5;
+			/*
+			 * Send password packet to backend. The auth response is
+			 * read by md5_auth_responses() after the password packet
+			 * has been sent to all backends.
+			 */
+			write_password_packet(backend, protoMajor, encbuf);
 		}
 		return kind;
 	}
@@ -1096,28 +1323,46 @@ static int read_password_packet(POOL_CONNECTION *frontend, int protoMajor, 	char
  * "password" must be null-terminated.
  */
 static int send_password_packet(POOL_CONNECTION *backend, int protoMajor, char *password)
+{
+	write_password_packet(backend, protoMajor, password);
+	return read_password_response(backend, protoMajor);
+}
+
+/*
+ * Send password packet to backend without waiting for the
+ * response. "password" must be null-terminated.
+ */
+static void write_password_packet(POOL_CONNECTION *backend, int protoMajor, char *password)
 {
 	int size;
-	int len;
-	int kind;
-	char response;
 
-	/* Send password packet to backend */
 	if (protoMajor == PROTO_MAJOR_V3)
 		pool_write(backend, "p", 1);
 	size = htonl(sizeof(size) + strlen(password)+1);
 	pool_write(backend, &size, sizeof(size));
 	pool_write_and_flush(backend, password, strlen(password)+1);
+}
+
+/*
+ * Receive authentication response packet to the password packet.
+ * Return value is the last field of authentication response. If it's
+ * 0, authentication was successfull.
+ */
+static int read_password_response(POOL_CONNECTION *backend, int protoMajor)
+{
+	int len;
+	int kind;
+	char response;
 
 	if (pool_read(backend, &response, sizeof(response)))
 	{
-		pool_error("send_password_packet: failed to read authentication response");
+		pool_error("read_password_response: failed to read authentication response");
 		return -1;
 	}
 
 	if (response != 'R')
 	{
-		pool_debug("send_password_packet: backend does not return R");
+		pool_debug("read_password_response: backend does not return R");
 		return -1;
 	}
 
@@ -1125,13 +1370,13 @@ static int send_password_packet(POOL_CONNECTION *backend, int protoMajor, char *
 	{
 		if (pool_read(backend, &len, sizeof(len)))
 		{
-			pool_error("send_password_packet: failed to read authentication packet size");
+			pool_error("read_password_response: failed to read authentication packet size");
 			return -1;
 		}
 
 		if (ntohl(len) != 8)
 		{
-			pool_error("send_password_packet: incorrect authentication packet size (%d)", ntohl(len));
+			pool_error("read_password_response: incorrect authentication packet size (%d)", ntohl(len));
 			return -1;
 		}
 	}
@@ -1139,7 +1384,7 @@ static int send_password_packet(POOL_CONNECTION *backend, int protoMajor, char *
 	/* Expect to read "Authentication OK" response. kind should be 0... */
 	if (pool_read(backend, &kind, sizeof(kind)))
 	{
-		pool_debug("send_password_packet: failed to read Authentication OK response");
+		pool_debug("read_password_response: failed to read Authentication OK response");
 		return -1;
 	}
 
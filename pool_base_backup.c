@@ -0,0 +1,818 @@
+/* -*-pgsql-c-*- */
+/*
+ * $Header$
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2011	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_base_backup.c: 1st stage of online recovery taking a base
+ * backup of the primary node over the streaming replication protocol
+ * (BASE_BACKUP command, PostgreSQL 9.1 or later). The tar streams sent
+ * by the primary are unpacked into a work directory next to the data
+ * directory of the node to be recovered, which must be on the pgpool
+ * host. The work directory replaces the data directory only after the
+ * whole backup has been received, so an interrupted recovery never
+ * leaves a half copied data directory behind. Other tablespaces are
+ * handled in the same way with a work directory next to their
+ * location.
+ */
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ftw.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "pool.h"
+#include "pool_config.h"
+
+#include "libpq-fe.h"
+
+/* suffix of the work directory receiving the base backup */
+#define WORK_DIR_SUFFIX ".pgpool_recovery"
+
+/* suffix of the old data directory replaced by the base backup */
+#define OLD_DIR_SUFFIX ".old"
+
+/* interval in seconds to report progress */
+#define PROGRESS_REPORT_INTERVAL 1
+
+#define TAR_BLOCK_SIZE 512
+
+/*
+ * Progress of a base backup
+ */
+typedef struct {
+	long total_kb;			/* estimated size of all tablespaces in kB */
+	long received;			/* bytes received so far */
+	struct timeval start;	/* time the base backup started */
+	time_t last_report;		/* time progress was reported last */
+} BASE_BACKUP_PROGRESS;
+
+static PGconn *connect_replication(BackendInfo *backend);
+static void append_conninfo(char *buf, int size, char *key, char *value);
+static int receive_tar(PGconn *conn, char *dir, char **locations, int nlocations,
+					   BASE_BACKUP_PROGRESS *progress);
+static bool is_safe_tar_name(char *name);
+static bool is_tablespace_link(char *name, char *linkname, char **locations, int nlocations);
+static int write_tar_data(FILE **file, char *name, char *data, int len);
+static long tar_octal(char *p, int len);
+static int prepare_work_dir(char *dir, char *work_dir, int size);
+static int prepare_dir(char *dir);
+static int install_dir(char *dir);
+static int remove_dir(char *dir);
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw);
+static int write_recovery_conf(char *dir, BackendInfo *primary);
+static void update_progress(BASE_BACKUP_PROGRESS *progress, int len, bool force);
+
+/*
+ * Take a base backup of the primary node and install it as the data
+ * directory of the node to be recovered. If "standby" is true,
+ * recovery.conf is written so that the node starts as a streaming
+ * replication standby of the primary. Returns 0 on success.
+ */
+int pool_base_backup(BackendInfo *primary, BackendInfo *target, bool standby)
+{
+	char work_dir[POOLMAXPATHLEN];
+	char tblspc_work_dir[POOLMAXPATHLEN];
+	char *data_dir = target->backend_data_directory;
+	char **locations = NULL;
+	int nlocations = 0;
+	BASE_BACKUP_PROGRESS progress;
+	PGconn *conn;
+	PGresult *res = NULL;
+	int r = 1;
+	int i;
+
+	if (*data_dir == '\0')
+	{
+		pool_error("pool_base_backup: data directory of the node to be recovered is not set");
+		return 1;
+	}
+
+	if (prepare_work_dir(data_dir, work_dir, sizeof(work_dir)))
+		return 1;
+
+	conn = connect_replication(primary);
+	if (conn == NULL)
+		return 1;
+
+	pool_log("pool_base_backup: starting base backup of %s:%d into %s",
+			 primary->backend_hostname, primary->backend_port, work_dir);
+
+	if (PQsendQuery(conn, "BASE_BACKUP LABEL 'pgpool-II online recovery' PROGRESS FAST WAL") == 0)
+	{
+		pool_error("pool_base_backup: could not send BASE_BACKUP: %s", PQerrorMessage(conn));
+		PQfinish(conn);
+		return 1;
+	}
+
+	/*
+	 * 9.2 or later sends the start position of the backup before the
+	 * tablespace list and the end position after the tar streams. 9.1
+	 * sends neither.
+	 */
+	if (PQserverVersion(conn) >= 90200)
+	{
+		res = PQgetResult(conn);
+		if (PQresultStatus(res) != PGRES_TUPLES_OK || PQntuples(res) != 1)
+		{
+			pool_error("pool_base_backup: could not start base backup: %s", PQerrorMessage(conn));
+			goto done;
+		}
+		pool_log("pool_base_backup: base backup started at %s", PQgetvalue(res, 0, 0));
+		PQclear(res);
+	}
+
+	/* list of tablespaces with their estimated size */
+	res = PQgetResult(conn);
+	if (PQresultStatus(res) != PGRES_TUPLES_OK || PQnfields(res) < 3)
+	{
+		pool_error("pool_base_backup: could not get tablespace list: %s", PQerrorMessage(conn));
+		goto done;
+	}
+
+	memset(&progress, 0, sizeof(progress));
+	gettimeofday(&progress.start, NULL);
+	for (i=0;i<PQntuples(res);i++)
+		progress.total_kb += atol(PQgetvalue(res, i, 2));
+
+	locations = calloc(PQntuples(res), sizeof(char *));
+	if (locations == NULL)
+	{
+		pool_error("pool_base_backup: calloc failed");
+		goto done;
+	}
+
+	/*
+	 * Other tablespaces end up in the same location as on the
+	 * primary, as pg_basebackup does, so that the symbolic links in
+	 * pg_tblspc are valid. Collect all the locations first since they
+	 * are the only symbolic link targets accepted outside the backup.
+	 */
+	for (i=0;i<PQntuples(res);i++)
+	{
+		if (PQgetisnull(res, i, 1))
+			continue;
+
+		locations[nlocations] = strdup(PQgetvalue(res, i, 1));
+		if (locations[nlocations] == NULL)
+		{
+			pool_error("pool_base_backup: strdup failed");
+			goto done;
+		}
+		nlocations++;
+	}
+
+	/*
+	 * One tar stream is sent per tablespace in the same order. The
+	 * main data directory comes with NULL location. Until the backup
+	 * is complete, other tablespaces are unpacked into a work
+	 * directory next to the location, since the location may be used
+	 * by the node.
+	 */
+	for (i=0;i<PQntuples(res);i++)
+	{
+		char *dir;
+
+		if (PQgetisnull(res, i, 1))
+			dir = work_dir;
+		else
+		{
+			if (prepare_work_dir(PQgetvalue(res, i, 1), tblspc_work_dir, sizeof(tblspc_work_dir)))
+				goto done;
+			dir = tblspc_work_dir;
+		}
+
+		if (receive_tar(conn, dir, locations, nlocations, &progress))
+			goto done;
+	}
+	PQclear(res);
+
+	/* end position of the backup */
+	if (PQserverVersion(conn) >= 90200)
+	{
+		res = PQgetResult(conn);
+		if (PQresultStatus(res) != PGRES_TUPLES_OK)
+		{
+			pool_error("pool_base_backup: could not get end position of base backup: %s", PQerrorMessage(conn));
+			goto done;
+		}
+		if (PQntuples(res) > 0)
+			pool_log("pool_base_backup: base backup ended at %s", PQgetvalue(res, 0, 0));
+		PQclear(res);
+	}
+
+	while ((res = PQgetResult(conn)) != NULL)
+	{
+		if (PQresultStatus(res) != PGRES_COMMAND_OK)
+		{
+			pool_error("pool_base_backup: base backup failed: %s", PQerrorMessage(conn));
+			goto done;
+		}
+		PQclear(res);
+	}
+
+	update_progress(&progress, 0, true);
+
+	if (standby && write_recovery_conf(work_dir, primary))
+		goto done;
+
+	/* Replace tablespaces and the data directory with the base backup */
+	for (i=0;i<nlocations;i++)
+	{
+		if (install_dir(locations[i]))
+			goto done;
+	}
+	if (install_dir(data_dir))
+		goto done;
+
+	pool_log("pool_base_backup: base backup has been installed into %s", data_dir);
+	r = 0;
+
+done:
+	PQclear(res);
+	PQfinish(conn);
+	for (i=0;i<nlocations;i++)
+		free(locations[i]);
+	free(locations);
+	return r;
+}
+
+/*
+ * Open a replication connection to the backend.
+ */
+static PGconn *connect_replication(BackendInfo *backend)
+{
+	char conninfo[1024];
+	char port_str[16];
+	PGconn *conn;
+
+	snprintf(port_str, sizeof(port_str), "%d", backend->backend_port);
+
+	*conninfo = '\0';
+	append_conninfo(conninfo, sizeof(conninfo), "host", backend->backend_hostname);
+	append_conninfo(conninfo, sizeof(conninfo), "port", port_str);
+	append_conninfo(conninfo, sizeof(conninfo), "user", pool_config->recovery_user);
+	append_conninfo(conninfo, sizeof(conninfo), "password", pool_config->recovery_password);
+	append_conninfo(conninfo, sizeof(conninfo), "dbname", "replication");
+	append_conninfo(conninfo, sizeof(conninfo), "replication", "true");
+
+	conn = PQconnectdb(conninfo);
+	if (PQstatus(conn) != CONNECTION_OK)
+	{
+		pool_error("pool_base_backup: could not connect to %s:%d: %s",
+				   backend->backend_hostname, backend->backend_port, PQerrorMessage(conn));
+		PQfinish(conn);
+		return NULL;
+	}
+	return conn;
+}
+
+/*
+ * Append "key=value" to a libpq connection string. The value is
+ * quoted if it contains spaces, quotes or backslashes.
+ */
+static void append_conninfo(char *buf, int size, char *key, char *value)
+{
+	int len = strlen(buf);
+	bool quote;
+
+	if (*value == '\0')
+		return;
+
+	quote = strpbrk(value, " \t\n'\\") != NULL;
+
+	len += snprintf(buf + len, size - len, "%s%s=%s", len > 0 ? " " : "", key, quote ? "'" : "");
+	if (len >= size - 1)
+	{
+		pool_error("pool_base_backup: too long connection string");
+		buf[size - 1] = '\0';
+		return;
+	}
+	for (;*value && len < size - 2;value++)
+	{
+		if (quote && (*value == '\'' || *value == '\\'))
+			buf[len++] = '\\';
+		buf[len++] = *value;
+	}
+	if (quote && len < size - 1)
+		buf[len++] = '\'';
+	buf[len] = '\0';
+}
+
+/*
+ * Receive a tar stream and unpack it into "dir". Member names and
+ * link targets must stay inside "dir", except for the symbolic links
+ * of pg_tblspc, which must point to one of the tablespace locations.
+ */
+static int receive_tar(PGconn *conn, char *dir, char **locations, int nlocations,
+					   BASE_BACKUP_PROGRESS *progress)
+{
+	PGresult *res;
+	char header[TAR_BLOCK_SIZE];
+	char path[POOLMAXPATHLEN];
+	int header_len = 0;		/* bytes of tar header collected */
+	long remaining = 0;		/* bytes of file data to come */
+	long padding = 0;		/* bytes of padding to come */
+	FILE *file = NULL;
+	char *copybuf;
+	int r = 0;
+
+	res = PQgetResult(conn);
+	if (PQresultStatus(res) != PGRES_COPY_OUT)
+	{
+		pool_error("pool_base_backup: could not receive tar stream: %s", PQerrorMessage(conn));
+		PQclear(res);
+		return 1;
+	}
+	PQclear(res);
+
+	for (;;)
+	{
+		char *p;
+		int len;
+
+		len = PQgetCopyData(conn, &copybuf, 0);
+		if (len == -1)
+			break;			/* end of this tar stream */
+		if (len < 0)
+		{
+			pool_error("pool_base_backup: could not read tar stream: %s", PQerrorMessage(conn));
+			r = 1;
+			break;
+		}
+
+		update_progress(progress, len, false);
+
+		p = copybuf;
+		while (len > 0 && r == 0)
+		{
+			int n;
+
+			if (remaining > 0)
+			{
+				/* file data */
+				n = Min(remaining, len);
+				if (write_tar_data(&file, path, p, n))
+					r = 1;
+				remaining -= n;
+				if (remaining == 0 && file)
+				{
+					fclose(file);
+					file = NULL;
+				}
+			}
+			else if (padding > 0)
+			{
+				n = Min(padding, len);
+				padding -= n;
+			}
+			else
+			{
+				/* tar header */
+				n = Min(TAR_BLOCK_SIZE - header_len, len);
+				memcpy(header + header_len, p, n);
+				header_len += n;
+
+				if (header_len == TAR_BLOCK_SIZE)
+				{
+					char name[101];
+					char linkname[101];
+					int namelen;
+					mode_t mode;
+
+					header_len = 0;
+
+					/* end of archive marker */
+					if (header[0] == '\0')
+					{
+						p += n;
+						len -= n;
+						continue;
+					}
+
+					memcpy(name, header, 100);
+					name[100] = '\0';
+					namelen = strlen(name);
+					if (namelen > 0 && name[namelen - 1] == '/')
+						name[namelen - 1] = '\0';
+
+					memcpy(linkname, header + 157, 100);
+					linkname[100] = '\0';
+
+					mode = tar_octal(header + 100, 8) & 07777;
+					remaining = tar_octal(header + 124, 12);
+					padding = (TAR_BLOCK_SIZE - remaining % TAR_BLOCK_SIZE) % TAR_BLOCK_SIZE;
+
+					if (!is_safe_tar_name(name))
+					{
+						pool_error("pool_base_backup: invalid file name \"%s\" in tar stream", name);
+						r = 1;
+						break;
+					}
+
+					if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= sizeof(path))
+					{
+						pool_error("pool_base_backup: too long path name in %s", dir);
+						r = 1;
+						break;
+					}
+
+					switch (header[156])
+					{
+						case '5':	/* directory */
+							if (mkdir(path, S_IRWXU) < 0 && errno != EEXIST)
+							{
+								pool_error("pool_base_backup: could not create directory %s: %s",
+										   path, strerror(errno));
+								r = 1;
+							}
+							break;
+
+						case '1':	/* hard link */
+							{
+								char target[POOLMAXPATHLEN];
+
+								remaining = padding = 0;
+								if (!is_safe_tar_name(linkname))
+								{
+									pool_error("pool_base_backup: invalid link target \"%s\" of %s in tar stream",
+											   linkname, name);
+									r = 1;
+								}
+								else if (snprintf(target, sizeof(target), "%s/%s", dir, linkname) >= sizeof(target))
+								{
+									pool_error("pool_base_backup: too long path name in %s", dir);
+									r = 1;
+								}
+								else if (link(target, path) < 0)
+								{
+									pool_error("pool_base_backup: could not create hard link %s: %s",
+											   path, strerror(errno));
+									r = 1;
+								}
+							}
+							break;
+
+						case '2':	/* symbolic link */
+							remaining = padding = 0;
+							if (!is_safe_tar_name(linkname) &&
+								!is_tablespace_link(name, linkname, locations, nlocations))
+							{
+								pool_error("pool_base_backup: invalid link target \"%s\" of %s in tar stream",
+										   linkname, name);
+								r = 1;
+							}
+							else if (symlink(linkname, path) < 0)
+							{
+								pool_error("pool_base_backup: could not create symbolic link %s: %s",
+										   path, strerror(errno));
+								r = 1;
+							}
+							break;
+
+						default:	/* regular file */
+							file = fopen(path, "wb");
+							if (file == NULL)
+							{
+								pool_error("pool_base_backup: could not create file %s: %s",
+										   path, strerror(errno));
+								r = 1;
+								break;
+							}
+							fchmod(fileno(file), mode);
+							if (remaining == 0)
+							{
+								fclose(file);
+								file = NULL;
+							}
+							break;
+					}
+				}
+			}
+			p += n;
+			len -= n;
+		}
+		PQfreemem(copybuf);
+
+		if (r)
+			break;
+	}
+
+	if (file)
+		fclose(file);
+	return r;
+}
+
+/*
+ * Return true if "name" taken from a tar stream is a relative path
+ * without ".." components, so that it does not point outside the
+ * directory the tar stream is unpacked into. Names below the links in
+ * pg_tblspc are rejected too, since they would go to the tablespace
+ * location itself instead of its work directory.
+ */
+static bool is_safe_tar_name(char *name)
+{
+	char *p = name;
+
+	if (*name == '\0' || *name == '/')
+		return false;
+
+	if (strncmp(name, "pg_tblspc/", 10) == 0 && strchr(name + 10, '/'))
+		return false;
+
+	while (*p)
+	{
+		if (p[0] == '.' && p[1] == '.' && (p[2] == '/' || p[2] == '\0'))
+			return false;
+		p = strchr(p, '/');
+		if (p == NULL)
+			break;
+		p++;
+	}
+	return true;
+}
+
+/*
+ * Return true if "name" is a symbolic link in pg_tblspc pointing to
+ * one of the tablespace locations of the backup.
+ */
+static bool is_tablespace_link(char *name, char *linkname, char **locations, int nlocations)
+{
+	int i;
+
+	if (strncmp(name, "pg_tblspc/", 10) != 0 || strchr(name + 10, '/'))
+		return false;
+
+	for (i=0;i<nlocations;i++)
+	{
+		if (!strcmp(linkname, locations[i]))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Write file data taken from a tar stream.
+ */
+static int write_tar_data(FILE **file, char *name, char *data, int len)
+{
+	if (fwrite(data, len, 1, *file) != 1)
+	{
+		pool_error("pool_base_backup: could not write to file %s: %s", name, strerror(errno));
+		fclose(*file);
+		*file = NULL;
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Parse an octal number in a tar header.
+ */
+static long tar_octal(char *p, int len)
+{
+	long v = 0;
+
+	while (len > 0 && (*p == ' ' || *p == '0'))
+	{
+		p++;
+		len--;
+	}
+	while (len > 0 && *p >= '0' && *p <= '7')
+	{
+		v = v * 8 + (*p - '0');
+		p++;
+		len--;
+	}
+	return v;
+}
+
+/*
+ * Create the work directory receiving the base backup of "dir" and
+ * store its path in work_dir. The work directory is left behind if
+ * the previous recovery was interrupted. It is never used as a data
+ * directory or a tablespace, so remove it and start over.
+ */
+static int prepare_work_dir(char *dir, char *work_dir, int size)
+{
+	struct stat st;
+
+	if (snprintf(work_dir, size, "%s%s", dir, WORK_DIR_SUFFIX) >= size)
+	{
+		pool_error("pool_base_backup: too long path name %s", dir);
+		return 1;
+	}
+
+	if (stat(work_dir, &st) == 0)
+	{
+		pool_log("pool_base_backup: removing incomplete base backup in %s", work_dir);
+		if (remove_dir(work_dir))
+			return 1;
+	}
+
+	return prepare_dir(work_dir);
+}
+
+/*
+ * Replace "dir" with the base backup received in its work
+ * directory. The old directory is kept with OLD_DIR_SUFFIX until the
+ * next recovery of the node.
+ */
+static int install_dir(char *dir)
+{
+	char work_dir[POOLMAXPATHLEN];
+	char old_dir[POOLMAXPATHLEN];
+	struct stat st;
+
+	if (snprintf(work_dir, sizeof(work_dir), "%s%s", dir, WORK_DIR_SUFFIX) >= sizeof(work_dir) ||
+		snprintf(old_dir, sizeof(old_dir), "%s%s", dir, OLD_DIR_SUFFIX) >= sizeof(old_dir))
+	{
+		pool_error("pool_base_backup: too long path name %s", dir);
+		return 1;
+	}
+
+	if (stat(dir, &st) == 0)
+	{
+		if (stat(old_dir, &st) == 0 && remove_dir(old_dir))
+			return 1;
+
+		if (rename(dir, old_dir) < 0)
+		{
+			pool_error("pool_base_backup: could not rename %s to %s: %s",
+					   dir, old_dir, strerror(errno));
+			return 1;
+		}
+		pool_log("pool_base_backup: old directory has been moved to %s", old_dir);
+	}
+
+	if (rename(work_dir, dir) < 0)
+	{
+		pool_error("pool_base_backup: could not rename %s to %s: %s",
+				   work_dir, dir, strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Create a directory if it does not exist. An existing directory must
+ * be empty.
+ */
+static int prepare_dir(char *dir)
+{
+	struct stat st;
+
+	/* rmdir() fails unless the directory is empty */
+	if (stat(dir, &st) == 0 && rmdir(dir) < 0)
+	{
+		pool_error("pool_base_backup: directory %s exists and is not empty", dir);
+		return 1;
+	}
+
+	if (mkdir(dir, S_IRWXU) < 0)
+	{
+		pool_error("pool_base_backup: could not create directory %s: %s", dir, strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Remove a directory recursively.
+ */
+static int remove_dir(char *dir)
+{
+	if (nftw(dir, remove_entry, 64, FTW_DEPTH | FTW_PHYS) < 0)
+	{
+		pool_error("pool_base_backup: could not remove directory %s: %s", dir, strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+static int remove_entry(const char *path, const struct stat *st, int flag, struct FTW *ftw)
+{
+	return remove(path);
+}
+
+/*
+ * Write recovery.conf so that the node starts as a streaming
+ * replication standby of the primary.
+ */
+static int write_recovery_conf(char *dir, BackendInfo *primary)
+{
+	char path[POOLMAXPATHLEN];
+	char conninfo[1024];
+	char port_str[16];
+	FILE *fd;
+	char *p;
+
+	snprintf(port_str, sizeof(port_str), "%d", primary->backend_port);
+
+	*conninfo = '\0';
+	append_conninfo(conninfo, sizeof(conninfo), "host", primary->backend_hostname);
+	append_conninfo(conninfo, sizeof(conninfo), "port", port_str);
+	append_conninfo(conninfo, sizeof(conninfo), "user", pool_config->recovery_user);
+	append_conninfo(conninfo, sizeof(conninfo), "password", pool_config->recovery_password);
+
+	if (snprintf(path, sizeof(path), "%s/recovery.conf", dir) >= sizeof(path))
+	{
+		pool_error("pool_base_backup: too long path name %s", dir);
+		return 1;
+	}
+	fd = fopen(path, "w");
+	if (fd == NULL)
+	{
+		pool_error("pool_base_backup: could not create %s: %s", path, strerror(errno));
+		return 1;
+	}
+
+	fprintf(fd, "standby_mode = 'on'\n");
+	fprintf(fd, "primary_conninfo = '");
+	for (p = conninfo; *p; p++)
+	{
+		/* quotes in recovery.conf are escaped by doubling them */
+		if (*p == '\'')
+			fputc('\'', fd);
+		fputc(*p, fd);
+	}
+	fprintf(fd, "'\n");
+
+	if (fclose(fd) != 0)
+	{
+		pool_error("pool_base_backup: could not write %s: %s", path, strerror(errno));
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Account "len" bytes received, report progress every
+ * PROGRESS_REPORT_INTERVAL seconds (or now if "force" is true) to the
+ * log and pcp_recovery_node, and throttle to recovery_max_rate.
+ */
+static void update_progress(BASE_BACKUP_PROGRESS *progress, int len, bool force)
+{
+	struct timeval now;
+	long elapsed;
+
+	progress->received += len;
+	gettimeofday(&now, NULL);
+
+	if (force || now.tv_sec - progress->last_report >= PROGRESS_REPORT_INTERVAL)
+	{
+		char msg[256];
+		long received_kb = progress->received / 1024;
+
+		if (progress->total_kb > 0)
+			snprintf(msg, sizeof(msg), "base backup: %ld of %ld kB (%d%%)",
+					 received_kb, progress->total_kb,
+					 (int)Min(100, received_kb * 100 / progress->total_kb));
+		else
+			snprintf(msg, sizeof(msg), "base backup: %ld kB", received_kb);
+
+		pool_debug("pool_base_backup: %s", msg);
+		pcp_report_progress(msg);
+		progress->last_report = now.tv_sec;
+	}
+
+	if (pool_config->recovery_max_rate > 0 && len > 0)
+	{
+		long expected;
+
+		/* microseconds the bytes received so far should take */
+		expected = (long)((double)progress->received * 1000000 /
+						  ((double)pool_config->recovery_max_rate * 1024));
+		elapsed = (now.tv_sec - progress->start.tv_sec) * 1000000 +
+			(now.tv_usec - progress->start.tv_usec);
+
+		if (expected > elapsed)
+		{
+			struct timeval t;
+
+			t.tv_sec = (expected - elapsed) / 1000000;
+			t.tv_usec = (expected - elapsed) % 1000000;
+			select(0, NULL, NULL, NULL, &t);
+		}
+	}
+}
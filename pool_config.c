@@ -1864,7 +1864,12 @@ int pool_init_config(void)
 	pool_config->backend_socket_dir = NULL;
 	pool_config->pcp_timeout = 10;
 	pool_config->num_init_children = 32;
+	pool_config->min_spare_children = 0;
+	pool_config->max_spare_children = 0;
 	pool_config->max_pool = 4;
+	pool_config->prewarm_connections = 0;
+	pool_config->serialize_accept = 0;
+	pool_config->accept_queue_size = 0;
 	pool_config->child_life_time = 300;
 	pool_config->client_idle_limit = 0;
 	pool_config->connection_life_time = 0;
@@ -1878,6 +1883,7 @@ int pool_init_config(void)
 	pool_config->pid_file_name = DEFAULT_PID_FILE_NAME;
  	pool_config->log_statement = 0;
  	pool_config->log_per_node_statement = 0;
+	pool_config->log_buffer_size = 0;
 	pool_config->log_connections = 0;
 	pool_config->log_hostname = 0;
 	pool_config->enable_pool_hba = 0;
@@ -1890,6 +1896,7 @@ int pool_init_config(void)
 	pool_config->replicate_select = 0;
 	pool_config->reset_query_list = default_reset_query_list;
 	pool_config->num_reset_queries = sizeof(default_reset_query_list)/sizeof(char *);
+	pool_config->lazy_reset = 0;
 	pool_config->white_function_list = NULL;
 	pool_config->num_white_function_list = 0;
 	pool_config->black_function_list = default_black_function_list;
@@ -1909,6 +1916,7 @@ int pool_init_config(void)
 	pool_config->failback_command = "";
 	pool_config->fail_over_on_backend_error = 1;
 	pool_config->insert_lock = 1;
+	pool_config->sequence_prealloc_size = 0;
 	pool_config->ignore_leading_white_space = 1;
 	pool_config->parallel_mode = 0;
 	pool_config->enable_query_cache = 0;
@@ -1923,9 +1931,14 @@ int pool_init_config(void)
     pool_config->recovery_password = "";
     pool_config->recovery_1st_stage_command = "";
     pool_config->recovery_2nd_stage_command = "";
+    pool_config->recovery_base_backup = 0;
+    pool_config->recovery_max_rate = 0;
 	pool_config->recovery_timeout = 90;
 	pool_config->client_idle_limit_in_recovery = 0;
 	pool_config->lobj_lock_table = "";
+	pool_config->lobj_prealloc_size = 0;
+	pool_config->timestamp_calibration_interval = 0;
+	pool_config->cancel_request_delay = 1000;
 	pool_config->ssl = 0;
 	pool_config->ssl_cert = "";
 	pool_config->ssl_key = "";
@@ -2221,6 +2234,32 @@ int pool_get_config(char *confpath, POOL_CONFIG_CONTEXT context)
 			}
 			pool_config->num_init_children = v;
 		}
+
+		else if (!strcmp(key, "min_spare_children") && CHECK_CONTEXT(INIT_CONFIG|RELOAD_CONFIG, context))
+		{
+			int v = atoi(yytext);
+
+			if (token != POOL_INTEGER || v < 0)
+			{
+				pool_error("pool_config: %s must be equal or higher than 0 numeric value", key);
+				fclose(fd);
+				return(-1);
+			}
+			pool_config->min_spare_children = v;
+		}
+
+		else if (!strcmp(key, "max_spare_children") && CHECK_CONTEXT(INIT_CONFIG|RELOAD_CONFIG, context))
+		{
+			int v = atoi(yytext);
+
+			if (token != POOL_INTEGER || v < 0)
+			{
+				pool_error("pool_config: %s must be equal or higher than 0 numeric value", key);
+				fclose(fd);
+				return(-1);
+			}
+			pool_config->max_spare_children = v;
+		}
 		else if (!strcmp(key, "child_life_time") &&
 				 CHECK_CONTEXT(INIT_CONFIG|RELOAD_CONFIG, context))
 		{
@@ -2298,6 +2337,45 @@ int pool_get_config(char *confpath, POOL_CONFIG_CONTEXT context)
 			}
 			pool_config->max_pool = v;
 		}
+		else if (!strcmp(key, "prewarm_connections") && CHECK_CONTEXT(INIT_CONFIG, context))
+		{
+			int v = atoi(yytext);
+
+			if (token != POOL_INTEGER || v < 0)
+			{
+				pool_error("pool_config: %s must be equal or higher than 0 numeric value", key);
+				fclose(fd);
+				return(-1);
+			}
+			pool_config->prewarm_connections = v;
+		}
+
+		else if (!strcmp(key, "serialize_accept") &&
+				 CHECK_CONTEXT(INIT_CONFIG|RELOAD_CONFIG, context))
+		{
+			int v = eval_logical(yytext);
+
+			if (v < 0)
+			{
+				pool_error("pool_config: invalid value %s for %s", yytext, key);
+				fclose(fd);
+				return(-1);
+			}
+			pool_config->serialize_accept = v;
+		}
+
+		else if (!strcmp(key, "accept_queue_size") && CHECK_CONTEXT(INIT_CONFIG, context))
+		{
+			int v = atoi(yytext);
+
+			if (token != POOL_INTEGER || v < 0)
+			{
+				pool_error("pool_config: %s must be equal or higher than 0 numeric value", key);
+				fclose(fd);
+				return(-1);
+			}
+			pool_config->accept_queue_size = v;
+		}
 		else if (!strcmp(key, "logdir") && CHECK_CONTEXT(INIT_CONFIG, context))
 		{
 			char *str;
@@ -2569,6 +2647,20 @@ int pool_get_config(char *confpath, POOL_CONFIG_CONTEXT context)
 			}
 		}
 
+		else if (!strcmp(key, "lazy_reset") &&
+				 CHECK_CONTEXT(INIT_CONFIG|RELOAD_CONFIG, context))
+		{
+			int v = eval_logical(yytext);
+
+			if (v < 0)
+			{
+				pool_error("pool_config: invalid value %s for %s", yytext, key);
+				fclose(fd);
+				return(-1);
+			}
+			pool_config->lazy_reset = v;
+		}
+
 		else if (!strcmp(key, "white_function_list") &&
 				 CHECK_CONTEXT(INIT_CONFIG|RELOAD_CONFIG, context))
 		{
@@ -2965,6 +3057,33 @@ int pool_get_config(char *confpath, POOL_CONFIG_CONTEXT context)
 			pool_config->recovery_2nd_stage_command = str;
 		}
 
+		else if (!strcmp(key, "recovery_base_backup") &&
+				 CHECK_CONTEXT(INIT_CONFIG|RELOAD_CONFIG, context))
+		{
+			int v = eval_logical(yytext);
+
+			if (v < 0)
+			{
+				pool_error("pool_config: invalid value %s for %s", yytext, key);
+				fclose(fd);
+				return(-1);
+			}
+			pool_config->recovery_base_backup = v;
+		}
+
+		else if (!strcmp(key, "recovery_max_rate") && CHECK_CONTEXT(INIT_CONFIG|RELOAD_CONFIG, context))
+		{
+			int v = atoi(yytext);
+
+			if (token != POOL_INTEGER || v < 0)
+			{
+				pool_error("pool_config: %s must be equal or higher than 0 numeric value", key);
+				fclose(fd);
+				return(-1);
+			}
+			pool_config->recovery_max_rate = v;
+		}
+
 		else if (!strcmp(key, "recovery_timeout") &&
 				 CHECK_CONTEXT(INIT_CONFIG|RELOAD_CONFIG, context))
 		{
@@ -3007,6 +3126,19 @@ int pool_get_config(char *confpath, POOL_CONFIG_CONTEXT context)
 			pool_config->insert_lock = v;
 		}
 
+		else if (!strcmp(key, "sequence_prealloc_size") && CHECK_CONTEXT(INIT_CONFIG, context))
+		{
+			int v = atoi(yytext);
+
+			if (token != POOL_INTEGER || v < 0)
+			{
+				pool_error("pool_config: %s must be equal or higher than 0 numeric value", key);
+				fclose(fd);
+				return(-1);
+			}
+			pool_config->sequence_prealloc_size = v;
+		}
+
 		else if (!strcmp(key, "ignore_leading_white_space") &&
 				 CHECK_CONTEXT(INIT_CONFIG|RELOAD_CONFIG, context))
 		{
@@ -3396,6 +3528,19 @@ int pool_get_config(char *confpath, POOL_CONFIG_CONTEXT context)
 			}
 			pool_config->log_per_node_statement = v;
 		}
+
+		else if (!strcmp(key, "log_buffer_size") && CHECK_CONTEXT(INIT_CONFIG, context))
+		{
+			int v = atoi(yytext);
+
+			if (token != POOL_INTEGER || v < 0)
+			{
+				pool_error("pool_config: %s must be equal or higher than 0 numeric value", key);
+				fclose(fd);
+				return(-1);
+			}
+			pool_config->log_buffer_size = v;
+		}
        	else if (!strcmp(key, "log_statement") && CHECK_CONTEXT(INIT_CONFIG|RELOAD_CONFIG, context))
 		{
 			int v = eval_logical(yytext);
@@ -3427,6 +3572,45 @@ int pool_get_config(char *confpath, POOL_CONFIG_CONTEXT context)
 			pool_config->lobj_lock_table = str;
 		}
 
+		else if (!strcmp(key, "lobj_prealloc_size") && CHECK_CONTEXT(INIT_CONFIG, context))
+		{
+			int v = atoi(yytext);
+
+			if (token != POOL_INTEGER || v < 0)
+			{
+				pool_error("pool_config: %s must be equal or higher than 0 numeric value", key);
+				fclose(fd);
+				return(-1);
+			}
+			pool_config->lobj_prealloc_size = v;
+		}
+
+		else if (!strcmp(key, "timestamp_calibration_interval") && CHECK_CONTEXT(INIT_CONFIG, context))
+		{
+			int v = atoi(yytext);
+
+			if (token != POOL_INTEGER || v < 0)
+			{
+				pool_error("pool_config: %s must be equal or higher than 0 numeric value", key);
+				fclose(fd);
+				return(-1);
+			}
+			pool_config->timestamp_calibration_interval = v;
+		}
+
+		else if (!strcmp(key, "cancel_request_delay") && CHECK_CONTEXT(INIT_CONFIG|RELOAD_CONFIG, context))
+		{
+			int v = atoi(yytext);
+
+			if (token != POOL_INTEGER || v < 0)
+			{
+				pool_error("pool_config: %s must be equal or higher than 0 numeric value", key);
+				fclose(fd);
+				return(-1);
+			}
+			pool_config->cancel_request_delay = v;
+		}
+
         else if (!strcmp(key, "ssl") && CHECK_CONTEXT(INIT_CONFIG, context))
 		{
 			int v = eval_logical(yytext);
@@ -3658,6 +3842,8 @@ int pool_get_config(char *confpath, POOL_CONFIG_CONTEXT context)
 		info->schema_name = pool_config->system_db_schema;
 		info->dist_def_num = 0;
 		info->dist_def_slot = NULL;
+		info->repli_def_num = 0;
+		info->repli_def_slot = NULL;
 
 #ifndef POOL_PRIVATE
 		if (pool_config->parallel_mode)
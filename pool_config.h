@@ -64,6 +64,8 @@ typedef struct {
 	char *pcp_socket_dir;		/* PCP socket directory */
 	int pcp_timeout;			/* PCP timeout for an idle client */
     int	num_init_children;	/* # of children initially pre-forked */
+	int min_spare_children;		/* min # of idle children if max_spare_children > 0 */
+	int max_spare_children;		/* max # of idle children. 0 means all children are pre-forked */
     int	child_life_time;	/* if idle for this seconds, child exits */
     int	connection_life_time;	/* if idle for this seconds, connection closes */
     int	child_max_connections;	/* if max_connections received, child exits */
@@ -71,6 +73,11 @@ typedef struct {
 								   disconnected after n seconds idle */
 	int authentication_timeout; /* maximum time in seconds to complete client authentication */
     int	max_pool;	/* max # of connection pool per child */
+	int prewarm_connections;	/* # of most recently used user/database
+								 * pairs for which idle child keeps a
+								 * connection. 0 means off */
+	int serialize_accept;		/* if non 0, serialize accept() among children */
+	int accept_queue_size;		/* max number of connections queued by acceptor. 0 means no acceptor */
     char *logdir;		/* logging directory */
     char *log_destination;      /* log destination: stderr or syslog */
     int syslog_facility;        /* syslog facility: LOCAL0, LOCAL1, ... */
@@ -98,6 +105,7 @@ typedef struct {
 
 	int replicate_select; /* if non 0, replicate SELECT statement when load balancing is disabled. */
 	char **reset_query_list;		/* comma separated list of quries to be issued at the end of session */
+	int lazy_reset;		/* if non 0, skip reset queries which undo nothing */
 	char **white_function_list;		/* list of functions with no side effetcs */
 	char **black_function_list;		/* list of functions with side effetcs */
 	int print_timestamp;		/* if non 0, print time stamp to each log line */
@@ -130,15 +138,22 @@ typedef struct {
 	char *recovery_password;		/* PostgreSQL user password for online recovery */
 	char *recovery_1st_stage_command;   /* Online recovery command in 1st stage */
 	char *recovery_2nd_stage_command;   /* Online recovery command in 2nd stage */
+	int recovery_base_backup;		/* if true, 1st stage of online recovery takes a base backup by itself */
+	int recovery_max_rate;		/* max rate of base backup in kB per second. 0 means unlimited */
 	int recovery_timeout;				/* maximum time in seconds to wait for remote start-up */
 	int client_idle_limit_in_recovery;		/* If > 0, the client is forced to be
 											 *  disconnected after n seconds idle
 											 *  This parameter is only valid while in recovery 2nd statge */
 	int insert_lock;	/* if non 0, automatically lock table with INSERT to keep SERIAL
 						   data consistency */
+	int sequence_prealloc_size;		/* if > 0, assign SERIAL values from blocks of
+										 * this many values preallocated on all nodes
+										 * instead of locking with insert_lock */
 	int ignore_leading_white_space;		/* ignore leading white spaces of each query */
  	int log_statement; /* 0:false, 1: true - logs all SQL statements */
  	int log_per_node_statement; /* 0:false, 1: true - logs per node detailed SQL statements */
+	int log_buffer_size;		/* size of per child log ring buffer in bytes.
+								 * 0 means write log messages synchronously */
 
 	int parallel_mode;	/* if non 0, run in parallel query mode */
 
@@ -153,6 +168,14 @@ typedef struct {
 	char *system_db_password;	/* password to access system DB */
 
 	char *lobj_lock_table;		/* table name to lock for rewriting lo_creat */
+	int lobj_prealloc_size;		/* if > 0, number of large object ids reserved
+									 * at once for rewriting lo_creat */
+	int timestamp_calibration_interval;		/* if > 0, timestamps for rewriting now() are
+											 * calculated locally and the clock offset
+											 * against the master is calibrated every
+											 * this seconds. 0 means asking the master */
+	int cancel_request_delay;	/* delay in milliseconds before forwarding a cancel
+								 * request to other than the master in replication mode */
 
 	int debug_level;			/* debug message verbosity level.
 								 * 0: no message, 1 <= : more verbose
@@ -51,7 +51,7 @@ static int pool_index;	/* Active pool index */
 POOL_CONNECTION_POOL *pool_connection_pool;	/* connection pool */
 volatile sig_atomic_t backend_timer_expired = 0; /* flag for connection closed timer is expired */
 
-static POOL_CONNECTION_POOL_SLOT *create_cp(POOL_CONNECTION_POOL_SLOT *cp, int slot);
+static POOL_CONNECTION_POOL_SLOT *create_cp(POOL_CONNECTION_POOL_SLOT *cp, int slot, int fd);
 static POOL_CONNECTION_POOL *new_connection(POOL_CONNECTION_POOL *p);
 static int check_socket_status(int fd);
 
@@ -73,7 +73,7 @@ int pool_init_cp(void)
 	for (i = 0; i < pool_config->max_pool; i++)
 	{
 		pool_connection_pool[i].info = pool_coninfo(pool_get_process_context()->proc_id, i, 0);
-		memset(pool_connection_pool[i].info, 0, sizeof(ConnectionInfo) * MAX_NUM_BACKENDS);
+		pool_coninfo_clear(pool_connection_pool[i].info);
 	}
 	return 0;
 }
@@ -162,7 +162,7 @@ POOL_CONNECTION_POOL *pool_get_cp(char *user, char *database, int protoMajor, in
 					info = p->info;
 					memset(p, 0, sizeof(POOL_CONNECTION_POOL_SLOT));
 					p->info = info;
-					memset(p->info, 0, sizeof(ConnectionInfo) * MAX_NUM_BACKENDS);
+					pool_coninfo_clear(p->info);
 					POOL_SETMASK(&oldmask);
 					return NULL;
 				}
@@ -210,9 +210,92 @@ void pool_discard_cp(char *user, char *database, int protoMajor)
 	info = p->info;
 	memset(p, 0, sizeof(POOL_CONNECTION_POOL));
 	p->info = info;
-	memset(p->info, 0, sizeof(ConnectionInfo) * MAX_NUM_BACKENDS);
+	pool_coninfo_clear(p->info);
 }
 
+/*
+ * Return true if a connection pool for the user and database exists.
+ * Unlike pool_get_cp(), the pool is not touched.
+ */
+bool pool_cp_exists(char *user, char *database, int protoMajor)
+{
+	POOL_CONNECTION_POOL *p = pool_connection_pool;
+	int i;
+
+	if (p == NULL)
+		return false;
+
+	for (i=0;i<pool_config->max_pool;i++, p++)
+	{
+		if (MASTER_CONNECTION(p) &&
+			MASTER_CONNECTION(p)->sp &&
+			MASTER_CONNECTION(p)->sp->major == protoMajor &&
+			MASTER_CONNECTION(p)->sp->user != NULL &&
+			strcmp(MASTER_CONNECTION(p)->sp->user, user) == 0 &&
+			strcmp(MASTER_CONNECTION(p)->sp->database, database) == 0)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Return true if there's an empty connection slot, i.e.
+ * pool_create_cp() does not need to discard an existing connection.
+ */
+bool pool_cp_has_free_slot(void)
+{
+	POOL_CONNECTION_POOL *p = pool_connection_pool;
+	int i;
+
+	if (p == NULL)
+		return false;
+
+	for (i=0;i<pool_config->max_pool;i++, p++)
+	{
+		if (MASTER_CONNECTION(p) == NULL)
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Close and release connections to the DB node in all connection
+ * pools. Called when the node has been detached while this child is
+ * alive. Connections to other nodes are kept, so the pools look like
+ * the ones created while the node is down.
+ */
+void pool_discard_node_connections(int node_id)
+{
+#ifdef HAVE_SIGPROCMASK
+	sigset_t oldmask;
+#else
+	int	oldmask;
+#endif
+
+	POOL_CONNECTION_POOL *p = pool_connection_pool;
+	int i;
+
+	if (p == NULL)
+		return;
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+
+	for (i=0;i<pool_config->max_pool;i++, p++)
+	{
+		if (CONNECTION_SLOT(p, node_id) == NULL)
+			continue;
+
+		/* the startup packet is shared with other slots. do not free it */
+		pool_close(CONNECTION(p, node_id));
+		free(CONNECTION_SLOT(p, node_id));
+		CONNECTION_SLOT(p, node_id) = NULL;
+
+		/* forget the backend pid and cancel key of the node */
+		pool_coninfo_clear_node(p->info, node_id);
+	}
+
+	POOL_SETMASK(&oldmask);
+}
 
 /*
 * create a connection pool by user and database
@@ -295,7 +378,7 @@ POOL_CONNECTION_POOL *pool_create_cp(void)
 	info = p->info;
 	memset(p, 0, sizeof(POOL_CONNECTION_POOL));
 	p->info = info;
-	memset(p->info, 0, sizeof(ConnectionInfo) * MAX_NUM_BACKENDS);
+	pool_coninfo_clear(p->info);
 
 	ret = new_connection(p);
 	return ret;
@@ -402,7 +485,7 @@ void pool_backend_timer(void)
 				info = p->info;
 				memset(p, 0, sizeof(POOL_CONNECTION_POOL));
 				p->info = info;
-				memset(p->info, 0, sizeof(ConnectionInfo) * MAX_NUM_BACKENDS);
+				pool_coninfo_clear(p->info);
 			}
 			else
 			{
@@ -569,22 +652,162 @@ int connect_inet_domain_socket_by_port(char *host, int port, bool retry)
 }
 
 /*
- * create connection pool
+ * Start connecting to the backend. For INET domain sockets connect()
+ * does not wait for the connection to be established and
+ * *in_progress is set to true if it's still in progress. UNIX domain
+ * socket connections are local and done synchronously. Returns the
+ * socket or -1 on error.
  */
-static POOL_CONNECTION_POOL_SLOT *create_cp(POOL_CONNECTION_POOL_SLOT *cp, int slot)
+int start_connect_backend(int slot, bool *in_progress)
 {
 	BackendInfo *b = &pool_config->backend_desc->backend_info[slot];
+	struct sockaddr_in addr;
+	struct hostent *hp;
 	int fd;
+	int on = 1;
+
+	*in_progress = false;
 
 	if (*b->backend_hostname == '/')
+		return connect_unix_domain_socket(slot, TRUE);
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0)
 	{
-		fd = connect_unix_domain_socket(slot, TRUE);
+		pool_error("start_connect_backend: socket() failed: %s", strerror(errno));
+		return -1;
 	}
-	else
+
+	/* set nodelay */
+	if (setsockopt(fd, IPPROTO_TCP, TCP_NODELAY,
+				   (char *) &on,
+				   sizeof(on)) < 0)
 	{
-		fd = connect_inet_domain_socket(slot, TRUE);
+		pool_error("start_connect_backend: setsockopt() failed: %s", strerror(errno));
+		close(fd);
+		return -1;
 	}
 
+	memset((char *) &addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(b->backend_port);
+
+	hp = gethostbyname(b->backend_hostname);
+	if ((hp == NULL) || (hp->h_addrtype != AF_INET))
+	{
+		pool_error("start_connect_backend: gethostbyname() failed: %s host: %s", hstrerror(h_errno), b->backend_hostname);
+		close(fd);
+		return -1;
+	}
+	memmove((char *) &(addr.sin_addr),
+			(char *) hp->h_addr,
+			hp->h_length);
+
+	pool_set_nonblock(fd);
+
+	if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+	{
+		/*
+		 * EINTR does not abort non-blocking connect(). The connection
+		 * is established asynchronously in this case too.
+		 */
+		if (errno != EINPROGRESS && errno != EINTR)
+		{
+			pool_error("start_connect_backend: connect() failed: %s", strerror(errno));
+			close(fd);
+			return -1;
+		}
+		*in_progress = true;
+	}
+	return fd;
+}
+
+/*
+ * Wait for connections started by start_connect_backend() to be
+ * established and set the sockets back to blocking mode. fds[i] is
+ * set to -1 if connecting to node i failed.
+ */
+void wait_for_connect_backends(int *fds, bool *in_progress)
+{
+	fd_set wmask;
+	int num_fds;
+	int err;
+	socklen_t errlen;
+	int i;
+
+	for (;;)
+	{
+		num_fds = 0;
+		FD_ZERO(&wmask);
+		for (i=0;i<NUM_BACKENDS;i++)
+		{
+			if (fds[i] >= 0 && in_progress[i])
+			{
+				FD_SET(fds[i], &wmask);
+				num_fds = Max(fds[i] + 1, num_fds);
+			}
+		}
+
+		if (num_fds == 0)
+			break;
+
+		if (select(num_fds, NULL, &wmask, NULL, NULL) < 0)
+		{
+			if (errno == EINTR && !exit_request && !health_check_timed_out())
+				continue;
+
+			if (exit_request)
+				pool_log("wait_for_connect_backends: exit request has been sent");
+			else if (health_check_timed_out())
+				pool_error("wait_for_connect_backends: health check timer expired");
+			else
+				pool_error("wait_for_connect_backends: select() failed: %s", strerror(errno));
+
+			for (i=0;i<NUM_BACKENDS;i++)
+			{
+				if (fds[i] >= 0 && in_progress[i])
+				{
+					close(fds[i]);
+					fds[i] = -1;
+				}
+			}
+			break;
+		}
+
+		for (i=0;i<NUM_BACKENDS;i++)
+		{
+			if (fds[i] < 0 || !in_progress[i] || !FD_ISSET(fds[i], &wmask))
+				continue;
+
+			in_progress[i] = false;
+
+			errlen = sizeof(err);
+			if (getsockopt(fds[i], SOL_SOCKET, SO_ERROR, &err, &errlen) < 0)
+				err = errno;
+
+			if (err != 0)
+			{
+				pool_error("wait_for_connect_backends: connect() failed: %s", strerror(err));
+				close(fds[i]);
+				fds[i] = -1;
+			}
+		}
+	}
+
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		if (fds[i] >= 0)
+			pool_unset_nonblock(fds[i]);
+	}
+}
+
+/*
+ * create connection pool
+ */
+static POOL_CONNECTION_POOL_SLOT *create_cp(POOL_CONNECTION_POOL_SLOT *cp, int slot, int fd)
+{
+	BackendInfo *b = &pool_config->backend_desc->backend_info[slot];
+
 	if (fd < 0)
 	{
 		pool_error("connection to %s(%d) failed", b->backend_hostname, b->backend_port);
@@ -598,16 +821,23 @@ static POOL_CONNECTION_POOL_SLOT *create_cp(POOL_CONNECTION_POOL_SLOT *cp, int s
 }
 
 /*
- * create actual connections to backends
+ * create actual connections to backends. Connecting to all backends
+ * is started first and then waited for, so that the time to connect
+ * does not add up as the number of backends increases.
  */
 static POOL_CONNECTION_POOL *new_connection(POOL_CONNECTION_POOL *p)
 {
 	POOL_CONNECTION_POOL_SLOT *s;
+	int fds[MAX_NUM_BACKENDS];
+	bool in_progress[MAX_NUM_BACKENDS];
 	int active_backend_count = 0;
 	int i;
 
 	for (i=0;i<NUM_BACKENDS;i++)
 	{
+		fds[i] = -1;
+		in_progress[i] = false;
+
 		pool_debug("new_connection: connecting %d backend", i);
 
 		if (!VALID_BACKEND(i))
@@ -617,6 +847,16 @@ static POOL_CONNECTION_POOL *new_connection(POOL_CONNECTION_POOL *p)
 			continue;
 		}
 
+		fds[i] = start_connect_backend(i, &in_progress[i]);
+	}
+
+	wait_for_connect_backends(fds, in_progress);
+
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		if (!VALID_BACKEND(i))
+			continue;
+
 		s = malloc(sizeof(POOL_CONNECTION_POOL_SLOT));
 		if (s == NULL)
 		{
@@ -624,7 +864,7 @@ static POOL_CONNECTION_POOL *new_connection(POOL_CONNECTION_POOL *p)
 			return NULL;
 		}
 
-		if (create_cp(s, i) == NULL)
+		if (create_cp(s, i, fds[i]) == NULL)
 		{
 			/* connection failed. mark this backend down */
 			pool_error("new_connection: create_cp() failed");
@@ -27,15 +27,34 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "pool.h"
 #include "pool_config.h"
 
 #define MAXSTRFTIME 128
 
+/* max length of a log message to be written to log ring buffer */
+#define MAX_LOG_RECORD_LEN 8192
+
 extern int debug;
 
 static char *nowsec(void);
+static int log_to_ring(const char *level, const char *fmt, va_list ap);
+
+static POOL_LOG_RING *log_ring;		/* my log ring buffer if any */
+static int log_ring_pid;			/* my pid */
+static volatile sig_atomic_t in_log_ring = 0;	/* true if writing to log_ring */
+
+/*
+ * Start writing log messages to the log ring buffer instead of
+ * stderr. NULL stops it.
+ */
+void pool_set_log_ring(POOL_LOG_RING *ring)
+{
+	log_ring_pid = (int)getpid();
+	log_ring = ring;
+}
 
 void pool_error(const char *fmt,...)
 {
@@ -58,6 +77,17 @@ void pool_error(const char *fmt,...)
 	   return;
 	}
 
+	if (log_ring)
+	{
+		int rtn;
+
+		va_start(ap, fmt);
+		rtn = log_to_ring("ERROR:", fmt, ap);
+		va_end(ap);
+		if (rtn == 0)
+			return;
+	}
+
 	POOL_SETMASK2(&BlockSig, &oldmask);
 
 	if (pool_config->print_timestamp)
@@ -120,6 +150,17 @@ void pool_debug(const char *fmt,...)
 	   return;
 	}
 
+	if (log_ring)
+	{
+		int rtn;
+
+		va_start(ap, fmt);
+		rtn = log_to_ring("DEBUG:", fmt, ap);
+		va_end(ap);
+		if (rtn == 0)
+			return;
+	}
+
 	POOL_SETMASK2(&BlockSig, &oldmask);
 
 	if (pool_config->print_timestamp)
@@ -171,6 +212,17 @@ void pool_log(const char *fmt,...)
 	   return;
 	}
 
+	if (log_ring)
+	{
+		int rtn;
+
+		va_start(ap, fmt);
+		rtn = log_to_ring("LOG:  ", fmt, ap);
+		va_end(ap);
+		if (rtn == 0)
+			return;
+	}
+
 	POOL_SETMASK2(&BlockSig, &oldmask);
 
 	if (pool_config->print_timestamp)
@@ -201,11 +253,76 @@ void pool_log(const char *fmt,...)
 	POOL_SETMASK(&oldmask);
 }
 
+/*
+ * Format a log message and append it to the log ring buffer. The
+ * message is dropped if the ring buffer is full. Returns -1 if the
+ * message cannot be written to the ring buffer and caller should
+ * write it to stderr instead. Since the ring buffer has only one
+ * writer, no lock is needed except against signal handlers calling
+ * us again.
+ */
+static int log_to_ring(const char *level, const char *fmt, va_list ap)
+{
+	char buf[MAX_LOG_RECORD_LEN];
+	unsigned int head, offset, first;
+	int len, n;
+
+	if (in_log_ring)
+		return -1;
+	in_log_ring = 1;
+
+	if (pool_config->print_timestamp)
+		len = snprintf(buf, sizeof(buf), "%s %s pid %d: ", nowsec(), level, log_ring_pid);
+	else
+		len = snprintf(buf, sizeof(buf), "%s pid %d: ", level, log_ring_pid);
+
+	n = vsnprintf(buf + len, sizeof(buf) - len, fmt, ap);
+	if (n < 0 || len + n + 1 > sizeof(buf) || len + n + 1 > log_ring->size)
+	{
+		in_log_ring = 0;
+		return -1;
+	}
+	len += n;
+	buf[len++] = '\n';
+
+	head = log_ring->head;
+	if (log_ring->size - (head - log_ring->tail) < len)
+	{
+		log_ring->dropped++;
+		in_log_ring = 0;
+		return 0;
+	}
+
+	offset = head & (log_ring->size - 1);
+	first = log_ring->size - offset;
+	if (first > len)
+		first = len;
+	memcpy(log_ring->data + offset, buf, first);
+	if (len > first)
+		memcpy(log_ring->data, buf + first, len - first);
+
+	/* make sure that the data is written before head is advanced */
+	POOL_MEMORY_BARRIER();
+	log_ring->head = head + len;
+
+	in_log_ring = 0;
+	return 0;
+}
+
+/*
+ * Return current time as a string. The string is reused while we are
+ * in the same second.
+ */
 static char *nowsec(void)
 {
 	static char strbuf[MAXSTRFTIME];
+	static time_t last;
 	time_t now = time(NULL);
 
-	strftime(strbuf, MAXSTRFTIME, "%Y-%m-%d %H:%M:%S", localtime(&now));
+	if (now != last)
+	{
+		strftime(strbuf, MAXSTRFTIME, "%Y-%m-%d %H:%M:%S", localtime(&now));
+		last = now;
+	}
 	return strbuf;
 }
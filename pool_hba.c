@@ -42,8 +42,57 @@
 #define MULTI_VALUE_SEP "\001" /* delimiter for multi-valued column strings */
 #define MAX_TOKEN	256
 
+/* connection type of a hba rule */
+typedef enum {
+	HBA_LOCAL,
+	HBA_HOST,
+	HBA_HOSTSSL,
+	HBA_HOSTNOSSL,
+	HBA_ERROR					/* erroneous line */
+} HbaConnType;
+
+/* kind of a name in database or user list */
+typedef enum {
+	HBA_NAME_LITERAL,			/* plain name */
+	HBA_NAME_ALL,				/* "all" */
+	HBA_NAME_SAMEUSER,			/* "sameuser" */
+	HBA_NAME_GROUP				/* "samegroup" or "+group" */
+} HbaNameKind;
+
+typedef struct {
+	HbaNameKind kind;
+	char *name;					/* points into the token of hba_lines */
+	unsigned int hash;			/* hba_hash() of name */
+} HbaName;
+
+typedef struct {
+	int num;					/* number of names */
+	HbaName *names;
+} HbaNameList;
+
+/*
+ * A line of pool_hba.conf compiled at load time, so that no parsing
+ * is needed per connection.
+ */
+typedef struct {
+	int line_num;				/* line number in pool_hba.conf */
+	HbaConnType type;
+	HbaNameList db;
+	HbaNameList user;
+	struct sockaddr_storage addr;	/* host address */
+	struct sockaddr_storage mask;	/* host mask */
+#ifdef HAVE_IPV6
+	struct sockaddr_storage addr6;	/* IPv4 addr promoted to IPv6 */
+	struct sockaddr_storage mask6;	/* IPv4 mask promoted to IPv6 */
+#endif
+	UserAuth auth_method;
+	char *auth_arg;
+} HbaRule;
+
 static List *hba_lines = NIL;
 static List *hba_line_nums = NIL;
+static HbaRule *hba_rules = NULL;
+static int num_hba_rules = 0;
 static char *hbaFileName;
 
 static POOL_MEMORY_POOL *hba_memory_context = NULL;
@@ -53,10 +102,16 @@ static void auth_failed(POOL_CONNECTION *frontend);
 static void close_all_backend_connections(void);
 static bool hba_getauthmethod(POOL_CONNECTION *frontend);
 static bool check_hba(POOL_CONNECTION *frontend);
-static void parse_hba(List *line, int line_num, POOL_CONNECTION *frontend, bool *found_p, bool *error_p);
+static bool check_hba_addr(HbaRule *rule, POOL_CONNECTION *frontend);
+static void compile_hba_line(List *line, int line_num, HbaRule *rule);
 static void parse_hba_auth(ListCell **line_item, UserAuth *userauth_p, char **auth_arg_p, bool *error_p);
-static bool check_user(char *user, char *param_str);
-static bool check_db(char *dbname, char *user, char *param_str);
+static int compile_hba_names(char *param_str, bool is_db, HbaNameList *list);
+static bool check_user(char *user, unsigned int user_hash, HbaNameList *list);
+static bool check_db(char *dbname, unsigned int db_hash, char *user, HbaNameList *list);
+static unsigned int hba_hash(const char *name);
+static void compile_hba_lines(List *lines, List *line_nums);
+static void free_hba_rule(HbaRule *rule);
+static void free_hba_rules(void);
 static void free_lines(List **lines, List **line_nums);
 static void tokenize_file(const char *filename, FILE *file, List **lines, List **line_nums);
 static char *tokenize_inc_file(const char *outer_filename, const char *inc_filename);
@@ -117,6 +172,7 @@ int load_hba(char *hbapath)
 	old_context = pool_memory;
 	pool_memory = hba_memory_context;
 
+	free_hba_rules();
 	if (hba_lines || hba_line_nums)
 		free_lines(&hba_lines, &hba_line_nums);
 
@@ -141,6 +197,9 @@ int load_hba(char *hbapath)
 
 	hbaFileName = pstrdup(hbapath);
 
+	/* compile the lines so that connections need not parse them */
+	compile_hba_lines(hba_lines, hba_line_nums);
+
 	/* switch to old memory context */
 	pool_memory = old_context;
 
@@ -488,65 +547,131 @@ static bool hba_getauthmethod(POOL_CONNECTION *frontend)
 
 
 /*
- *  Scan the (pre-parsed) hba file line by line, looking for a match
- *  to the port's connection request.
+ *  Scan the compiled hba rules one by one, looking for a match to the
+ *  port's connection request. No memory is allocated here.
  */
 static bool check_hba(POOL_CONNECTION *frontend)
 {
-	bool found_entry = false;
-	bool error = false;
-	ListCell *line;
-	ListCell *line_num;
+	unsigned int db_hash = hba_hash(frontend->database);
+	unsigned int user_hash = hba_hash(frontend->username);
+	HbaRule *rule;
+	int i;
 
-	forboth(line, hba_lines, line_num, hba_line_nums)
+	for (i = 0; i < num_hba_rules; i++)
 	{
-		parse_hba(lfirst(line), lfirst_int(line_num),
-				  frontend, &found_entry, &error);
-		if (found_entry || error)
-			break;
-	}
+		rule = &hba_rules[i];
 
-	if (!error)
-	{
-		/* If no matching entry was found, synthesize 'reject' entry. */
-		if (!found_entry)
-			frontend->auth_method = uaReject;
+		switch (rule->type)
+		{
+			case HBA_ERROR:
+				pool_log("invalid entry in file \"%s\" at line %d",
+						 hbaFileName, rule->line_num);
+				return false;
+
+			case HBA_LOCAL:
+				/* Does not match if connection isn't AF_UNIX */
+				if (!IS_AF_UNIX(frontend->raddr.addr.ss_family))
+					continue;
+				break;
+
+			case HBA_HOSTSSL:
+#ifdef USE_SSL
+				/* Record does not match if we are not on an SSL connection */
+				if (!frontend->ssl)
+					continue;
+#endif
+				if (!check_hba_addr(rule, frontend))
+					continue;
+				break;
+
+			case HBA_HOSTNOSSL:
+#ifdef USE_SSL
+				/* Record does not match if we are on an SSL connection */
+				if (frontend->ssl)
+					continue;
+#endif
+				if (!check_hba_addr(rule, frontend))
+					continue;
+				break;
+
+			case HBA_HOST:
+				if (!check_hba_addr(rule, frontend))
+					continue;
+				break;
+		}
+
+		/* Does the entry match database and user? */
+		if (!check_db(frontend->database, db_hash, frontend->username, &rule->db))
+			continue;
+		if (!check_user(frontend->username, user_hash, &rule->user))
+			continue;
+
+		/* Success */
+		frontend->auth_method = rule->auth_method;
+		frontend->auth_arg = rule->auth_arg;
 		return true;
 	}
-	else
-		return false;
+
+	/* If no matching entry was found, synthesize 'reject' entry. */
+	frontend->auth_method = uaReject;
+	return true;
 }
 
 
 /*
- *  Process one line from the hba config file.
+ *  Check if the client address is in the address range of the rule.
+ */
+static bool check_hba_addr(HbaRule *rule, POOL_CONNECTION *frontend)
+{
+	if (rule->addr.ss_family == frontend->raddr.addr.ss_family)
+		return rangeSockAddr(&frontend->raddr.addr, &rule->addr, &rule->mask);
+
+	/*
+	 * Wrong address family.  We allow only one case: if the file has
+	 * IPv4 and the port is IPv6, use the address promoted to IPv6 at
+	 * load time.
+	 */
+#ifdef HAVE_IPV6
+	if (rule->addr.ss_family == AF_INET && frontend->raddr.addr.ss_family == AF_INET6)
+		return rangeSockAddr(&frontend->raddr.addr, &rule->addr6, &rule->mask6);
+#endif   /* HAVE_IPV6 */
+
+	/* Line doesn't match client port, so ignore it. */
+	return false;
+}
+
+
+/*
+ *  Compile one line from the hba config file into *rule.
  *
- *  See if it applies to a connection from a frontend with IP address
- *  frontend->raddr to a database named frontend->database.  If so, return
- *  *found_p true and fill in the auth arguments into the appropriate
- *  frontend fields. If not, leave *found_p as it was.  If the record has
- *  a syntax error, return *error_p true, after issuing a message to the
- *  log.  If no error, leave *error_p as it was.
+ *  IP addresses and masks are converted to binary, and database and
+ *  user lists are split into names. Tokens of the line are modified in
+ *  place. If the record has a syntax error, issue a message to the log
+ *  and make rule->type HBA_ERROR, so that a connection reaching the
+ *  rule fails as before.
  */
-static void parse_hba(List *line, int line_num, POOL_CONNECTION *frontend,
-					  bool *found_p, bool *error_p)
+static void compile_hba_line(List *line, int line_num, HbaRule *rule)
 {
 	char *token;
-	char *db, *db_tmp;
-	char *user, *user_tmp;
+	char *db = NULL;
+	char *user = NULL;
+	bool error = false;
 	struct addrinfo *gai_result;
 	struct addrinfo hints;
 	int ret;
-	struct sockaddr_storage addr;
-	struct sockaddr_storage mask;
 	char *cidr_slash;
 	ListCell *line_item;
 
+	memset(rule, 0, sizeof(*rule));
+	rule->line_num = line_num;
+
 	line_item = list_head(line);
 	/* Check the record type. */
 	token = lfirst(line_item);
 	if (strcmp(token, "local") == 0)
 	{
+		rule->type = HBA_LOCAL;
+
 		/* Get the database. */
 		line_item = lnext(line_item);
 		if (!line_item)
@@ -564,21 +689,10 @@ static void parse_hba(List *line, int line_num, POOL_CONNECTION *frontend,
 			goto hba_syntax;
 
 		/* Read the rest of the line. */
-		parse_hba_auth(&line_item, &frontend->auth_method,
-					   &frontend->auth_arg, error_p);
-		if (*error_p)
-			goto hba_syntax;
-
-        /* Disallow auth methods that always need TCP/IP sockets to work */
-		/*
-		if (frontend->auth_method == uaKrb4 ||
-			frontend->auth_method == uaKrb5)
+		parse_hba_auth(&line_item, &rule->auth_method,
+					   &rule->auth_arg, &error);
+		if (error)
 			goto hba_syntax;
-		*/
-
-		/* Does not match if connection isn't AF_UNIX */
-		if (!IS_AF_UNIX(frontend->raddr.addr.ss_family))
-			return;
 	}
 	else if (strcmp(token, "host") == 0
 			 || strcmp(token, "hostssl") == 0
@@ -587,27 +701,16 @@ static void parse_hba(List *line, int line_num, POOL_CONNECTION *frontend,
 		if (token[4] == 's')    /* "hostssl" */
 		{
 #ifdef USE_SSL
-			/* Record does not match if we are not on an SSL connection */
-			if (!frontend->ssl)
-				return;
-
-			/* Placeholder to require specific SSL level, perhaps? */
-			/* Or a client certificate */
-
-			/* Since we were on SSL, proceed as with normal 'host' mode */
+			rule->type = HBA_HOSTSSL;
 #else
 			/* We don't accept this keyword at all if no SSL support */
 			goto hba_syntax;
 #endif
 		}
-#ifdef USE_SSL
 		else if (token[4] == 'n')       /* "hostnossl" */
-		{
-			/* Record does not match if we are on an SSL connection */
-			if (frontend->ssl)
-				return;
-		}
-#endif
+			rule->type = HBA_HOSTNOSSL;
+		else
+			rule->type = HBA_HOST;
 
         /* Get the database. */
 		line_item = lnext(line_item);
@@ -657,13 +760,13 @@ static void parse_hba(List *line, int line_num, POOL_CONNECTION *frontend,
 		if (cidr_slash)
 			*cidr_slash = '/';
 
-		memcpy(&addr, gai_result->ai_addr, gai_result->ai_addrlen);
+		memcpy(&rule->addr, gai_result->ai_addr, gai_result->ai_addrlen);
 		freeaddrinfo_all(hints.ai_family, gai_result);
 
 		/* Get the netmask */
 		if (cidr_slash)
 		{
-			if (SockAddr_cidr_mask(&mask, cidr_slash + 1, addr.ss_family) < 0)
+			if (SockAddr_cidr_mask(&rule->mask, cidr_slash + 1, rule->addr.ss_family) < 0)
 				goto hba_syntax;
 		}
 		else
@@ -684,10 +787,10 @@ static void parse_hba(List *line, int line_num, POOL_CONNECTION *frontend,
 				goto hba_other_error;
 			}
 
-			memcpy(&mask, gai_result->ai_addr, gai_result->ai_addrlen);
+			memcpy(&rule->mask, gai_result->ai_addr, gai_result->ai_addrlen);
 			freeaddrinfo_all(hints.ai_family, gai_result);
 
-			if (addr.ss_family != mask.ss_family)
+			if (rule->addr.ss_family != rule->mask.ss_family)
 			{
 				pool_log("IP address and mask do not match in file \"%s\" line %d",
 						 hbaFileName, line_num);
@@ -695,69 +798,35 @@ static void parse_hba(List *line, int line_num, POOL_CONNECTION *frontend,
 			}
 		}
 
-		if (addr.ss_family != frontend->raddr.addr.ss_family)
-		{
-			/*
-			 * Wrong address family.  We allow only one case: if the file
-			 * has IPv4 and the port is IPv6, promote the file address to
-			 * IPv6 and try to match that way.
-			 */
 #ifdef HAVE_IPV6
-			if (addr.ss_family == AF_INET && frontend->raddr.addr.ss_family == AF_INET6)
-			{
-				promote_v4_to_v6_addr(&addr);
-				promote_v4_to_v6_mask(&mask);
-			}
-			else
-#endif   /* HAVE_IPV6 */
-			{
-				/* Line doesn't match client port, so ignore it. */
-				return;
-			}
+		/* Prepare for IPv6 clients matching IPv4 rule */
+		if (rule->addr.ss_family == AF_INET)
+		{
+			rule->addr6 = rule->addr;
+			rule->mask6 = rule->mask;
+			promote_v4_to_v6_addr(&rule->addr6);
+			promote_v4_to_v6_mask(&rule->mask6);
 		}
-
-		/* Ignore line if client port is not in the matching addr range. */
-		if (!rangeSockAddr(&frontend->raddr.addr, &addr, &mask))
-			return;
+#endif   /* HAVE_IPV6 */
 
 		/* Read the rest of the line. */
 		line_item = lnext(line_item);
 		if (!line_item)
 			goto hba_syntax;
-		parse_hba_auth(&line_item, &frontend->auth_method,
-					   &frontend->auth_arg, error_p);
-		if (*error_p)
+		parse_hba_auth(&line_item, &rule->auth_method,
+					   &rule->auth_arg, &error);
+		if (error)
 			goto hba_syntax;
 	}
 	else
 		goto hba_syntax;
 
-	/* Does the entry match database and user? */
-	/*
-	 * duplicate db and username since strtok() in check_db() and check_user()
-	 * will override '\001' with '\0'.
-	 */
-	db_tmp = strdup(db);
-	if (db_tmp == NULL)
-	{
-		pool_error("parse_hba: strdup failed: %s", strerror(errno));
-		exit(1);
-	}
-	user_tmp = strdup(user);
-	if (user_tmp == NULL)
+	if (compile_hba_names(db, true, &rule->db) < 0 ||
+		compile_hba_names(user, false, &rule->user) < 0)
 	{
-		pool_error("parse_hba: strdup failed: %s", strerror(errno));
+		pool_error("compile_hba_line: malloc failed: %s", strerror(errno));
 		exit(1);
 	}
-	if (!check_db(frontend->database, frontend->username, db_tmp))
-		return;
-	if (!check_user(frontend->username, user_tmp))
-        return;
-	free(db_tmp);
-	free(user_tmp);
-
-	/* Success */
-	*found_p = true;
 	return;
 
  hba_syntax:
@@ -770,7 +839,8 @@ static void parse_hba(List *line, int line_num, POOL_CONNECTION *frontend,
 
 	/* Come here if suitable message already logged */
  hba_other_error:
-	*error_p = true;
+	free_hba_rule(rule);
+	rule->type = HBA_ERROR;
 }
 
 
@@ -844,16 +914,63 @@ static void parse_hba_auth(ListCell **line_item, UserAuth *userauth_p,
 
 
 /*
- * Check comma user list for a specific user, handle group names.
+ * Split comma separated database or user list "param_str" into names
+ * and classify them. param_str is modified in place. Returns 0 on
+ * success, -1 on malloc failure.
  */
-static bool check_user(char *user, char *param_str)
+static int compile_hba_names(char *param_str, bool is_db, HbaNameList *list)
 {
 	char *tok;
+	HbaName *name;
+	int num = 1;
+	char *p;
+
+	for (p = param_str; *p; p++)
+	{
+		if (*p == MULTI_VALUE_SEP[0])
+			num++;
+	}
+
+	list->names = malloc(sizeof(HbaName) * num);
+	if (list->names == NULL)
+		return -1;
+	list->num = 0;
 
 	for (tok = strtok(param_str, MULTI_VALUE_SEP);
 		 tok != NULL; tok = strtok(NULL, MULTI_VALUE_SEP))
 	{
-		if (tok[0] == '+')
+		name = &list->names[list->num++];
+		name->name = tok;
+		name->hash = hba_hash(tok);
+
+		if (strcmp(tok, "all\n") == 0)
+			name->kind = HBA_NAME_ALL;
+		else if (is_db && strcmp(tok, "sameuser\n") == 0)
+			name->kind = HBA_NAME_SAMEUSER;
+		else if (is_db && strcmp(tok, "samegroup\n") == 0)
+			name->kind = HBA_NAME_GROUP;
+		else if (!is_db && tok[0] == '+')
+			name->kind = HBA_NAME_GROUP;
+		else
+			name->kind = HBA_NAME_LITERAL;
+	}
+	return 0;
+}
+
+
+/*
+ * Check compiled user list for a specific user, handle group names.
+ */
+static bool check_user(char *user, unsigned int user_hash, HbaNameList *list)
+{
+	HbaName *name;
+	int i;
+
+	for (i = 0; i < list->num; i++)
+	{
+		name = &list->names[i];
+
+		if (name->kind == HBA_NAME_GROUP)
 		{
 			/*
 			 * pgpool cannot accept groups. commented lines below are the
@@ -864,7 +981,9 @@ static bool check_user(char *user, char *param_str)
 /* 			if (check_group(tok + 1, user)) */
 /* 				return true; */
 		}
-		else if (strcmp(tok, user) == 0 || strcmp(tok, "all\n") == 0)
+		else if (name->kind == HBA_NAME_ALL)
+			return true;
+		else if (name->hash == user_hash && strcmp(name->name, user) == 0)
 			return true;
 	}
 
@@ -873,23 +992,25 @@ static bool check_user(char *user, char *param_str)
 
 
 /*
- * Check to see if db/user combination matches param string.
+ * Check to see if db/user combination matches compiled database list.
  */
-static bool check_db(char *dbname, char *user, char *param_str)
+static bool check_db(char *dbname, unsigned int db_hash, char *user, HbaNameList *list)
 {
-	char *tok;
+	HbaName *name;
+	int i;
 
-	for (tok = strtok(param_str, MULTI_VALUE_SEP);
-		 tok != NULL; tok = strtok(NULL, MULTI_VALUE_SEP))
+	for (i = 0; i < list->num; i++)
 	{
-		if (strcmp(tok, "all\n") == 0)
+		name = &list->names[i];
+
+		if (name->kind == HBA_NAME_ALL)
 			return true;
-		else if (strcmp(tok, "sameuser\n") == 0)
+		else if (name->kind == HBA_NAME_SAMEUSER)
 		{
 			if (strcmp(dbname, user) == 0)
 				return true;
 		}
-		else if (strcmp(tok, "samegroup\n") == 0)
+		else if (name->kind == HBA_NAME_GROUP)
 		{
 			/*
 			 * pgpool cannot accept groups. commented lines below are the
@@ -900,7 +1021,7 @@ static bool check_db(char *dbname, char *user, char *param_str)
 /* 			if (check_group(dbname, user)) */
 /* 				return true; */
 		}
-		else if (strcmp(tok, dbname) == 0)
+		else if (name->hash == db_hash && strcmp(name->name, dbname) == 0)
 			return true;
 	}
 
@@ -908,6 +1029,80 @@ static bool check_db(char *dbname, char *user, char *param_str)
 }
 
 
+/*
+ * Compute hash value of a database or user name using FNV-1a.
+ */
+static unsigned int hba_hash(const char *name)
+{
+	const unsigned char *p;
+	unsigned int h = 2166136261U;
+
+	for (p = (const unsigned char *)name; *p; p++)
+	{
+		h ^= *p;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+
+/*
+ * Compile all lines built by tokenize_file() into hba_rules.
+ */
+static void compile_hba_lines(List *lines, List *line_nums)
+{
+	ListCell *line;
+	ListCell *line_num;
+	int i = 0;
+
+	num_hba_rules = list_length(lines);
+	if (num_hba_rules == 0)
+		return;
+
+	hba_rules = malloc(sizeof(HbaRule) * num_hba_rules);
+	if (hba_rules == NULL)
+	{
+		pool_error("compile_hba_lines: malloc failed: %s", strerror(errno));
+		exit(1);
+	}
+
+	forboth(line, lines, line_num, line_nums)
+	{
+		compile_hba_line(lfirst(line), lfirst_int(line_num), &hba_rules[i++]);
+	}
+}
+
+
+/*
+ * free memory used by a compiled rule
+ */
+static void free_hba_rule(HbaRule *rule)
+{
+	free(rule->db.names);
+	free(rule->user.names);
+	free(rule->auth_arg);
+	rule->db.names = NULL;
+	rule->user.names = NULL;
+	rule->auth_arg = NULL;
+}
+
+
+/*
+ * free memory used by hba_rules
+ */
+static void free_hba_rules(void)
+{
+	int i;
+
+	for (i = 0; i < num_hba_rules; i++)
+		free_hba_rule(&hba_rules[i]);
+
+	free(hba_rules);
+	hba_rules = NULL;
+	num_hba_rules = 0;
+}
+
+
 /*
  * tokenize the given file, storing the resulting data into two lists:
  * a list of sublists, each sublist containing the tokens in a line of
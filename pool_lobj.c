@@ -33,6 +33,33 @@
 #include "pool_relcache.h"
 #include "pool_config.h"
 
+static bool take_lobj_id(char *dbname, int *lobjid);
+static int put_lobj_block(char *dbname, int lobjid);
+
+static POOL_LOBJ_BLOCK *lobj_blocks;	/* on shared memory */
+
+/*
+ * Allocate large object id block area on shared memory. Called by
+ * pgpool main before forking children. Returns 0 on success.
+ */
+int pool_init_lobj_blocks(void)
+{
+	size_t size;
+
+	if (pool_config->lobj_prealloc_size <= 0)
+		return 0;
+
+	size = sizeof(POOL_LOBJ_BLOCK) * MAX_LOBJ_BLOCKS;
+	lobj_blocks = pool_shared_memory_create(size);
+	if (lobj_blocks == NULL)
+	{
+		pool_error("pool_init_lobj_blocks: failed to allocate large object id blocks");
+		return -1;
+	}
+	memset(lobj_blocks, 0, size);
+	return 0;
+}
+
 /*
  * Rewrite lo_creat call to lo_create call if:
  * 1) it's a lo_creat function call
@@ -78,6 +105,7 @@ char *pool_rewrite_lo_creat(char kind, char *packet, int packet_len,
 	int32 int32val;
 	int16 int16val;
 	int16 result_format_code;
+	char *dbname;
 
 	if (kind != 'F')
 		return NULL;	/* not function call */
@@ -158,6 +186,15 @@ char *pool_rewrite_lo_creat(char kind, char *packet, int packet_len,
 	/*
 	 * Ok, do it...
 	 */
+	dbname = MASTER_CONNECTION(backend)->sp->database;
+
+	/* preallocated id available? */
+	if (lobj_blocks && take_lobj_id(dbname, &lobjid))
+	{
+		pool_debug("pool_rewrite_lo_creat: preallocated lobjid:%d", lobjid);
+		goto rewrite;
+	}
+
 	/* issue lock table command to lob_lock_table */
 	snprintf(qbuf, sizeof(qbuf), "LOCK TABLE %s IN SHARE ROW EXCLUSIVE MODE", pool_config->lobj_lock_table);
 	per_node_statement_log(backend, MASTER_NODE_ID, qbuf);
@@ -178,6 +215,13 @@ char *pool_rewrite_lo_creat(char kind, char *packet, int packet_len,
 		return NULL;
 	}
 
+	/* the block may have been refilled while we were waiting for the lock */
+	if (lobj_blocks && take_lobj_id(dbname, &lobjid))
+	{
+		pool_debug("pool_rewrite_lo_creat: preallocated lobjid:%d", lobjid);
+		goto rewrite;
+	}
+
 	/* get max lobj id */
 	per_node_statement_log(backend, MASTER_NODE_ID, GET_MAX_LOBJ_KEY);
 	status = do_query(MASTER(backend), GET_MAX_LOBJ_KEY, &result, MAJOR(backend));
@@ -204,6 +248,11 @@ char *pool_rewrite_lo_creat(char kind, char *packet, int packet_len,
 		return NULL;
 	}
 
+	/* reserve following ids while we are holding the lock */
+	if (lobj_blocks)
+		lobjid = put_lobj_block(dbname, lobjid);
+
+rewrite:
 	/*
 	 * Create lo_create call packet
 	 */
@@ -240,3 +289,89 @@ char *pool_rewrite_lo_creat(char kind, char *packet, int packet_len,
 
 	return rewritten_packet;
 }
+
+/*
+ * Take a large object id from the block of the database. Returns
+ * false if the block is exhausted.
+ */
+static bool take_lobj_id(char *dbname, int *lobjid)
+{
+	bool found = false;
+	int i;
+
+	pool_semaphore_lock(LOBJ_BLOCK_SEM);
+
+	for (i = 0; i < MAX_LOBJ_BLOCKS && lobj_blocks[i].dbname[0]; i++)
+	{
+		if (!strcmp(lobj_blocks[i].dbname, dbname))
+		{
+			if (lobj_blocks[i].next <= lobj_blocks[i].last)
+			{
+				*lobjid = lobj_blocks[i].next++;
+				found = true;
+			}
+			break;
+		}
+	}
+
+	pool_semaphore_unlock(LOBJ_BLOCK_SEM);
+
+	return found;
+}
+
+/*
+ * Reserve a new block starting from lobjid, which is max(loid)+1
+ * obtained while holding lobj_lock_table. Ids already handed out may
+ * not be committed yet and invisible to max(loid), so the new block
+ * starts after the previous one if needed. Returns the first id of
+ * the new block, which is given to the caller.
+ *
+ * If another session has refilled the block while we were waiting
+ * for the lock, an id is taken from it instead, so that the block is
+ * not thrown away.
+ *
+ * The slot is never reused for other databases since it remembers
+ * the ids handed out. If there's no room, lobjid is returned as is
+ * and the caller works like without preallocation.
+ */
+static int put_lobj_block(char *dbname, int lobjid)
+{
+	int i;
+
+	pool_semaphore_lock(LOBJ_BLOCK_SEM);
+
+	for (i = 0; i < MAX_LOBJ_BLOCKS; i++)
+	{
+		if (lobj_blocks[i].dbname[0] == '\0')
+		{
+			strlcpy(lobj_blocks[i].dbname, dbname, sizeof(lobj_blocks[i].dbname));
+			lobj_blocks[i].next = 1;
+			lobj_blocks[i].last = 0;
+		}
+
+		if (!strcmp(lobj_blocks[i].dbname, dbname))
+		{
+			if (lobj_blocks[i].next <= lobj_blocks[i].last)
+			{
+				lobjid = lobj_blocks[i].next++;
+				pool_debug("put_lobj_block: block of %s already refilled", dbname);
+				break;
+			}
+
+			if (lobjid <= lobj_blocks[i].last)
+				lobjid = lobj_blocks[i].last + 1;
+
+			lobj_blocks[i].next = lobjid + 1;
+			lobj_blocks[i].last = lobjid + pool_config->lobj_prealloc_size - 1;
+			pool_debug("put_lobj_block: reserved %d to %d for %s", lobjid, lobj_blocks[i].last, dbname);
+			break;
+		}
+	}
+
+	pool_semaphore_unlock(LOBJ_BLOCK_SEM);
+
+	if (i == MAX_LOBJ_BLOCKS)
+		pool_log("put_lobj_block: no room for large object id block of %s", dbname);
+
+	return lobjid;
+}
@@ -27,6 +27,21 @@
 #define POOL_LOBJ_H
 #include "pool.h"
 
+/* max number of databases whose large object id blocks are kept */
+#define MAX_LOBJ_BLOCKS 64
+
+/*
+ * A block of large object ids reserved for lo_creat. Ids from next to
+ * last are not handed out yet. Placed on shared memory and protected
+ * by LOBJ_BLOCK_SEM.
+ */
+typedef struct {
+	char dbname[SM_DATABASE];	/* database name */
+	int next;		/* next id to be assigned */
+	int last;		/* last id of the block */
+} POOL_LOBJ_BLOCK;
+
+extern int pool_init_lobj_blocks(void);
 extern char *pool_rewrite_lo_creat(char kind, char *packet, int packet_len, POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend, int* len);
 
 #endif /* POOL_LOBJ_H */
@@ -0,0 +1,221 @@
+/* -*-pgsql-c-*- */
+/*
+ * $Header$
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2011	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_logger.c: logger process. Children append formatted log
+ * messages to their own ring buffer on shared memory and the logger
+ * process writes them out to stderr.
+ */
+#include "config.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <stddef.h>
+
+#include "pool.h"
+#include "pool_config.h"
+
+/* sleep time in micro seconds when there's nothing to write */
+#define LOGGER_NAPTIME 10000
+
+static unsigned int drain_log_ring(POOL_LOG_RING *ring);
+static void write_all(int fd, char *buf, unsigned int len);
+static RETSIGTYPE logger_exit_handler(int sig);
+
+static char *log_rings;		/* on shared memory */
+static size_t log_ring_stride;	/* size of a ring including header */
+static volatile sig_atomic_t logger_exit_request = 0;
+
+/*
+ * Allocate log ring buffers on shared memory, one for each child.
+ * Called by pgpool main before forking children. log_buffer_size is
+ * rounded up to a power of 2. Returns 0 on success.
+ */
+int pool_init_log_rings(void)
+{
+	unsigned int size;
+	int i;
+
+	if (pool_config->log_buffer_size <= 0)
+		return 0;
+
+	for (size = 1024; size < pool_config->log_buffer_size; size <<= 1)
+		;
+
+	log_ring_stride = offsetof(POOL_LOG_RING, data) + size;
+	log_ring_stride = (log_ring_stride + sizeof(long) - 1) & ~(sizeof(long) - 1);
+
+	log_rings = pool_shared_memory_create(log_ring_stride * pool_config->num_init_children);
+	if (log_rings == NULL)
+	{
+		pool_error("pool_init_log_rings: failed to allocate log ring buffers");
+		return -1;
+	}
+
+	for (i=0;i<pool_config->num_init_children;i++)
+	{
+		POOL_LOG_RING *ring = pool_get_log_ring(i);
+
+		ring->head = ring->tail = ring->dropped = 0;
+		ring->size = size;
+	}
+	return 0;
+}
+
+/*
+ * Return the log ring buffer of the child. NULL if log buffering is
+ * disabled.
+ */
+POOL_LOG_RING *pool_get_log_ring(int proc_id)
+{
+	if (log_rings == NULL || proc_id < 0 || proc_id >= pool_config->num_init_children)
+		return NULL;
+
+	return (POOL_LOG_RING *)(log_rings + log_ring_stride * proc_id);
+}
+
+/*
+ * logger child main loop
+ */
+void do_logger_child(void)
+{
+	unsigned int *reported;
+	unsigned int written;
+	int i;
+
+	pool_debug("I am %d", getpid());
+
+	/* Identify myself via ps */
+	init_ps_display("", "", "", "");
+	set_ps_display("logger process", false);
+
+	/* set up signal handlers */
+	signal(SIGALRM, SIG_DFL);
+	signal(SIGTERM, logger_exit_handler);
+	signal(SIGINT, logger_exit_handler);
+	signal(SIGQUIT, logger_exit_handler);
+	signal(SIGHUP, SIG_IGN);
+	signal(SIGCHLD, SIG_IGN);
+	signal(SIGUSR1, SIG_IGN);
+	signal(SIGUSR2, SIG_IGN);
+	signal(SIGPIPE, SIG_IGN);
+
+	reported = calloc(pool_config->num_init_children, sizeof(unsigned int));
+	if (reported == NULL)
+	{
+		pool_error("do_logger_child: calloc failed");
+		exit(1);
+	}
+
+	for (i=0;i<pool_config->num_init_children;i++)
+		reported[i] = pool_get_log_ring(i)->dropped;
+
+	for (;;)
+	{
+		written = 0;
+
+		for (i=0;i<pool_config->num_init_children;i++)
+		{
+			POOL_LOG_RING *ring = pool_get_log_ring(i);
+			unsigned int dropped;
+
+			written += drain_log_ring(ring);
+
+			dropped = ring->dropped;
+			if (dropped != reported[i])
+			{
+				pool_log("do_logger_child: %u log messages of child %d were dropped because log buffer was full",
+						 dropped - reported[i], process_info[i].pid);
+				reported[i] = dropped;
+			}
+		}
+
+		/*
+		 * Children are killed at the same time as us. Keep on
+		 * draining until there's nothing left.
+		 */
+		if (written == 0)
+		{
+			if (logger_exit_request)
+				exit(0);
+			usleep(LOGGER_NAPTIME);
+		}
+	}
+}
+
+/*
+ * Write out all messages in the ring buffer. Returns the number of
+ * bytes written.
+ */
+static unsigned int drain_log_ring(POOL_LOG_RING *ring)
+{
+	unsigned int head, tail, len, offset, first;
+
+	head = ring->head;
+	/* make sure that we read data after head is read */
+	POOL_MEMORY_BARRIER();
+	tail = ring->tail;
+
+	len = head - tail;
+	if (len == 0)
+		return 0;
+
+	offset = tail & (ring->size - 1);
+	first = ring->size - offset;
+	if (first > len)
+		first = len;
+
+	write_all(fileno(stderr), ring->data + offset, first);
+	if (len > first)
+		write_all(fileno(stderr), ring->data, len - first);
+
+	/* make sure that the data is read before the space is released */
+	POOL_MEMORY_BARRIER();
+	ring->tail = head;
+
+	return len;
+}
+
+static void write_all(int fd, char *buf, unsigned int len)
+{
+	ssize_t n;
+
+	while (len > 0)
+	{
+		n = write(fd, buf, len);
+		if (n < 0)
+		{
+			if (errno == EINTR)
+				continue;
+			/* nowhere to report the error. discard messages */
+			return;
+		}
+		buf += n;
+		len -= n;
+	}
+}
+
+static RETSIGTYPE logger_exit_handler(int sig)
+{
+	logger_exit_request = 1;
+}
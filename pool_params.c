@@ -25,12 +25,18 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <netinet/in.h>
 
 #include "pool.h"
 #include "parser/parser.h"
 
 #define MAX_PARAM_ITEMS 128
 
+/* size of hash table on names. must be power of 2 */
+#define PARAM_HASH_SIZE 256
+
+static unsigned int hash_name(char *name);
+
 /*
  * initialize parameter structure
  */
@@ -49,6 +55,14 @@ int pool_init_params(ParamStatus *params)
 		pool_error("pool_init_params: cannot allocate memory");
 		return -1;
 	}
+	params->hash = calloc(PARAM_HASH_SIZE, sizeof(short));
+	if (params->hash == NULL)
+	{
+		pool_error("pool_init_params: cannot allocate memory");
+		return -1;
+	}
+	params->messages = NULL;
+	params->messages_len = 0;
 	return 0;
 }
 
@@ -66,6 +80,8 @@ void pool_discard_params(ParamStatus *params)
     }
     free(params->names);
     free(params->values);
+	free(params->hash);
+	free(params->messages);
 }
 
 /*
@@ -75,16 +91,18 @@ void pool_discard_params(ParamStatus *params)
  */
 char *pool_find_name(ParamStatus *params, char *name, int *pos)
 {
-    int i;
+	unsigned int h;
+	int i;
 
-    for (i=0;i<params->num;i++)
-    {
+	for (h = hash_name(name);params->hash[h];h = (h + 1) & (PARAM_HASH_SIZE - 1))
+	{
+		i = params->hash[h] - 1;
 		if (!strcmp(name, params->names[i]))
 		{
 			*pos = i;
 			return params->values[i];
 		}
-    }
+	}
     return NULL;
 }
 
@@ -108,6 +126,7 @@ int pool_get_param(ParamStatus *params, int index, char **name, char **value)
 int pool_add_param(ParamStatus *params, char *name, char *value)
 {
     int pos;
+	unsigned int h;
 
     if (pool_find_name(params, name, &pos))
     {
@@ -147,11 +166,70 @@ int pool_add_param(ParamStatus *params, char *name, char *value)
 			return -1;
 		}
 		params->num++;
+
+		h = hash_name(name);
+		while (params->hash[h])
+			h = (h + 1) & (PARAM_HASH_SIZE - 1);
+		params->hash[h] = params->num;
     }
+
+	/* ParameterStatus messages need to be rebuilt */
+	free(params->messages);
+	params->messages = NULL;
+	params->messages_len = 0;
+
 	parser_set_param(name, value);
 	return 0;
 }
 
+/*
+ * Return ParameterStatus messages (V3) for all name/value pairs in a
+ * contiguous buffer, so that they can be sent to frontend at once.
+ * The buffer is built on first call and kept until a pair is added
+ * or replaced. Returns NULL on error.
+ */
+char *pool_get_param_messages(ParamStatus *params, int *len)
+{
+	char *p;
+	int total;
+	int msglen;
+	int sendlen;
+	int i;
+
+	if (params->messages == NULL)
+	{
+		total = 0;
+		for (i=0;i<params->num;i++)
+			total += 1 + sizeof(sendlen) + strlen(params->names[i]) + 1 + strlen(params->values[i]) + 1;
+
+		/* allocate at least 1 byte so that we can tell the buffer is built */
+		params->messages = malloc(total + 1);
+		if (params->messages == NULL)
+		{
+			pool_error("pool_get_param_messages: cannot allocate memory");
+			return NULL;
+		}
+
+		p = params->messages;
+		for (i=0;i<params->num;i++)
+		{
+			*p++ = 'S';
+			msglen = sizeof(sendlen) + strlen(params->names[i]) + 1 + strlen(params->values[i]) + 1;
+			sendlen = htonl(msglen);
+			memcpy(p, &sendlen, sizeof(sendlen));
+			p += sizeof(sendlen);
+			strcpy(p, params->names[i]);
+			p += strlen(params->names[i]) + 1;
+			strcpy(p, params->values[i]);
+			p += strlen(params->values[i]) + 1;
+		}
+		params->messages_len = total;
+	}
+
+	*len = params->messages_len;
+	return params->messages;
+}
+
 void pool_param_debug_print(ParamStatus *params)
 {
 	int i;
@@ -161,3 +239,16 @@ void pool_param_debug_print(ParamStatus *params)
 		pool_debug("No.%d: name: %s value: %s", i, params->names[i], params->values[i]);
 	}
 }
+
+/*
+ * Hash function for parameter names
+ */
+static unsigned int hash_name(char *name)
+{
+	unsigned int h = 0;
+
+	while (*name)
+		h = h * 31 + (unsigned char)*name++;
+
+	return h & (PARAM_HASH_SIZE - 1);
+}
@@ -24,11 +24,42 @@
 
 #include <string.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "pool.h"
 #include "pool_passwd.h"
 
+/* max length of a line in pool_passwd */
+#define POOL_PASSWD_LINE_LEN 1024
+
+/*
+ * An entry of pool_passwd loaded on memory.
+ */
+typedef struct {
+	char *username;		/* user name */
+	char passwd[POOL_PASSWD_LEN+1];	/* md5 password */
+	int next;			/* next entry in the same hash bucket. -1 if none */
+} POOL_PASSWD_ENTRY;
+
+static unsigned int passwd_hash(const char *username);
+static int load_pool_passwd(struct stat *st);
+static void free_pool_passwd_entries(void);
+
 static FILE *passwd_fd = NULL;	/* File descriptor for pool_passwd */
+static char *passwd_filename;	/* path to pool_passwd */
+
+/*
+ * pool_passwd entries and their hash index. Loaded by pgpool main so
+ * that children share them until the file is modified.
+ */
+static POOL_PASSWD_ENTRY *passwd_entries;
+static int num_passwd_entries;
+static int *passwd_bucket;
+static int passwd_bucket_size;
+static struct stat passwd_stat;	/* stat of pool_passwd when loaded */
+static bool passwd_loaded = false;	/* true if passwd_stat is valid */
 
 /*
  * Initialize this module.
@@ -40,6 +71,13 @@ void pool_init_pool_passwd(char *pool_passwd_filename)
 	if (passwd_fd)
 		return;
 
+	passwd_filename = strdup(pool_passwd_filename);
+	if (passwd_filename == NULL)
+	{
+		pool_error("pool_init_pool_passwd: strdup failed");
+		return;
+	}
+
 	passwd_fd = fopen(pool_passwd_filename, "r+");
 	if (!passwd_fd)
 	{
@@ -53,7 +91,45 @@ void pool_init_pool_passwd(char *pool_passwd_filename)
 
 		pool_error("pool_init_pool_passwd: couldn't open %s. reason: %s",
 				   pool_passwd_filename, strerror(errno));
+		return;
 	}
+
+	pool_reload_pool_passwd();
+}
+
+/*
+ * Load pool_passwd into memory if it has been modified since last
+ * loaded.
+ */
+void pool_reload_pool_passwd(void)
+{
+	struct stat st;
+
+	if (passwd_filename == NULL)
+		return;
+
+	if (stat(passwd_filename, &st) < 0)
+	{
+		pool_error("pool_reload_pool_passwd: couldn't stat %s. reason: %s",
+				   passwd_filename, strerror(errno));
+		return;
+	}
+
+	/*
+	 * st_mtime has one second resolution, which misses a change of
+	 * the same size made within the second the file was loaded. Look
+	 * at the nanoseconds as well where available.
+	 */
+	if (passwd_loaded &&
+		st.st_mtime == passwd_stat.st_mtime &&
+#ifdef HAVE_STRUCT_STAT_ST_MTIM_TV_NSEC
+		st.st_mtim.tv_nsec == passwd_stat.st_mtim.tv_nsec &&
+#endif
+		st.st_size == passwd_stat.st_size &&
+		st.st_ino == passwd_stat.st_ino)
+		return;
+
+	load_pool_passwd(&st);
 }
 
 /*
@@ -146,11 +222,8 @@ int pool_create_passwdent(char *username, char *passwd)
  */
 char *pool_get_passwd(char *username)
 {
-	int c;
-	char name[33];
 	static char passwd[POOL_PASSWD_LEN+1];
-	char *p;
-	int readlen;
+	int i;
 
 	if (!passwd_fd)
 	{
@@ -158,49 +231,20 @@ char *pool_get_passwd(char *username)
 		return NULL;
 	}
 
-	rewind(passwd_fd);
-	name[0] = '\0';
+	/* pick up modifications to pool_passwd */
+	pool_reload_pool_passwd();
 
-	while (!feof(passwd_fd))
-	{
-		p = name;
-		readlen = 0;
-
-		while (readlen < (sizeof(name)-1))
-		{
-			c = fgetc(passwd_fd);
-			if (c == EOF)
-				break;
-			else if (c == ':')
-				break;
-
-			readlen++;
-			*p++ = c;
-		}
-		*p = '\0';
+	if (passwd_bucket == NULL)
+		return NULL;
 
-		if (!strcmp(username, name))
+	for (i = passwd_bucket[passwd_hash(username) & (passwd_bucket_size - 1)];
+		 i >= 0; i = passwd_entries[i].next)
+	{
+		if (!strcmp(username, passwd_entries[i].username))
 		{
-			/* User name found. Return password. */
-			p = passwd;
-			readlen = 0;
-
-			while((c = fgetc(passwd_fd)) != EOF &&
-				  c != '\n' && readlen < (sizeof(passwd)-1))
-			{
-				*p++ = c;
-				readlen++;
-			}
-			*p = '\0';
+			strcpy(passwd, passwd_entries[i].passwd);
 			return passwd;
 		}
-		else
-		{
-			/* Skip password */
-			while((c = fgetc(passwd_fd)) != EOF &&
-				  c != '\n')
-				;
-		}
 	}
 	return NULL;
 }
@@ -223,4 +267,151 @@ void pool_finish_pool_passwd(void)
 		fclose(passwd_fd);
 		passwd_fd = NULL;
 	}
+	free_pool_passwd_entries();
+	free(passwd_filename);
+	passwd_filename = NULL;
+}
+
+/*
+ * Compute hash value of user name using FNV-1a.
+ */
+static unsigned int passwd_hash(const char *username)
+{
+	const unsigned char *p;
+	unsigned int h = 2166136261U;
+
+	for (p = (const unsigned char *)username; *p; p++)
+	{
+		h ^= *p;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/*
+ * Read all entries of pool_passwd and build hash index. "st" is the
+ * stat of the file to be remembered. If the same user name appears
+ * more than once, the first one wins as before. On error the entries
+ * loaded previously are kept. Returns 0 on success, -1 on error.
+ */
+static int load_pool_passwd(struct stat *st)
+{
+	FILE *fd;
+	char line[POOL_PASSWD_LINE_LEN];
+	POOL_PASSWD_ENTRY *entries = NULL;
+	int *bucket = NULL;
+	int num = 0;
+	int alloc = 0;
+	int size;
+	int i;
+
+	fd = fopen(passwd_filename, "r");
+	if (fd == NULL)
+	{
+		pool_error("load_pool_passwd: couldn't open %s. reason: %s",
+				   passwd_filename, strerror(errno));
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fd))
+	{
+		char *p;
+		int len;
+
+		len = strlen(line);
+		if (len > 0 && line[len-1] == '\n')
+			line[--len] = '\0';
+
+		p = strchr(line, ':');
+		if (p == NULL)
+			continue;
+		*p++ = '\0';
+
+		if (num >= alloc)
+		{
+			POOL_PASSWD_ENTRY *e;
+
+			alloc = alloc ? alloc * 2 : 128;
+			e = realloc(entries, sizeof(POOL_PASSWD_ENTRY) * alloc);
+			if (e == NULL)
+			{
+				pool_error("load_pool_passwd: realloc failed");
+				goto error;
+			}
+			entries = e;
+		}
+
+		entries[num].username = strdup(line);
+		if (entries[num].username == NULL)
+		{
+			pool_error("load_pool_passwd: strdup failed");
+			goto error;
+		}
+		strncpy(entries[num].passwd, p, POOL_PASSWD_LEN);
+		entries[num].passwd[POOL_PASSWD_LEN] = '\0';
+		num++;
+	}
+	fclose(fd);
+	fd = NULL;
+
+	/* keep load factor under 0.5 */
+	for (size = 16; size < num * 2; size <<= 1)
+		;
+
+	bucket = malloc(sizeof(int) * size);
+	if (bucket == NULL)
+	{
+		pool_error("load_pool_passwd: malloc failed");
+		goto error;
+	}
+
+	for (i = 0; i < size; i++)
+		bucket[i] = -1;
+
+	/* insert in reverse order so that the first entry wins on duplicates */
+	for (i = num - 1; i >= 0; i--)
+	{
+		unsigned int h = passwd_hash(entries[i].username) & (size - 1);
+
+		entries[i].next = bucket[h];
+		bucket[h] = i;
+	}
+
+	free_pool_passwd_entries();
+	passwd_entries = entries;
+	num_passwd_entries = num;
+	passwd_bucket = bucket;
+	passwd_bucket_size = size;
+	passwd_stat = *st;
+	passwd_loaded = true;
+
+	pool_debug("load_pool_passwd: loaded %d entries from %s", num, passwd_filename);
+	return 0;
+
+error:
+	if (fd)
+		fclose(fd);
+	for (i = 0; i < num; i++)
+		free(entries[i].username);
+	free(entries);
+	free(bucket);
+	return -1;
+}
+
+/*
+ * Discard pool_passwd entries loaded on memory.
+ */
+static void free_pool_passwd_entries(void)
+{
+	int i;
+
+	for (i = 0; i < num_passwd_entries; i++)
+		free(passwd_entries[i].username);
+	free(passwd_entries);
+	free(passwd_bucket);
+	passwd_entries = NULL;
+	num_passwd_entries = 0;
+	passwd_bucket = NULL;
+	passwd_bucket_size = 0;
+	passwd_loaded = false;
 }
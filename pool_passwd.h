@@ -34,6 +34,7 @@
 extern void pool_init_pool_passwd(char *pool_passwd_filename);
 extern int pool_create_passwdent(char *username, char *passwd);
 extern char *pool_get_passwd(char *username);
+extern void pool_reload_pool_passwd(void);
 extern void pool_delete_passwdent(char *username);
 extern void pool_finish_pool_passwd(void);
 
@@ -0,0 +1,355 @@
+/* -*-pgsql-c-*- */
+/*
+ * $Header$
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2011	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_prewarm.c: Prewarm connection pools. Children remember the
+ * startup packets of recent sessions on shared memory. While waiting
+ * for a new frontend, each child connects to backends and
+ * authenticates using the most recently used startup packets, so
+ * that the frontend finds an authenticated connection in the pool.
+ */
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "pool.h"
+#include "pool_config.h"
+#include "pool_passwd.h"
+
+/* max number of startup packets remembered */
+#define MAX_PREWARM_TEMPLATES 64
+
+/* max length of a startup packet remembered */
+#define MAX_PREWARM_PACKET_LENGTH 1024
+
+/*
+ * Startup packet of a recent session. len == 0 means the entry is
+ * not used. Placed on shared memory and protected by PREWARM_SEM.
+ */
+typedef struct {
+	int len;			/* startup packet length */
+	time_t last_used;	/* last time the startup packet was used */
+	char data[MAX_PREWARM_PACKET_LENGTH];	/* raw startup packet without packet length */
+} POOL_PREWARM_TEMPLATE;
+
+static int get_recent_templates(POOL_PREWARM_TEMPLATE *result, int max);
+static int prewarm_one(POOL_PREWARM_TEMPLATE *template);
+static StartupPacket *make_startup_packet(char *data, int len);
+
+static POOL_PREWARM_TEMPLATE *templates;	/* on shared memory */
+
+/*
+ * Allocate startup packet table on shared memory. Called by pgpool
+ * main before forking children. Returns 0 on success.
+ */
+int pool_init_prewarm(void)
+{
+	size_t size;
+
+	if (pool_config->prewarm_connections <= 0)
+		return 0;
+
+	size = sizeof(POOL_PREWARM_TEMPLATE) * MAX_PREWARM_TEMPLATES;
+	templates = pool_shared_memory_create(size);
+	if (templates == NULL)
+	{
+		pool_error("pool_init_prewarm: failed to allocate startup packet table");
+		return -1;
+	}
+	memset(templates, 0, size);
+	return 0;
+}
+
+/*
+ * Remember the startup packet of a session which has been connected
+ * to backends. Only startup packets whose connection can be cached
+ * and authenticated without frontend are remembered.
+ */
+void pool_prewarm_register(POOL_CONNECTION_POOL *backend)
+{
+	StartupPacket *sp;
+	POOL_PREWARM_TEMPLATE *t;
+	POOL_PREWARM_TEMPLATE *victim = NULL;
+	int authkind;
+	int i;
+
+	if (templates == NULL)
+		return;
+
+	sp = MASTER_CONNECTION(backend)->sp;
+
+	if (sp->major != PROTO_MAJOR_V3 ||
+		sp->len > MAX_PREWARM_PACKET_LENGTH ||
+		pool_config->connection_cache == 0 ||
+		!strcmp(sp->database, "template0") ||
+		!strcmp(sp->database, "template1") ||
+		!strcmp(sp->database, "postgres") ||
+		!strcmp(sp->database, "regression"))
+		return;
+
+	authkind = MASTER(backend)->auth_kind;
+	if (authkind != 0 && !(authkind == 5 && pool_get_passwd(sp->user) != NULL))
+		return;
+
+	pool_semaphore_lock(PREWARM_SEM);
+
+	for (i=0;i<MAX_PREWARM_TEMPLATES;i++)
+	{
+		t = &templates[i];
+
+		if (t->len == sp->len && memcmp(t->data, sp->startup_packet, sp->len) == 0)
+		{
+			t->last_used = time(NULL);
+			pool_semaphore_unlock(PREWARM_SEM);
+			return;
+		}
+
+		/* look for an empty or the least recently used entry */
+		if (victim == NULL ||
+			(victim->len > 0 && (t->len == 0 || t->last_used < victim->last_used)))
+			victim = t;
+	}
+
+	memcpy(victim->data, sp->startup_packet, sp->len);
+	victim->len = sp->len;
+	victim->last_used = time(NULL);
+
+	pool_semaphore_unlock(PREWARM_SEM);
+}
+
+/*
+ * Called by an idle child before accepting a new frontend. Create
+ * connections for the prewarm_connections most recently used startup
+ * packets which do not have a connection yet. Existing connections
+ * are never discarded to make room.
+ */
+void pool_prewarm_connections(void)
+{
+	static POOL_PREWARM_TEMPLATE recent[MAX_PREWARM_TEMPLATES];
+	int n;
+	int i;
+
+	if (templates == NULL)
+		return;
+
+	n = get_recent_templates(recent, pool_config->prewarm_connections);
+
+	for (i=0;i<n;i++)
+	{
+		if (prewarm_one(&recent[i]) < 0)
+			break;
+	}
+}
+
+/*
+ * Copy at most max startup packets into result, most recently used
+ * first. Returns the number of startup packets copied.
+ */
+static int get_recent_templates(POOL_PREWARM_TEMPLATE *result, int max)
+{
+	POOL_PREWARM_TEMPLATE tmp;
+	int n = 0;
+	int i, j;
+
+	pool_semaphore_lock(PREWARM_SEM);
+	for (i=0;i<MAX_PREWARM_TEMPLATES;i++)
+	{
+		if (templates[i].len > 0)
+			result[n++] = templates[i];
+	}
+	pool_semaphore_unlock(PREWARM_SEM);
+
+	if (max > n)
+		max = n;
+
+	/* partial selection sort. max is small */
+	for (i=0;i<max;i++)
+	{
+		for (j=i+1;j<n;j++)
+		{
+			if (result[j].last_used > result[i].last_used)
+			{
+				tmp = result[i];
+				result[i] = result[j];
+				result[j] = tmp;
+			}
+		}
+	}
+	return max;
+}
+
+/*
+ * Create an authenticated connection using the startup packet if
+ * there's no connection for it yet. Returns -1 if there's no empty
+ * connection slot, otherwise 0.
+ */
+static int prewarm_one(POOL_PREWARM_TEMPLATE *template)
+{
+	POOL_CONNECTION_POOL *backend;
+	StartupPacket *sp;
+	int i;
+
+	sp = make_startup_packet(template->data, template->len);
+	if (sp == NULL)
+		return 0;
+
+	if (pool_cp_exists(sp->user, sp->database, sp->major))
+	{
+		pool_free_startup_packet(sp);
+		return 0;
+	}
+
+	if (!pool_cp_has_free_slot())
+	{
+		pool_free_startup_packet(sp);
+		return -1;
+	}
+
+	backend = pool_create_cp();
+	if (backend == NULL)
+	{
+		pool_free_startup_packet(sp);
+		return -1;
+	}
+
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		if (VALID_BACKEND(i))
+		{
+			/* set DB node id */
+			CONNECTION(backend, i)->db_node_id = i;
+
+			/* mark this is a backend connection */
+			CONNECTION(backend, i)->isbackend = 1;
+			pool_ssl_negotiate_clientserver(CONNECTION(backend, i));
+
+			/*
+			 * save startup packet info
+			 */
+			CONNECTION_SLOT(backend, i)->sp = sp;
+
+			/* send startup packet */
+			if (send_startup_packet(CONNECTION_SLOT(backend, i)) < 0)
+			{
+				pool_error("pool_prewarm_connections: fails to send startup packet to the %d th backend", i);
+				pool_discard_cp(sp->user, sp->database, sp->major);
+				return 0;
+			}
+		}
+	}
+
+	if (pool_do_prewarm_auth(backend))
+	{
+		pool_debug("pool_prewarm_connections: could not authenticate user %s database %s",
+				   sp->user, sp->database);
+		pool_discard_cp(sp->user, sp->database, sp->major);
+		return 0;
+	}
+
+	/* the connection has not been used by any frontend yet */
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		if (VALID_BACKEND(i))
+			backend->info[i].counter = 0;
+	}
+
+	pool_connection_pool_timer(backend);
+
+	pool_debug("pool_prewarm_connections: prewarmed connection for user %s database %s",
+			   sp->user, sp->database);
+	return 0;
+}
+
+/*
+ * Build a V3 startup packet info from the raw startup packet in the
+ * same way as read_startup_packet() does.
+ */
+static StartupPacket *make_startup_packet(char *data, int len)
+{
+	StartupPacket *sp;
+	int protov;
+	char *p;
+
+	sp = (StartupPacket *)calloc(sizeof(*sp), 1);
+	if (!sp)
+	{
+		pool_error("make_startup_packet: out of memory");
+		return NULL;
+	}
+
+	sp->startup_packet = malloc(len);
+	if (!sp->startup_packet)
+	{
+		pool_error("make_startup_packet: out of memory");
+		pool_free_startup_packet(sp);
+		return NULL;
+	}
+	memcpy(sp->startup_packet, data, len);
+
+	sp->len = len;
+	memcpy(&protov, sp->startup_packet, sizeof(protov));
+	sp->major = ntohl(protov)>>16;
+	sp->minor = ntohl(protov) & 0x0000ffff;
+
+	p = sp->startup_packet + sizeof(int);	/* skip protocol version info */
+
+	while(p < sp->startup_packet + len && *p)
+	{
+		if (!strcmp("user", p))
+		{
+			p += (strlen(p) + 1);
+			sp->user = strdup(p);
+			if (!sp->user)
+			{
+				pool_error("make_startup_packet: out of memory");
+				pool_free_startup_packet(sp);
+				return NULL;
+			}
+		}
+		else if (!strcmp("database", p))
+		{
+			p += (strlen(p) + 1);
+			sp->database = strdup(p);
+			if (!sp->database)
+			{
+				pool_error("make_startup_packet: out of memory");
+				pool_free_startup_packet(sp);
+				return NULL;
+			}
+		}
+		else if (!strcmp("application_name", p))
+		{
+			p += (strlen(p) + 1);
+			sp->application_name = p;
+		}
+
+		p += (strlen(p) + 1);
+	}
+
+	if (sp->user == NULL || sp->database == NULL)
+	{
+		pool_free_startup_packet(sp);
+		return NULL;
+	}
+	return sp;
+}
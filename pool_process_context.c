@@ -21,13 +21,32 @@
  *
  */
 
+#include <signal.h>
+#include <string.h>
+
 #include "pool.h"
+#include "pool_signal.h"
 #include "pool_process_context.h"
 #include "pool_config.h"		/* remove me afterwards */
 
 static POOL_PROCESS_CONTEXT process_context_d;
 static POOL_PROCESS_CONTEXT *process_context;
 
+/*
+ * Hash index from cancel key (pid and key) to connection info on
+ * shmem. Elements of con_info are chained from coninfo_bucket by
+ * coninfo_next. coninfo_hashed remembers the bucket each element is
+ * chained from, or -1 if it's not in the index. Placed on shared
+ * memory and protected by CONINFO_INDEX_SEM.
+ */
+static int coninfo_nbuckets;
+static int *coninfo_bucket;
+static int *coninfo_next;
+static int *coninfo_hashed;
+
+static int coninfo_hash(int pid, int key);
+static void coninfo_index_remove(int e);
+
 /*
  * Initialize per process context
  */
@@ -239,3 +258,170 @@ void pool_coninfo_unset_frontend_connected(int proc_id, int pool_index)
 		con->connected = false;
 	}
 }
+
+/*
+ * Create cancel key index of connection info on shmem. Must be
+ * called after con_info is created. Returns 0 on success.
+ */
+int pool_coninfo_init_index(void)
+{
+	int nelm = pool_coninfo_num();
+	int *p;
+	int i;
+
+	for (coninfo_nbuckets = 1; coninfo_nbuckets < nelm; coninfo_nbuckets <<= 1)
+		;
+
+	p = pool_shared_memory_create(sizeof(int) * (coninfo_nbuckets + nelm * 2));
+	if (p == NULL)
+	{
+		pool_error("pool_coninfo_init_index: failed to allocate cancel key index");
+		return -1;
+	}
+
+	coninfo_bucket = p;
+	coninfo_next = p + coninfo_nbuckets;
+	coninfo_hashed = coninfo_next + nelm;
+
+	for (i = 0; i < coninfo_nbuckets; i++)
+		coninfo_bucket[i] = -1;
+	for (i = 0; i < nelm; i++)
+		coninfo_next[i] = coninfo_hashed[i] = -1;
+
+	return 0;
+}
+
+static int coninfo_hash(int pid, int key)
+{
+	unsigned int h = (unsigned int) pid * 2654435761U ^ (unsigned int) key;
+
+	return (h ^ (h >> 16)) & (coninfo_nbuckets - 1);
+}
+
+/*
+ * Unchain e th element from the index. Caller must hold
+ * CONINFO_INDEX_SEM.
+ */
+static void coninfo_index_remove(int e)
+{
+	int *p;
+
+	if (coninfo_hashed[e] < 0)
+		return;
+
+	for (p = &coninfo_bucket[coninfo_hashed[e]]; *p >= 0; p = &coninfo_next[*p])
+	{
+		if (*p == e)
+		{
+			*p = coninfo_next[e];
+			break;
+		}
+	}
+	coninfo_next[e] = coninfo_hashed[e] = -1;
+}
+
+/*
+ * Register connection info to the index by its pid and key. Call
+ * this after pid and key are set.
+ */
+void pool_coninfo_index_add(ConnectionInfo *info)
+{
+	sigset_t oldmask;
+	int e = info - con_info;
+	int h;
+
+	if (coninfo_bucket == NULL)
+		return;
+
+	h = coninfo_hash(info->pid, info->key);
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(CONINFO_INDEX_SEM);
+
+	coninfo_index_remove(e);
+	coninfo_next[e] = coninfo_bucket[h];
+	coninfo_bucket[h] = e;
+	coninfo_hashed[e] = h;
+
+	pool_semaphore_unlock(CONINFO_INDEX_SEM);
+	POOL_SETMASK(&oldmask);
+}
+
+/*
+ * Clear connection info of a connection pool, i.e. MAX_NUM_BACKENDS
+ * elements starting from info, and remove them from the index.
+ */
+void pool_coninfo_clear(ConnectionInfo *info)
+{
+	sigset_t oldmask;
+	int e = info - con_info;
+	int i;
+
+	if (coninfo_bucket)
+	{
+		POOL_SETMASK2(&BlockSig, &oldmask);
+		pool_semaphore_lock(CONINFO_INDEX_SEM);
+
+		for (i = 0; i < MAX_NUM_BACKENDS; i++)
+			coninfo_index_remove(e + i);
+
+		pool_semaphore_unlock(CONINFO_INDEX_SEM);
+		POOL_SETMASK(&oldmask);
+	}
+
+	memset(info, 0, sizeof(ConnectionInfo) * MAX_NUM_BACKENDS);
+}
+
+/*
+ * Clear connection info of the DB node in a connection pool starting
+ * from info, and remove it from the index.
+ */
+void pool_coninfo_clear_node(ConnectionInfo *info, int node_id)
+{
+	sigset_t oldmask;
+	int e = info - con_info + node_id;
+
+	if (coninfo_bucket)
+	{
+		POOL_SETMASK2(&BlockSig, &oldmask);
+		pool_semaphore_lock(CONINFO_INDEX_SEM);
+		coninfo_index_remove(e);
+		pool_semaphore_unlock(CONINFO_INDEX_SEM);
+		POOL_SETMASK(&oldmask);
+	}
+
+	memset(&info[node_id], 0, sizeof(ConnectionInfo));
+}
+
+/*
+ * Look for connection info having the cancel key. Returns the
+ * connection info of the first backend in the connection pool, or
+ * NULL if not found.
+ */
+ConnectionInfo *pool_coninfo_lookup(int pid, int key)
+{
+	sigset_t oldmask;
+	ConnectionInfo *c = NULL;
+	int e;
+
+	if (coninfo_bucket == NULL)
+		return NULL;
+
+	POOL_SETMASK2(&BlockSig, &oldmask);
+	pool_semaphore_lock(CONINFO_INDEX_SEM);
+
+	for (e = coninfo_bucket[coninfo_hash(pid, key)]; e >= 0; e = coninfo_next[e])
+	{
+		if (con_info[e].pid == pid && con_info[e].key == key)
+		{
+			/* back to the first backend */
+			c = &con_info[e - e % MAX_NUM_BACKENDS];
+			break;
+		}
+	}
+
+	pool_semaphore_unlock(CONINFO_INDEX_SEM);
+	POOL_SETMASK(&oldmask);
+
+	return c;
+}
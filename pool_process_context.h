@@ -56,6 +56,11 @@ extern int pool_coninfo_size(void);
 extern int pool_coninfo_num(void);
 extern ConnectionInfo *pool_coninfo(int child, int connection_pool, int backend);
 extern ConnectionInfo *pool_coninfo_pid(int pid, int connection_pool, int backend);
+extern int pool_coninfo_init_index(void);
+extern void pool_coninfo_index_add(ConnectionInfo *info);
+extern void pool_coninfo_clear(ConnectionInfo *info);
+extern void pool_coninfo_clear_node(ConnectionInfo *info, int node_id);
+extern ConnectionInfo *pool_coninfo_lookup(int pid, int key);
 extern void pool_coninfo_set_frontend_connected(int proc_id, int pool_index);
 extern void pool_coninfo_unset_frontend_connected(int proc_id, int pool_index);
 
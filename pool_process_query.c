@@ -65,6 +65,9 @@
 #define CRASH_SHUTDOWN_ERROR_CODE "57P02"
 
 static int reset_backend(POOL_CONNECTION_POOL *backend, int qcnt);
+static int reset_backend_pipelined(POOL_CONNECTION_POOL *backend);
+static bool need_reset_query(char *query);
+static POOL_STATUS read_pipelined_responses(POOL_CONNECTION *backend, int n, ParamStatus *params);
 static char *get_insert_command_table_name(InsertStmt *node);
 static int send_deallocate(POOL_CONNECTION_POOL *backend, POOL_SENT_MESSAGE_LIST msglist, int n);
 static int is_cache_empty(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend);
@@ -77,6 +80,8 @@ static bool pool_has_insert_lock(void);
 static POOL_STATUS add_lock_target(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend, char* table);
 static bool has_lock_target(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend, char* table, bool for_update);
 static POOL_STATUS insert_oid_into_insert_lock(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend, char* table);
+static int read_split_response(POOL_CONNECTION *cp, int node_id, unsigned long *ntuples,
+							   char **error, int *error_len, bool *error_seen);
 
 /* timeout sec for pool_check_fd */
 static int timeoutsec;
@@ -106,6 +111,18 @@ POOL_STATUS pool_process_query(POOL_CONNECTION *frontend,
 	 */
 	int state;
 
+	/*
+	 * If no query is in progress, send all reset queries at once
+	 * rather than one by one in the loop below.
+	 */
+	if (reset_request && MAJOR(backend) == PROTO_MAJOR_V3 &&
+		!pool_is_query_in_progress() && is_cache_empty(frontend, backend))
+	{
+		if (reset_backend_pipelined(backend) < 0)
+			return POOL_END;
+		return POOL_CONTINUE;
+	}
+
 	frontend->no_forward = reset_request;
 	qcnt = 0;
 	state = 0;
@@ -203,6 +220,9 @@ POOL_STATUS pool_process_query(POOL_CONNECTION *frontend,
 				num_fds = Max(frontend->fd + 1, num_fds);
 			}
 
+			/* forget nodes detached by failover */
+			check_down_nodes();
+
 			/*
 			 * If we are in load balance mode and the selected node is
 			 * down, we need to re-select load_balancing_node.  Note
@@ -968,7 +988,7 @@ int pool_check_fd(POOL_CONNECTION *cp)
 		fds = select(fd+1, &readmask, NULL, &exceptmask, timeoutp);
 		if (fds == -1)
 		{
-			if (errno == EAGAIN || errno == EINTR)
+			if ((errno == EAGAIN || errno == EINTR) && !health_check_timed_out())
 				continue;
 
 			pool_error("pool_check_fd: select() failed. reason %s", strerror(errno));
@@ -1425,6 +1445,8 @@ static int reset_backend(POOL_CONNECTION_POOL *backend, int qcnt)
 		if (!need_to_abort)
 			return 0;
 	}
+	else if (!need_reset_query(query))
+		return 0;
 
 	pool_set_timeout(10);
 
@@ -1438,6 +1460,296 @@ static int reset_backend(POOL_CONNECTION_POOL *backend, int qcnt)
 	return 1;
 }
 
+/*
+ * Reset backend status like reset_backend() does, but send queries in
+ * reset_query_list and DEALLOCATE for the prepared statements to all
+ * backends at once, then read the responses. Used with protocol V3
+ * when no query is in progress. Returns 0 on success, -1 on error.
+ */
+static int reset_backend_pipelined(POOL_CONNECTION_POOL *backend)
+{
+	POOL_SESSION_CONTEXT *session_context;
+	POOL_SENT_MESSAGE *msg;
+	char **commands;
+	char *query;
+	int ncommands = 0;
+	int qn;
+	int i;
+	int status = 0;
+	bool need_to_abort;
+
+	/* Get session context */
+	session_context = pool_get_session_context();
+	if (!session_context)
+	{
+		pool_error("reset_backend_pipelined: cannot get session context");
+		return -1;
+	}
+
+	/* Set reset context */
+	session_context->reset_context = true;
+
+	/*
+	 * Reset all state variables
+	 */
+	reset_variables();
+
+	qn = pool_config->num_reset_queries;
+	commands = malloc(sizeof(char *) * (qn + session_context->message_list.size + 1));
+	if (commands == NULL)
+	{
+		pool_error("reset_backend_pipelined: malloc failed");
+		return -1;
+	}
+
+	for (i=0;i<qn;i++)
+	{
+		query = pool_config->reset_query_list[i];
+
+		if (!strcmp("ABORT", query))
+		{
+			/* If transaction state are all idle, we don't need to issue ABORT */
+			int j;
+
+			need_to_abort = false;
+
+			for (j=0;j<NUM_BACKENDS;j++)
+			{
+				if (VALID_BACKEND(j) && TSTATE(backend, j) != 'I')
+					need_to_abort = true;
+			}
+
+			if (!need_to_abort)
+				continue;
+		}
+		else if (!need_reset_query(query))
+			continue;
+		commands[ncommands++] = strdup(query);
+	}
+
+	/* Deallocate prepared statements */
+	for (i=0;i<session_context->message_list.size;i++)
+	{
+		msg = session_context->message_list.sent_messages[i];
+
+		if ((msg->kind == 'P' || msg->kind == 'Q') && *msg->name != '\0')
+		{
+			query = malloc(strlen(msg->name) + 14);	/* "DEALLOCATE \"" + "\"" + '\0' */
+			if (query)
+				sprintf(query, "DEALLOCATE \"%s\"", msg->name);
+			commands[ncommands++] = query;
+		}
+	}
+	pool_clear_sent_message_list();
+
+	for (i=0;i<ncommands;i++)
+	{
+		if (commands[i] == NULL)
+		{
+			pool_error("reset_backend_pipelined: malloc failed");
+			status = -1;
+			break;
+		}
+	}
+
+	/*
+	 * Write all commands to all backends, then read the
+	 * responses. Backends execute the commands in parallel and no
+	 * round trip is needed between commands.
+	 */
+	if (status == 0 && ncommands > 0)
+	{
+		pool_set_timeout(10);
+		if (pool_pipeline_commands(backend, commands, ncommands) != POOL_CONTINUE)
+			status = -1;
+		pool_set_timeout(0);
+	}
+
+	for (i=0;i<ncommands;i++)
+		free(commands[i]);
+	free(commands);
+
+	return status;
+}
+
+/*
+ * Reset queries and the session state they undo. Reset queries not
+ * listed here are needed if any session state has been changed.
+ */
+static struct {
+	char *query;
+	int state;
+} reset_query_states[] = {
+	{"RESET ALL", POOL_SESSION_STATE_GUC},
+	{"SET SESSION AUTHORIZATION DEFAULT", POOL_SESSION_STATE_GUC},
+	{"RESET SESSION AUTHORIZATION", POOL_SESSION_STATE_GUC},
+	{"DISCARD TEMP", POOL_SESSION_STATE_TEMP},
+	{"UNLISTEN", POOL_SESSION_STATE_LISTEN},
+	{"CLOSE ALL", POOL_SESSION_STATE_CURSOR},
+	{"SELECT pg_advisory_unlock_all()", POOL_SESSION_STATE_LOCK},
+};
+
+/*
+ * Return true if the reset query (other than ABORT) has to be
+ * executed. Unless lazy_reset is enabled, all reset queries are
+ * executed.
+ */
+static bool need_reset_query(char *query)
+{
+	int state;
+	int i;
+
+	if (!pool_config->lazy_reset)
+		return true;
+
+	state = pool_get_session_state();
+	if (state & POOL_SESSION_STATE_UNKNOWN)
+		return true;
+
+	while (isspace(*query))
+		query++;
+
+	for (i=0;i<sizeof(reset_query_states)/sizeof(reset_query_states[0]);i++)
+	{
+		if (!strncasecmp(query, reset_query_states[i].query,
+						 strlen(reset_query_states[i].query)))
+			break;
+	}
+
+	if (i < sizeof(reset_query_states)/sizeof(reset_query_states[0]))
+		state &= reset_query_states[i].state;
+
+	if (state == 0)
+	{
+		pool_debug("need_reset_query: skip reset query: %s", query);
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Send n simple queries to all valid backends without waiting for
+ * each response, then read the responses. Responses are not
+ * forwarded to frontend. Notice and non fatal errors are ignored as
+ * do_command() does. Parameter status of the master node is
+ * saved. Protocol V3 only.
+ *
+ * Queries are sent in batches of PIPELINE_BATCH_SIZE and responses of
+ * a batch are read before sending the next one. Otherwise with many
+ * queries (one DEALLOCATE per prepared statement) the backend may
+ * block on writing responses nobody reads while we block on writing
+ * queries, and both socket buffers fill up.
+ */
+#define PIPELINE_BATCH_SIZE 100
+
+POOL_STATUS pool_pipeline_commands(POOL_CONNECTION_POOL *backend, char **commands, int n)
+{
+	POOL_CONNECTION *cp;
+	int len;
+	int i, j;
+	int start, nbatch;
+
+	for (start=0;start<n;start+=nbatch)
+	{
+		nbatch = Min(n - start, PIPELINE_BATCH_SIZE);
+
+		for (i=0;i<NUM_BACKENDS;i++)
+		{
+			if (!VALID_BACKEND(i))
+				continue;
+
+			cp = CONNECTION(backend, i);
+
+			for (j=start;j<start+nbatch;j++)
+			{
+				pool_debug("pool_pipeline_commands: %d th backend: Query: %s", i, commands[j]);
+
+				pool_write(cp, "Q", 1);
+				len = htonl(strlen(commands[j]) + 1 + sizeof(len));
+				pool_write(cp, &len, sizeof(len));
+				pool_write(cp, commands[j], strlen(commands[j]) + 1);
+			}
+
+			if (pool_flush(cp) < 0)
+			{
+				pool_error("pool_pipeline_commands: failed to send queries to %d th backend", i);
+				return POOL_END;
+			}
+		}
+
+		for (i=0;i<NUM_BACKENDS;i++)
+		{
+			if (!VALID_BACKEND(i))
+				continue;
+
+			if (read_pipelined_responses(CONNECTION(backend, i), nbatch,
+										 IS_MASTER_NODE_ID(i) ? &MASTER(backend)->params : NULL) != POOL_CONTINUE)
+				return POOL_END;
+		}
+	}
+	return POOL_CONTINUE;
+}
+
+/*
+ * Read responses of n pipelined simple queries from a backend, that
+ * is, until n ReadyForQuery are received. If params is not NULL,
+ * parameter status is saved in it.
+ */
+static POOL_STATUS read_pipelined_responses(POOL_CONNECTION *backend, int n, ParamStatus *params)
+{
+	char kind;
+	int len;
+	char *p;
+
+	while (n > 0)
+	{
+		if (pool_read(backend, &kind, sizeof(kind)) < 0)
+		{
+			pool_error("read_pipelined_responses: error while reading message kind");
+			return POOL_END;
+		}
+
+		if (pool_read(backend, &len, sizeof(len)) < 0)
+		{
+			pool_error("read_pipelined_responses: error while reading message length");
+			return POOL_END;
+		}
+		len = ntohl(len) - 4;
+
+		p = pool_read2(backend, len);
+		if (p == NULL && len > 0)
+		{
+			pool_error("read_pipelined_responses: error while reading rest of message");
+			return POOL_END;
+		}
+
+		switch (kind)
+		{
+			case 'Z':	/* ReadyForQuery */
+				backend->tstate = *p;
+				n--;
+				break;
+
+			case 'S':	/* ParameterStatus */
+				if (params)
+					pool_add_param(params, p, p + strlen(p) + 1);
+				break;
+
+			case 'E':	/* ErrorResponse */
+				if (is_panic_or_fatal_error(p, PROTO_MAJOR_V3))
+				{
+					pool_error("read_pipelined_responses: fatal error from backend");
+					return POOL_END;
+				}
+				break;
+
+			default:	/* ignore CommandComplete, rows and others */
+				break;
+		}
+	}
+	return POOL_CONTINUE;
+}
+
 /*
  * returns non 0 if the SQL statement can be load
  * balanced. Followings are statemnts go into this category.
@@ -2239,6 +2551,288 @@ POOL_STATUS OneNode_do_command(POOL_CONNECTION *frontend, POOL_CONNECTION *backe
 		return status;
 }
 
+/*
+ * Read responses of a split INSERT from a DB node up to
+ * ReadyForQuery. Row counts of CommandComplete for INSERT are added
+ * to *ntuples. The first ErrorResponse is saved into *error, and
+ * *error_seen is set even if it could not be saved. Returns -1 if
+ * reading from the node failed.
+ */
+static int read_split_response(POOL_CONNECTION *cp, int node_id, unsigned long *ntuples,
+							   char **error, int *error_len, bool *error_seen)
+{
+	int len;
+	char kind;
+	char *p;
+
+	for (;;)
+	{
+		if (pool_read(cp, &kind, sizeof(kind)) < 0 ||
+			pool_read(cp, &len, sizeof(len)) < 0)
+		{
+			pool_error("pool_parallel_split_exec: error while reading message from node %d", node_id);
+			return -1;
+		}
+
+		len = ntohl(len) - 4;
+		p = NULL;
+		if (len > 0)
+		{
+			p = pool_read2(cp, len);
+			if (p == NULL)
+			{
+				pool_error("pool_parallel_split_exec: error while reading message from node %d", node_id);
+				return -1;
+			}
+		}
+
+		if (kind == 'C' && p)
+		{
+			unsigned int oid;
+			unsigned long n;
+
+			if (sscanf(p, "INSERT %u %lu", &oid, &n) == 2)
+				*ntuples += n;
+		}
+		else if (kind == 'E')
+		{
+			if (!*error_seen && p)
+			{
+				*error = malloc(len);
+				if (*error == NULL)
+					pool_error("pool_parallel_split_exec: malloc failed");
+				else
+				{
+					memcpy(*error, p, len);
+					*error_len = len;
+				}
+			}
+			*error_seen = true;
+		}
+		else if (kind == 'Z' && p)
+		{
+			cp->tstate = *p;
+			return 0;
+		}
+		/* other messages such as NoticeResponse are discarded */
+	}
+}
+
+/*
+ * Send INSERTs split by dividing key to the DB nodes and merge the
+ * results. queries[i] is the INSERT for node i, or NULL if node i has
+ * no rows to insert. All the INSERTs are sent before reading any
+ * response so that nodes execute them concurrently. Row counts of
+ * CommandComplete are summed up and returned to frontend as one
+ * CommandComplete. If any node returns an error, the first
+ * ErrorResponse is forwarded instead. V3 protocol only.
+ *
+ * If not in an explicit transaction, the INSERTs are run in a
+ * transaction on each node, which is committed only if all nodes
+ * succeeded. Otherwise rows might be left on some nodes although
+ * frontend gets an error. This is not two-phase commit: if COMMIT
+ * itself fails on a node, the rows stay committed on the others. In
+ * an explicit transaction, if any node
+ * fails, the transaction is aborted on the other nodes too, so that
+ * COMMIT by frontend does not commit the rows only on them. Responses
+ * of every node are read up to ReadyForQuery even after an error, so
+ * that the nodes stay in sync with the session.
+ */
+POOL_STATUS pool_parallel_split_exec(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend, char **queries)
+{
+	int i;
+	int len;
+	int sendlen;
+	char *error = NULL;
+	int error_len = 0;
+	bool error_seen = false;
+	bool read_failed = false;
+	bool sent[MAX_NUM_BACKENDS];
+	bool in_xact[MAX_NUM_BACKENDS];
+	bool aborted[MAX_NUM_BACKENDS];
+	unsigned long ntuples = 0;
+	char tstate = 'I';
+	char tag[64];
+	char *query;
+	POOL_SESSION_CONTEXT *session_context;
+
+	session_context = pool_get_session_context();
+	if (!session_context || !session_context->query_context)
+	{
+		pool_error("pool_parallel_split_exec: cannot get query context");
+		return POOL_END;
+	}
+
+	pool_setall_node_to_be_sent(session_context->query_context);
+
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		sent[i] = in_xact[i] = aborted[i] = false;
+
+		if (queries[i] == NULL)
+			continue;
+
+		if (!VALID_BACKEND(i))
+		{
+			pool_error("pool_parallel_split_exec: node %d is not valid", i);
+			read_failed = true;
+			break;
+		}
+
+		/* start a transaction if not in an explicit one */
+		in_xact[i] = TSTATE(backend, i) == 'I';
+		if (in_xact[i])
+		{
+			query = malloc(strlen(queries[i]) + sizeof("BEGIN;"));
+			if (query == NULL)
+			{
+				pool_error("pool_parallel_split_exec: malloc failed");
+				read_failed = true;
+				break;
+			}
+			sprintf(query, "BEGIN;%s", queries[i]);
+		}
+		else
+			query = queries[i];
+
+		per_node_statement_log(backend, i, query);
+
+		if (send_simplequery_message(CONNECTION(backend, i), strlen(query)+1,
+									 query, PROTO_MAJOR_V3) != POOL_CONTINUE)
+			read_failed = true;
+		else
+			sent[i] = true;
+
+		if (query != queries[i])
+			free(query);
+
+		if (read_failed)
+			break;
+	}
+
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		if (sent[i] &&
+			read_split_response(CONNECTION(backend, i), i, &ntuples,
+								&error, &error_len, &error_seen) < 0)
+		{
+			sent[i] = false;
+			read_failed = true;
+		}
+	}
+
+	/* finish the transactions started above */
+	query = (error_seen || read_failed) ? "ROLLBACK" : "COMMIT";
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		if (!sent[i] || !in_xact[i])
+			continue;
+
+		per_node_statement_log(backend, i, query);
+
+		if (send_simplequery_message(CONNECTION(backend, i), strlen(query)+1,
+									 query, PROTO_MAJOR_V3) != POOL_CONTINUE)
+		{
+			sent[i] = false;
+			read_failed = true;
+		}
+	}
+
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		if (sent[i] && in_xact[i] &&
+			read_split_response(CONNECTION(backend, i), i, &ntuples,
+								&error, &error_len, &error_seen) < 0)
+		{
+			sent[i] = false;
+			read_failed = true;
+		}
+	}
+
+	/*
+	 * In an explicit transaction, send the invalid query to abort the
+	 * transaction on nodes which are still in it, including nodes
+	 * which had no rows to insert.
+	 */
+	if (error_seen && !read_failed)
+	{
+		query = "POOL_RESET_TSTATE";
+		for (i=0;i<NUM_BACKENDS;i++)
+		{
+			if (!VALID_BACKEND(i) || TSTATE(backend, i) != 'T')
+				continue;
+
+			per_node_statement_log(backend, i, query);
+
+			if (send_simplequery_message(CONNECTION(backend, i), strlen(query)+1,
+										 query, PROTO_MAJOR_V3) != POOL_CONTINUE)
+			{
+				read_failed = true;
+				break;
+			}
+			aborted[i] = true;
+		}
+
+		for (i=0;i<NUM_BACKENDS;i++)
+		{
+			if (aborted[i] &&
+				read_split_response(CONNECTION(backend, i), i, &ntuples,
+									&error, &error_len, &error_seen) < 0)
+				read_failed = true;
+		}
+	}
+
+	if (read_failed)
+	{
+		free(error);
+		return POOL_END;
+	}
+
+	/* report the "worst" transaction state: E > T > I */
+	for (i=0;i<NUM_BACKENDS;i++)
+	{
+		if (!sent[i] && !aborted[i])
+			continue;
+
+		if (TSTATE(backend, i) == 'E' || (TSTATE(backend, i) == 'T' && tstate == 'I'))
+			tstate = TSTATE(backend, i);
+	}
+
+	if (error)
+	{
+		pool_write(frontend, "E", 1);
+		sendlen = htonl(error_len + 4);
+		pool_write(frontend, &sendlen, sizeof(sendlen));
+		pool_write(frontend, error, error_len);
+		free(error);
+	}
+	else if (error_seen)
+	{
+		pool_send_error_message(frontend, PROTO_MAJOR_V3, "XX000",
+								"split INSERT failed on a DB node",
+								"", "", __FILE__, __LINE__);
+	}
+	else
+	{
+		snprintf(tag, sizeof(tag), "INSERT 0 %lu", ntuples);
+		len = strlen(tag) + 1;
+		pool_write(frontend, "C", 1);
+		sendlen = htonl(len + 4);
+		pool_write(frontend, &sendlen, sizeof(sendlen));
+		pool_write(frontend, tag, len);
+	}
+
+	pool_write(frontend, "Z", 1);
+	sendlen = htonl(5);
+	pool_write(frontend, &sendlen, sizeof(sendlen));
+	pool_write(frontend, &tstate, 1);
+
+	if (pool_flush(frontend) < 0)
+		return POOL_END;
+
+	return POOL_CONTINUE;
+}
+
 /*
  * Free POOL_SELECT_RESULT object
  */
@@ -172,6 +172,16 @@ POOL_REPORT_CONFIG* get_config(int *nrows)
 	strncpy(status[i].desc, "# of children initially pre-forked", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	strncpy(status[i].name, "min_spare_children", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->min_spare_children);
+	strncpy(status[i].desc, "min # of idle children. 0 means at least one", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	strncpy(status[i].name, "max_spare_children", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->max_spare_children);
+	strncpy(status[i].desc, "max # of idle children. 0 means no dynamic child pool", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	strncpy(status[i].name, "child_life_time", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->child_life_time);
 	strncpy(status[i].desc, "if idle for this seconds, child exits", POOLCONFIG_MAXDESCLEN);
@@ -197,6 +207,21 @@ POOL_REPORT_CONFIG* get_config(int *nrows)
 	strncpy(status[i].desc, "max # of connection pool per child", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	strncpy(status[i].name, "prewarm_connections", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->prewarm_connections);
+	strncpy(status[i].desc, "# of recent user/db pairs preconnected by idle child", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	strncpy(status[i].name, "serialize_accept", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->serialize_accept);
+	strncpy(status[i].desc, "if true, only one idle child waits for a connection at a time", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	strncpy(status[i].name, "accept_queue_size", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->accept_queue_size);
+	strncpy(status[i].desc, "max number of connections queued by acceptor process", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	strncpy(status[i].name, "authentication_timeout", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->authentication_timeout);
 	strncpy(status[i].desc, "maximum time in seconds to complete client authentication", POOLCONFIG_MAXNAMELEN);
@@ -273,6 +298,11 @@ POOL_REPORT_CONFIG* get_config(int *nrows)
 	strncpy(status[i].desc, "queries issued at the end of session", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	strncpy(status[i].name, "lazy_reset", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->lazy_reset);
+	strncpy(status[i].desc, "if true, skip reset queries which undo nothing", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	strncpy(status[i].name, "white_function_list", POOLCONFIG_MAXNAMELEN);
 	*(status[i].value) = '\0';
 	for (j=0;j<pool_config->num_white_function_list;j++)
@@ -369,6 +399,11 @@ POOL_REPORT_CONFIG* get_config(int *nrows)
 	strncpy(status[i].desc, "insert lock", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	strncpy(status[i].name, "sequence_prealloc_size", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->sequence_prealloc_size);
+	strncpy(status[i].desc, "number of SERIAL values to preallocate per sequence", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	strncpy(status[i].name, "ignore_leading_white_space", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->ignore_leading_white_space);
 	strncpy(status[i].desc, "ignore leading white spaces", POOLCONFIG_MAXDESCLEN);
@@ -404,6 +439,11 @@ POOL_REPORT_CONFIG* get_config(int *nrows)
 	strncpy(status[i].desc, "if non 0, logs all SQL statements on each node", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	strncpy(status[i].name, "log_buffer_size", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->log_buffer_size);
+	strncpy(status[i].desc, "per child log buffer size in bytes. 0 means no buffering", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	strncpy(status[i].name, "log_connections", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->log_connections);
 	strncpy(status[i].desc, "if true, print incoming connections to the log", POOLCONFIG_MAXDESCLEN);
@@ -434,6 +474,16 @@ POOL_REPORT_CONFIG* get_config(int *nrows)
 	strncpy(status[i].desc, "execute a command in second stage.", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	strncpy(status[i].name, "recovery_base_backup", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->recovery_base_backup);
+	strncpy(status[i].desc, "take base backup in 1st stage instead of command", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	strncpy(status[i].name, "recovery_max_rate", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->recovery_max_rate);
+	strncpy(status[i].desc, "max transfer rate of base backup in kB/s", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	strncpy(status[i].name, "recovery_timeout", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->recovery_timeout);
 	strncpy(status[i].desc, "max time in seconds to wait for the recovering node's postmaster", POOLCONFIG_MAXDESCLEN);
@@ -449,6 +499,21 @@ POOL_REPORT_CONFIG* get_config(int *nrows)
 	strncpy(status[i].desc, "table name used for large object replication control", POOLCONFIG_MAXDESCLEN);
 	i++;
 
+	strncpy(status[i].name, "lobj_prealloc_size", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->lobj_prealloc_size);
+	strncpy(status[i].desc, "number of large object ids to preallocate at once", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	strncpy(status[i].name, "timestamp_calibration_interval", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->timestamp_calibration_interval);
+	strncpy(status[i].desc, "clock calibration interval for local timestamp rewriting", POOLCONFIG_MAXDESCLEN);
+	i++;
+
+	strncpy(status[i].name, "cancel_request_delay", POOLCONFIG_MAXNAMELEN);
+	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->cancel_request_delay);
+	strncpy(status[i].desc, "delay in msec before canceling query on other than master", POOLCONFIG_MAXDESCLEN);
+	i++;
+
 	strncpy(status[i].name, "ssl", POOLCONFIG_MAXNAMELEN);
 	snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", pool_config->ssl);
 	strncpy(status[i].desc, "SSL support", POOLCONFIG_MAXDESCLEN);
@@ -550,6 +615,36 @@ POOL_REPORT_CONFIG* get_config(int *nrows)
 		i++;
 	}
 
+	if (pool_get_accept_queue_status())
+	{
+		POOL_ACCEPT_QUEUE_STATUS qs;
+
+		pool_semaphore_lock(ACCEPT_QUEUE_SEM);
+		qs = *pool_get_accept_queue_status();
+		pool_semaphore_unlock(ACCEPT_QUEUE_SEM);
+
+		strncpy(status[i].name, "accept_queue_length", POOLCONFIG_MAXNAMELEN);
+		snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%d", qs.queue_length);
+		strncpy(status[i].desc, "number of connections waiting in accept queue", POOLCONFIG_MAXDESCLEN);
+		i++;
+
+		strncpy(status[i].name, "accept_queue_handed_off", POOLCONFIG_MAXNAMELEN);
+		snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%lld", qs.handed_off);
+		strncpy(status[i].desc, "number of connections handed off to children", POOLCONFIG_MAXDESCLEN);
+		i++;
+
+		strncpy(status[i].name, "accept_queue_avg_wait", POOLCONFIG_MAXNAMELEN);
+		snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%lld",
+				 qs.handed_off > 0 ? qs.total_wait / qs.handed_off : 0);
+		strncpy(status[i].desc, "average wait time in accept queue in microseconds", POOLCONFIG_MAXDESCLEN);
+		i++;
+
+		strncpy(status[i].name, "accept_queue_max_wait", POOLCONFIG_MAXNAMELEN);
+		snprintf(status[i].value, POOLCONFIG_MAXVALLEN, "%lld", qs.max_wait);
+		strncpy(status[i].desc, "max wait time in accept queue in microseconds", POOLCONFIG_MAXDESCLEN);
+		i++;
+	}
+
 	*nrows = i;
 	return status;
 	}
@@ -762,6 +857,9 @@ POOL_REPORT_POOLS* get_pools(int *nrows)
 	for (child = 0; child < pool_config->num_init_children; child++)
 	{
 		proc_id = process_info[child].pid;
+		/* empty slot of the dynamic child pool */
+		if (proc_id == 0)
+			continue;
 		pi = pool_get_process_info(proc_id);
     
 		for (pool = 0; pool < pool_config->max_pool; pool++)
@@ -953,43 +1051,55 @@ POOL_REPORT_PROCESSES* get_processes(int *nrows)
     int poolBE;
     ProcessInfo *pi = NULL;
     int proc_id;
+	int n = 0;
 
     POOL_REPORT_PROCESSES* processes = malloc(pool_config->num_init_children * sizeof(POOL_REPORT_PROCESSES));
 
 	for (child = 0; child < pool_config->num_init_children; child++)
     {
 		proc_id = process_info[child].pid;
-	    pi = pool_get_process_info(proc_id);
+		/* empty slot of the dynamic child pool */
+		if (proc_id == 0)
+			continue;
+	    pi = &process_info[child];
     
-        snprintf(processes[child].pool_pid, POOLCONFIG_MAXCOUNTLEN, "%d", proc_id);
-	    strftime(processes[child].start_time, POOLCONFIG_MAXDATELEN, "%Y-%m-%d %H:%M:%S", localtime(&pi->start_time));
-	    strncpy(processes[child].database, "", POOLCONFIG_MAXIDENTLEN);
-	    strncpy(processes[child].username, "", POOLCONFIG_MAXIDENTLEN);
-        strncpy(processes[child].create_time, "", POOLCONFIG_MAXDATELEN);
-        strncpy(processes[child].pool_counter, "", POOLCONFIG_MAXCOUNTLEN);
+        snprintf(processes[n].pool_pid, POOLCONFIG_MAXCOUNTLEN, "%d", proc_id);
+	    strftime(processes[n].start_time, POOLCONFIG_MAXDATELEN, "%Y-%m-%d %H:%M:%S", localtime(&pi->start_time));
+	    strncpy(processes[n].database, "", POOLCONFIG_MAXIDENTLEN);
+	    strncpy(processes[n].username, "", POOLCONFIG_MAXIDENTLEN);
+        strncpy(processes[n].create_time, "", POOLCONFIG_MAXDATELEN);
+        strncpy(processes[n].pool_counter, "", POOLCONFIG_MAXCOUNTLEN);
+
+		if (pi->retiring)
+			strncpy(processes[n].status, "retiring", POOLCONFIG_MAXIDENTLEN);
+		else if (pi->idle)
+			strncpy(processes[n].status, "idle", POOLCONFIG_MAXIDENTLEN);
+		else
+			strncpy(processes[n].status, "busy", POOLCONFIG_MAXIDENTLEN);
 
         for (pool = 0; pool < pool_config->max_pool; pool++)
         {
             poolBE = pool*MAX_NUM_BACKENDS;
             if (pi->connection_info[poolBE].connected && strlen(pi->connection_info[poolBE].database) > 0 && strlen(pi->connection_info[poolBE].user) > 0)
             {
-	            strncpy(processes[child].database, pi->connection_info[poolBE].database, POOLCONFIG_MAXIDENTLEN);
-	            strncpy(processes[child].username, pi->connection_info[poolBE].user, POOLCONFIG_MAXIDENTLEN);
-	            strftime(processes[child].create_time, POOLCONFIG_MAXDATELEN, "%Y-%m-%d %H:%M:%S", localtime(&pi->connection_info[poolBE].create_time));
-                snprintf(processes[child].pool_counter, POOLCONFIG_MAXCOUNTLEN, "%d", pi->connection_info[poolBE].counter);
+	            strncpy(processes[n].database, pi->connection_info[poolBE].database, POOLCONFIG_MAXIDENTLEN);
+	            strncpy(processes[n].username, pi->connection_info[poolBE].user, POOLCONFIG_MAXIDENTLEN);
+	            strftime(processes[n].create_time, POOLCONFIG_MAXDATELEN, "%Y-%m-%d %H:%M:%S", localtime(&pi->connection_info[poolBE].create_time));
+                snprintf(processes[n].pool_counter, POOLCONFIG_MAXCOUNTLEN, "%d", pi->connection_info[poolBE].counter);
             }
         }
+		n++;
     }
 
-	*nrows = child;
+	*nrows = n;
 
 	return processes;
 	}
 
 void processes_reporting(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend)
 		{
-	static short num_fields = 6;
-	static char *field_names[] = {"pool_pid", "start_time", "database", "username", "create_time", "pool_counter"};
+	static short num_fields = 7;
+	static char *field_names[] = {"pool_pid", "start_time", "database", "username", "create_time", "pool_counter", "status"};
 	short s;
 	int len;
 	int nrows;
@@ -1040,6 +1150,11 @@ void processes_reporting(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backen
 			hsize = htonl(size+4);
 			pool_write(frontend, &hsize, sizeof(hsize));
 			pool_write(frontend, processes[i].pool_counter, size);
+
+			size = strlen(processes[i].status);
+			hsize = htonl(size+4);
+			pool_write(frontend, &hsize, sizeof(hsize));
+			pool_write(frontend, processes[i].status, size);
 		}
 	}
 	else
@@ -1055,6 +1170,7 @@ void processes_reporting(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backen
 			len += 4 + strlen(processes[i].username);     /* int32 + data */
 			len += 4 + strlen(processes[i].create_time);  /* int32 + data */
 			len += 4 + strlen(processes[i].pool_counter); /* int32 + data */
+			len += 4 + strlen(processes[i].status);       /* int32 + data */
 			len = htonl(len);
 			pool_write(frontend, &len, sizeof(len));
 			s = htons(num_fields);
@@ -1083,6 +1199,10 @@ void processes_reporting(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backen
 			len = htonl(strlen(processes[i].pool_counter));
 			pool_write(frontend, &len, sizeof(len));
 			pool_write(frontend, processes[i].pool_counter, strlen(processes[i].pool_counter));
+
+			len = htonl(strlen(processes[i].status));
+			pool_write(frontend, &len, sizeof(len));
+			pool_write(frontend, processes[i].status, strlen(processes[i].status));
 		}
 	}
 
@@ -55,6 +55,8 @@
 #include "pool_session_context.h"
 #include "pool_query_context.h"
 #include "pool_lobj.h"
+#include "pool_sequence.h"
+#include "pool_select_walker.h"
 
 char *copy_table = NULL;  /* copy table name */
 char *copy_schema = NULL;  /* copy table name */
@@ -91,8 +93,12 @@ static POOL_STATUS parse_before_bind(POOL_CONNECTION *frontend,
 									 POOL_SENT_MESSAGE *message);
 static int* find_victim_nodes(int *ntuples, int nmembers, int master_node, int *number_of_nodes);
 static int extract_ntuples(char *message);
+static void track_session_state(List *parse_tree_list);
 static POOL_STATUS close_standby_transactions(POOL_CONNECTION *frontend,
 											  POOL_CONNECTION_POOL *backend);
+static POOL_STATUS reassign_serial_values(POOL_CONNECTION *frontend,
+										  POOL_CONNECTION_POOL *backend,
+										  POOL_SENT_MESSAGE *message);
 
 /*
  * Process Query('Q') message
@@ -151,6 +157,10 @@ POOL_STATUS SimpleQuery(POOL_CONNECTION *frontend,
 	/* parse SQL string */
 	parse_tree_list = raw_parser(contents);
 
+	/* Remember session state changed by the query */
+	track_session_state(parse_tree_list);
+	pool_check_sequence_functions(contents);
+
 	if (parse_tree_list == NIL)
 	{
 		/*
@@ -317,8 +327,18 @@ POOL_STATUS SimpleQuery(POOL_CONNECTION *frontend,
 				lock_kind = need_insert_lock(backend, contents, node);
 				if (lock_kind)
 				{
-					/* if so, issue lock command */
-					status = insert_lock(frontend, backend, contents, (InsertStmt *)node, lock_kind);
+					bool assigned;
+
+					/* try to assign SERIAL values from preallocated blocks */
+					status = pool_assign_serial_values(frontend, backend, contents, (InsertStmt *)node, lock_kind, &assigned);
+					if (status == POOL_CONTINUE && assigned)
+					{
+						query_context->rewritten_query = nodeToString(node);
+						len = strlen(query_context->rewritten_query) + 1;
+					}
+					/* if not, issue lock command */
+					else if (status == POOL_CONTINUE)
+						status = insert_lock(frontend, backend, contents, (InsertStmt *)node, lock_kind);
 					if (status != POOL_CONTINUE)
 					{
 						free_parser();
@@ -597,7 +617,7 @@ POOL_STATUS Parse(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend,
 	char *stmt;
 	List *parse_tree_list;
 	Node *node = NULL;
-	POOL_SENT_MESSAGE *msg;
+	POOL_SENT_MESSAGE *msg = NULL;
 	POOL_STATUS status;
 	POOL_MEMORY_POOL *old_context;
 	POOL_SESSION_CONTEXT *session_context;
@@ -626,6 +646,10 @@ POOL_STATUS Parse(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend,
 	/* parse SQL string */
 	parse_tree_list = raw_parser(stmt);
 
+	/* Remember session state changed by the query */
+	track_session_state(parse_tree_list);
+	pool_check_sequence_functions(stmt);
+
 	if (parse_tree_list == NIL)
 	{
 		/*
@@ -753,8 +777,59 @@ POOL_STATUS Parse(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend,
 
 		if (insert_stmt_with_lock)
 		{
+			bool assigned = false;
+
+			/*
+			 * Try to assign SERIAL values from preallocated blocks.
+			 * Values are embedded in the statement, so this is done
+			 * only for the unnamed statement like rewriting `now()'.
+			 */
+			status = POOL_CONTINUE;
+			if (*name == '\0')
+				status = pool_assign_serial_values(frontend, backend, stmt, (InsertStmt *)query_context->parse_tree,
+												   insert_stmt_with_lock, &assigned);
+			if (status == POOL_CONTINUE && assigned)
+			{
+				char *rewrite_query;
+				int alloc_len;
+
+				old_context = pool_memory;
+				pool_memory = query_context->memory_context;
+
+				/* remember the statement to assign new values at re-Bind */
+				if (msg)
+				{
+					msg->serial_lock_kind = insert_stmt_with_lock;
+					msg->serial_query = pstrdup(stmt);
+				}
+
+				rewrite_query = nodeToString(query_context->parse_tree);
+				alloc_len = len - strlen(stmt) + strlen(rewrite_query);
+				contents = palloc(alloc_len);
+				strcpy(contents, name);
+				strcpy(contents + strlen(name) + 1, rewrite_query);
+				memcpy(contents + strlen(name) + strlen(rewrite_query) + 2,
+					   stmt + strlen(stmt) + 1,
+					   len - (strlen(name) + strlen(stmt) + 2));
+
+				pool_memory = old_context;
+
+				len = alloc_len;
+				name = contents;
+				stmt = contents + strlen(name) + 1;
+				pool_debug("Parse: rewrite query  %s %s len=%d", name, stmt, len);
+
+				if (msg)
+				{
+					msg->len = len;
+					msg->contents = contents;
+				}
+
+				query_context->rewritten_query = rewrite_query;
+			}
 			/* start a transaction if needed and lock the table */
-			status = insert_lock(frontend, backend, stmt, (InsertStmt *)query_context->parse_tree, insert_stmt_with_lock);
+			else if (status == POOL_CONTINUE)
+				status = insert_lock(frontend, backend, stmt, (InsertStmt *)query_context->parse_tree, insert_stmt_with_lock);
 			if (status != POOL_CONTINUE)
 			{
 				/* free_parser(); */
@@ -912,6 +987,20 @@ POOL_STATUS Bind(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend,
 			return POOL_END;
 	}
 
+	/*
+	 * The unnamed statement has SERIAL values preassigned at
+	 * Parse. They can be used only once.
+	 */
+	if (parse_msg->kind == 'P' && parse_msg->serial_lock_kind)
+	{
+		if (parse_msg->serial_bound)
+		{
+			if (reassign_serial_values(frontend, backend, parse_msg) != POOL_CONTINUE)
+				return POOL_END;
+		}
+		parse_msg->serial_bound = true;
+	}
+
 	pool_debug("Bind: waiting for master completing the query");
 	if (pool_send_and_wait(query_context, contents, len, 1, MASTER_NODE_ID, "B")
 		!= POOL_CONTINUE)
@@ -1271,6 +1360,13 @@ POOL_STATUS ReadyForQuery(POOL_CONNECTION *frontend,
 				state = kind;
 			}
 		}
+
+		/*
+		 * Transaction ended. Forget the timestamp used to rewrite
+		 * now() in the transaction.
+		 */
+		if (state == 'I')
+			session_context->transaction_timestamp = 0;
 	}
 
 	if (send_ready)
@@ -2031,6 +2127,9 @@ POOL_STATUS ProcessFrontendResponse(POOL_CONNECTION *frontend,
 			}
 			query = "INSERT INTO foo VALUES(1)";
 			parse_tree_list = raw_parser(query);
+
+			/* We don't know what the function does */
+			pool_set_session_state(POOL_SESSION_STATE_UNKNOWN);
 			node = (Node *) lfirst(list_head(parse_tree_list));
 			pool_start_query(query_context, query, node);
 			pool_where_to_send(query_context, query_context->original_query,
@@ -2121,6 +2220,13 @@ POOL_STATUS ProcessBackendResponse(POOL_CONNECTION *frontend,
 				break;
 
 			case '1':	/* ParseComplete */
+				if (session_context->ignore_parse_complete > 0)
+				{
+					/* response to Parse sent by reassign_serial_values() */
+					session_context->ignore_parse_complete--;
+					status = pool_discard_packet_contents(backend);
+					break;
+				}
 				status = ParseComplete(frontend, backend);
 				pool_set_command_success();
 				pool_unset_query_in_progress();
@@ -2834,6 +2940,99 @@ static POOL_STATUS parse_before_bind(POOL_CONNECTION *frontend,
 	return POOL_CONTINUE;
 }
 
+/*
+ * The unnamed statement whose SERIAL values were preassigned at Parse
+ * is bound again without new Parse. Binding it as it is would insert
+ * the same values again. So assign new values to the statement and
+ * parse it again on all nodes. ParseComplete for it is not forwarded
+ * to frontend. If values cannot be assigned, the statement is parsed
+ * without them and the table is locked instead.
+ */
+static POOL_STATUS reassign_serial_values(POOL_CONNECTION *frontend,
+										  POOL_CONNECTION_POOL *backend,
+										  POOL_SENT_MESSAGE *message)
+{
+	POOL_SESSION_CONTEXT *session_context;
+	POOL_QUERY_CONTEXT *qc = message->query_context;
+	POOL_MEMORY_POOL *old_context;
+	POOL_STATUS status;
+	List *parse_tree_list;
+	Node *node;
+	char *query;
+	char *stmt;
+	char *contents;
+	int len;
+	bool assigned = false;
+
+	session_context = pool_get_session_context();
+	if (!session_context)
+	{
+		pool_error("reassign_serial_values: cannot get session context");
+		return POOL_END;
+	}
+
+	old_context = pool_memory;
+	pool_memory = qc->memory_context;
+
+	parse_tree_list = raw_parser(message->serial_query);
+	if (parse_tree_list == NIL)
+	{
+		pool_error("reassign_serial_values: cannot parse \"%s\"", message->serial_query);
+		pool_memory = old_context;
+		return POOL_END;
+	}
+	node = (Node *) lfirst(list_head(parse_tree_list));
+
+	status = pool_assign_serial_values(frontend, backend, message->serial_query,
+									   (InsertStmt *)node, message->serial_lock_kind, &assigned);
+	if (status != POOL_CONTINUE)
+	{
+		pool_memory = old_context;
+		return status;
+	}
+
+	if (assigned)
+		query = nodeToString(node);
+	else
+		query = message->serial_query;
+
+	/* replace the query in the Parse message. name is "". */
+	stmt = message->contents + 1;
+	len = message->len - strlen(stmt) + strlen(query);
+	contents = palloc(len);
+	contents[0] = '\0';
+	strcpy(contents + 1, query);
+	memcpy(contents + strlen(query) + 2,
+		   stmt + strlen(stmt) + 1,
+		   message->len - (strlen(stmt) + 2));
+
+	pool_memory = old_context;
+
+	message->len = len;
+	message->contents = contents;
+	qc->parse_tree = node;
+	qc->rewritten_query = query;
+	pool_debug("reassign_serial_values: rewrite query %s len=%d", query, len);
+
+	if (!assigned)
+	{
+		status = insert_lock(frontend, backend, query, (InsertStmt *)node, message->serial_lock_kind);
+		if (status != POOL_CONTINUE)
+			return status;
+
+		/* the statement never gets values preassigned again */
+		message->serial_lock_kind = 0;
+	}
+
+	if (pool_send_and_wait(qc, contents, len, 1, MASTER_NODE_ID, "P") != POOL_CONTINUE)
+		return POOL_END;
+	if (pool_send_and_wait(qc, contents, len, -1, MASTER_NODE_ID, "P") != POOL_CONTINUE)
+		return POOL_END;
+
+	session_context->ignore_parse_complete++;
+	return POOL_CONTINUE;
+}
+
 /*
  * Find victim nodes by "decide by majority" rule and returns array
  * of victim node ids. If no victim is found, return NULL.
@@ -2968,3 +3167,119 @@ static int extract_ntuples(char *message)
 
 	return atoi(rows);
 }
+
+/*
+ * Remember session state changed by the queries in the parse tree
+ * list, which has to be undone by reset_query_list. See lazy_reset.
+ * If we cannot tell whether the query changes session state, it is
+ * assumed that anything could have been changed.
+ */
+static void track_session_state(List *parse_tree_list)
+{
+	POOL_SESSION_CONTEXT *session_context;
+	ListCell *cell;
+	Node *node;
+	int state = 0;
+
+	if (!pool_config->lazy_reset)
+		return;
+
+	/* Reset queries themselves are not tracked */
+	session_context = pool_get_session_context();
+	if (!session_context || session_context->reset_context)
+		return;
+
+	/* Unable to parse the query */
+	if (parse_tree_list == NIL)
+	{
+		pool_set_session_state(POOL_SESSION_STATE_UNKNOWN);
+		return;
+	}
+
+	foreach(cell, parse_tree_list)
+	{
+		node = (Node *) lfirst(cell);
+
+		/* EXPLAIN ANALYZE executes the query */
+		if (IsA(node, ExplainStmt))
+			node = ((ExplainStmt *)node)->query;
+
+		/*
+		 * The query of PREPARE runs at EXECUTE. Since the prepared
+		 * statement lives only in the session, it is enough to look
+		 * at it here, and EXECUTE itself need not be tracked.
+		 */
+		if (IsA(node, PrepareStmt))
+			node = ((PrepareStmt *)node)->query;
+
+		/* DECLARE CURSOR and COPY (SELECT ...) execute SELECT */
+		if (IsA(node, DeclareCursorStmt))
+		{
+			if (((DeclareCursorStmt *)node)->options & CURSOR_OPT_HOLD)
+				state |= POOL_SESSION_STATE_CURSOR;
+			node = ((DeclareCursorStmt *)node)->query;
+		}
+		else if (IsA(node, CopyStmt))
+		{
+			if (((CopyStmt *)node)->query == NULL)
+				continue;
+			node = ((CopyStmt *)node)->query;
+		}
+
+		if (IsA(node, SelectStmt) || IsA(node, InsertStmt) ||
+			IsA(node, UpdateStmt) || IsA(node, DeleteStmt))
+		{
+			/* SELECT INTO TEMP */
+			if (IsA(node, SelectStmt) && ((SelectStmt *)node)->intoClause &&
+				((SelectStmt *)node)->intoClause->rel->istemp)
+				state |= POOL_SESSION_STATE_TEMP;
+
+			if (pool_has_session_state_function(node))
+				state |= (POOL_SESSION_STATE_GUC | POOL_SESSION_STATE_LOCK);
+		}
+		else if (IsA(node, VariableSetStmt))
+		{
+			/* SET LOCAL is undone at the end of transaction */
+			if (!((VariableSetStmt *)node)->is_local)
+				state |= POOL_SESSION_STATE_GUC;
+		}
+		else if (IsA(node, CreateStmt))
+		{
+			if (((CreateStmt *)node)->relation->istemp)
+				state |= POOL_SESSION_STATE_TEMP;
+		}
+		else if (IsA(node, CreateSeqStmt))
+		{
+			if (((CreateSeqStmt *)node)->sequence->istemp)
+				state |= POOL_SESSION_STATE_TEMP;
+		}
+		else if (IsA(node, ViewStmt))
+		{
+			if (((ViewStmt *)node)->view->istemp)
+				state |= POOL_SESSION_STATE_TEMP;
+		}
+		else if (IsA(node, ListenStmt))
+		{
+			state |= POOL_SESSION_STATE_LISTEN;
+		}
+		else if (IsA(node, TransactionStmt) || IsA(node, VariableShowStmt) ||
+				 IsA(node, ExecuteStmt) || IsA(node, DeallocateStmt) ||
+				 IsA(node, ClosePortalStmt) ||
+				 IsA(node, FetchStmt) || IsA(node, UnlistenStmt) ||
+				 IsA(node, NotifyStmt) || IsA(node, LockStmt) ||
+				 IsA(node, DiscardStmt))
+		{
+			/*
+			 * These do not leave session state behind. Prepared
+			 * statements are deallocated by reset_backend() anyway.
+			 */
+		}
+		else
+		{
+			state |= POOL_SESSION_STATE_UNKNOWN;
+		}
+	}
+
+	if (state)
+		pool_set_session_state(state);
+}
@@ -273,6 +273,10 @@ pool_query_cache_lookup(POOL_CONNECTION *frontend, char *query, char *database,
 	if (! system_db_connection_exists())
 		return POOL_ERROR;		/* same as POOL_END ... at least for now */
 
+	/* query cache is looked up using the persistent connection */
+	if (pool_system_db_connection() == NULL)
+		return POOL_ERROR;
+
 	sql_len =
 		strlen(pool_config->system_db_schema) +
 		strlen(QUERY_CACHE_TABLE_NAME) +
@@ -96,7 +96,7 @@ void *pool_search_relcache(POOL_RELCACHE *relcache, POOL_CONNECTION_POOL *backen
 	char *dbname;
 	int i;
 	int maxrefcnt = INT_MAX;
-	char query[1024];
+	char query[MAX_QUERY_LENGTH];
 	POOL_SELECT_RESULT *res = NULL;
 	int index = 0;
 	int local_session_id;
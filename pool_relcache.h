@@ -31,6 +31,7 @@
  *-------------------------
 */
 #define MAX_ITEM_LENGTH	1024
+#define MAX_QUERY_LENGTH	2048	/* query to relation including table name */
 
 /* Relation lookup cache structure */
 
@@ -47,7 +48,7 @@ typedef struct {
 
 typedef struct {
 	int num;		/* number of cache items */
-	char sql[MAX_ITEM_LENGTH];	/* Query to relation */
+	char sql[MAX_QUERY_LENGTH];	/* Query to relation */
 	/*
 	 * User defined function to be called at data register.
 	 * Argument is POOL_SELECT_RESULT *.
@@ -32,7 +32,7 @@
 #include <errno.h>
 #include <stdlib.h>
 
-static int getInsertRule(ListCell *lc,List *list_t ,DistDefInfo *info, int div_key_num);
+static int getInsertRule(List *row, DistDefInfo *info, int div_key_num);
 static void examInsertStmt(Node *node,POOL_CONNECTION_POOL *backend,RewriteQuery *message);
 static void examSelectStmt(Node *node,POOL_CONNECTION_POOL *backend,RewriteQuery *message);
 static char *delimistr(char *str);
@@ -54,23 +54,18 @@ char *pool_error_message(char *message)
 
 /*
  *  search DistDefInfo(this info is build in starting process
- *  and get node id where a query send.
+ *  and get node id where a row of VALUES list is sent.
  */
-static int getInsertRule(ListCell *lc,List *list_t ,DistDefInfo *info,int div_key_num)
+static int getInsertRule(List *row, DistDefInfo *info, int div_key_num)
 {
 	int loop_counter = 0;
 	int node_number = -1;
-	ListCell *cell;
+	ListCell *lc;
 
-	if(list_t->length != 1)
+	if (!row || !IsA(row, List))
 		return -1;
 
-	cell = list_head(list_t);
-
-	if(!cell && !IsA(cell,List))
-		return 1;
-
-	foreach(lc,lfirst(cell))
+	foreach(lc, row)
 	{
 		A_Const *constant;
 		Value value;
@@ -123,6 +118,10 @@ static void examInsertStmt(Node *node,POOL_CONNECTION_POOL *backend, RewriteQuer
 	RangeVar *table;
 	int cell_num;
 	int node_number;
+	int num_nodes;
+	int i;
+	List *rows[MAX_NUM_BACKENDS];
+	SelectStmt *values;
 	DistDefInfo *info = NULL;
 	ListCell *lc = NULL;
 	List *list_t = NULL;
@@ -180,7 +179,7 @@ static void examInsertStmt(Node *node,POOL_CONNECTION_POOL *backend, RewriteQuer
 
 	/* number of target list */
 
-	if(list_t->length == 1 && IsA(lfirst(list_head(list_t)),List))
+	if(list_t->length >= 1 && IsA(lfirst(list_head(list_t)),List))
 	{
 		cell_num = ((List *) lfirst(list_head(list_t)))->length;
 	}
@@ -249,22 +248,78 @@ static void examInsertStmt(Node *node,POOL_CONNECTION_POOL *backend, RewriteQuer
 		return;
 	}
 
-	/* this loop get insert one args of divide rule */
-	node_number = getInsertRule(lc, list_t, info, div_key_num);
+	/*
+	 * Decide the node for each row of VALUES list. A multi-row INSERT
+	 * whose rows belong to different nodes is split into one INSERT
+	 * per node.
+	 */
+	for (i = 0; i < NUM_BACKENDS; i++)
+		rows[i] = NIL;
+
+	num_nodes = 0;
+	node_number = -1;
 
-	if (node_number < 0)
+	foreach(lc, list_t)
+	{
+		int n = getInsertRule((List *) lfirst(lc), info, div_key_num);
+
+		if (n < 0)
+		{
+			/* send  error message to frontend */
+			message->r_code = INSERT_SQL_RESTRICTION;
+			message->r_node = -1;
+			message->rewrite_query = pool_error_message("cannot get node_id from system db");
+			return;
+		}
+
+		if (rows[n] == NIL)
+			num_nodes++;
+		rows[n] = lappend(rows[n], lfirst(lc));
+		node_number = n;
+	}
+
+	if (num_nodes == 1)
+	{
+		pool_debug("insert node_number =%d",node_number);
+		message->r_code = 0;
+		message->r_node = node_number;
+		message->rewrite_query = nodeToString(node);
+		return;
+	}
+
+	if (MAJOR(backend) != PROTO_MAJOR_V3)
 	{
 		/* send  error message to frontend */
 		message->r_code = INSERT_SQL_RESTRICTION;
 		message->r_node = -1;
-		message->rewrite_query = pool_error_message("cannot get node_id from system db");
+		message->rewrite_query = pool_error_message("cannot split multi-row InsertStmt in protocol version 2");
 		return;
 	}
 
-	pool_debug("insert node_number =%d",node_number);
-	message->r_code = 0;
-	message->r_node = node_number;
-	message->rewrite_query = nodeToString(node);
+	/* rows returned by each node cannot be merged */
+	if (insert->returningList != NIL)
+	{
+		/* send  error message to frontend */
+		message->r_code = INSERT_SQL_RESTRICTION;
+		message->r_node = -1;
+		message->rewrite_query = pool_error_message("cannot split multi-row InsertStmt with RETURNING");
+		return;
+	}
+
+	values = (SelectStmt *) insert->selectStmt;
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		if (rows[i] == NIL)
+			continue;
+
+		values->valuesLists = rows[i];
+		message->split_query[i] = nodeToString(node);
+		pool_debug("insert split node_number =%d rows =%d", i, list_length(rows[i]));
+	}
+	values->valuesLists = list_t;
+
+	message->r_code = INSERT_SPLIT;
+	message->r_node = -1;
 }
 
 /* start of rewriting query */
@@ -299,6 +354,7 @@ static void initMessage(RewriteQuery *message)
 	message->dbname = NULL;
 	message->schemaname = NULL;
 	message->rewrite_query = NULL;
+	memset(message->split_query, 0, sizeof(message->split_query));
 	message->rewritelock = -1;
 	message->ignore_rewrite = -1;
 	message->ret_num = 0;
@@ -382,6 +438,12 @@ RewriteQuery *rewrite_query_stmt(Node *node,POOL_CONNECTION *frontend,POOL_CONNE
 				 * and execution status is received.
 				 */
 				POOL_CONNECTION_POOL_SLOT *system_db = pool_system_db_connection();
+
+				if (system_db == NULL)
+				{
+					message->status = POOL_ERROR;
+					break;
+				}
 				message->status = OneNode_do_command(frontend,
 													system_db->con,
 													message->rewrite_query,
@@ -432,6 +494,13 @@ RewriteQuery *rewrite_query_stmt(Node *node,POOL_CONNECTION *frontend,POOL_CONNE
 													message->rewrite_query,
 													backend->info->database);
 			}
+			else if (message->r_code == INSERT_SPLIT)
+			{
+				/* send the INSERT sentences split by dividing key */
+				message->status = pool_parallel_split_exec(frontend,
+														   backend,
+														   message->split_query);
+			}
 			else if (message->r_code == INSERT_SQL_RESTRICTION)
 			{
 				/* Restriction case of INSERT sentence */
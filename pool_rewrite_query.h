@@ -53,6 +53,7 @@
 #define SELECT_REWRITE 18
 #define SELECT_ANALYZE 19
 #define SELECT_DEFAULT_PREP 20
+#define INSERT_SPLIT 21
 
 /* build Sub-Select`s target List */
 typedef struct {
@@ -162,6 +163,7 @@ typedef struct {
 	char *schemaname;    /* schema */
 	char *dbname;        /* connect dbname */
 	char *rewrite_query; /* execute query */
+	char *split_query[MAX_NUM_BACKENDS]; /* per node INSERT of multi-row INSERT (INSERT_SPLIT) */
 	char table_state;    /* final state */
 	POOL_STATUS status;  /* return POOL_STATUS */
 	NodeTag type;        /* Query Type */
@@ -183,6 +185,7 @@ char *pool_error_message(char *message);
 extern int IsSelectpgcatalog(Node *node,POOL_CONNECTION_POOL *backend);
 extern RewriteQuery *is_parallel_query(Node *node,POOL_CONNECTION_POOL *backend);
 extern POOL_STATUS pool_parallel_exec(POOL_CONNECTION *frontend,POOL_CONNECTION_POOL *backend, char *string,Node *node,bool send_to_frontend);
+extern POOL_STATUS pool_parallel_split_exec(POOL_CONNECTION *frontend,POOL_CONNECTION_POOL *backend, char **queries);
 
 POOL_STATUS pool_do_parallel_query(POOL_CONNECTION *frontend,
 								   POOL_CONNECTION_POOL *backend,
@@ -33,6 +33,7 @@ typedef struct {
 	bool	has_system_catalog;		/* True if system catalog table is used */
 	bool	has_temp_table;		/* True if temporary table is used */
 	bool	has_function_call;	/* True if write function call is used */	
+	bool	has_session_state_function;	/* True if function changing session state is used */
 } SelectContext;
 
 static bool function_call_walker(Node *node, void *context);
@@ -40,6 +41,7 @@ static bool system_catalog_walker(Node *node, void *context);
 static bool is_system_catalog(char *table_name);
 static bool temp_table_walker(Node *node, void *context);
 static bool is_temp_table(char *table_name);
+static bool session_state_function_walker(Node *node, void *context);
 
 /*
  * Return true if this SELECT has function calls *and* supposed to
@@ -96,6 +98,49 @@ bool pool_has_temp_table(Node *node)
 	return ctx.has_temp_table;
 }
 
+/*
+ * Return true if this SELECT, INSERT, UPDATE or DELETE calls a
+ * function which changes session state, such as set_config() or
+ * pg_advisory_lock(), which survives the end of transaction.
+ */
+bool pool_has_session_state_function(Node *node)
+{
+	SelectContext	ctx;
+
+	ctx.has_session_state_function = false;
+
+	if (IsA(node, SelectStmt))
+	{
+		session_state_function_walker(node, &ctx);
+	}
+	else if (IsA(node, InsertStmt))
+	{
+		InsertStmt *stmt = (InsertStmt *)node;
+
+		session_state_function_walker(stmt->selectStmt, &ctx);
+		session_state_function_walker((Node *)stmt->returningList, &ctx);
+	}
+	else if (IsA(node, UpdateStmt))
+	{
+		UpdateStmt *stmt = (UpdateStmt *)node;
+
+		session_state_function_walker((Node *)stmt->targetList, &ctx);
+		session_state_function_walker(stmt->whereClause, &ctx);
+		session_state_function_walker((Node *)stmt->fromClause, &ctx);
+		session_state_function_walker((Node *)stmt->returningList, &ctx);
+	}
+	else if (IsA(node, DeleteStmt))
+	{
+		DeleteStmt *stmt = (DeleteStmt *)node;
+
+		session_state_function_walker((Node *)stmt->usingClause, &ctx);
+		session_state_function_walker(stmt->whereClause, &ctx);
+		session_state_function_walker((Node *)stmt->returningList, &ctx);
+	}
+
+	return ctx.has_session_state_function;
+}
+
 /*
  * Search function name in whilelist or blacklist regex array
  * Return 1 on success (found in list)
@@ -197,6 +242,49 @@ static bool function_call_walker(Node *node, void *context)
 	return raw_expression_tree_walker(node, function_call_walker, context);
 }
 
+/*
+ * Walker function to find a function call which changes session
+ * state.
+ */
+static bool session_state_function_walker(Node *node, void *context)
+{
+	SelectContext	*ctx = (SelectContext *) context;
+	static char *functions[] = {
+		"set_config",
+		"pg_advisory_lock",
+		"pg_advisory_lock_shared",
+		"pg_try_advisory_lock",
+		"pg_try_advisory_lock_shared",
+	};
+
+	if (node == NULL)
+		return false;
+
+	if (IsA(node, FuncCall))
+	{
+		FuncCall *fcall = (FuncCall *)node;
+		char *fname;
+		int length = list_length(fcall->funcname);
+		int i;
+
+		if (length > 0)
+		{
+			fname = strVal(llast(fcall->funcname));
+
+			for (i=0;i<sizeof(functions)/sizeof(functions[0]);i++)
+			{
+				if (!strcasecmp(fname, functions[i]))
+				{
+					pool_debug("session_state_function_walker: function name: %s", fname);
+					ctx->has_session_state_function = true;
+					return true;
+				}
+			}
+		}
+	}
+	return raw_expression_tree_walker(node, session_state_function_walker, context);
+}
+
 /*
  * Walker function to find a system catalog
  */
@@ -32,6 +32,7 @@
 extern bool pool_has_function_call(Node *node);
 extern bool pool_has_system_catalog(Node *node);
 extern bool pool_has_temp_table(Node *node);
+extern bool pool_has_session_state_function(Node *node);
 extern bool pool_has_pgpool_regclass(void);
 extern bool raw_expression_tree_walker(Node *node, bool (*walker) (), void *context);
 
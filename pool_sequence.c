@@ -0,0 +1,650 @@
+/* -*-pgsql-c-*- */
+/*
+ * $Header$
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2011	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_sequence.c: Assign SERIAL values to INSERT statements from
+ * blocks of sequence values preallocated on all DB nodes, so that
+ * concurrent INSERTs need not be serialized by insert_lock.
+ */
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "pool.h"
+#include "pool_sequence.h"
+#include "pool_relcache.h"
+#include "pool_config.h"
+#include "pool_proto_modules.h"
+#include "pool_session_context.h"
+#include "pool_select_walker.h"
+#include "parser/parser.h"
+#include "parser/pool_memory.h"
+
+typedef struct {
+	char	*attrname;	/* attribute name */
+	int		 attpos;	/* position of the attribute counting from 1 */
+	char	*seqname;	/* schema qualified sequence name as a literal */
+	char	*seqident;	/* schema qualified sequence name as an identifier */
+} SerialAttr;
+
+typedef struct {
+	int			natts;
+	bool		other_nextval;	/* triggers or rules may call nextval() */
+	SerialAttr	attr[1];
+} SerialRel;
+
+static void *serial_register_func(POOL_SELECT_RESULT *res);
+static void *serial_unregister_func(void *data);
+static SerialRel *serial_relcache_lookup(POOL_CONNECTION_POOL *backend, char *table);
+static POOL_SEQUENCE_BLOCK *find_sequence_block(char *dbname, char *seqname);
+static bool take_sequence_values(char *dbname, char *seqname, int n, long long *first);
+static void put_sequence_block(char *dbname, char *seqname, long long first, long long last,
+							   int n, long long *result);
+static POOL_STATUS get_sequence_values(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend,
+									   char *query, InsertStmt *node, int lock_kind, bool *locked,
+									   SerialAttr *attr, int n, long long *first, bool *found);
+static bool has_sequence_functions(char *query);
+static bool has_nextval_calls(char *query);
+static Node *makeSerialConst(long long value);
+
+static POOL_SEQUENCE_BLOCK *sequence_blocks;	/* on shared memory */
+
+/*
+ * Allocate sequence block area on shared memory. Called by pgpool
+ * main before forking children. Returns 0 on success.
+ */
+int pool_init_sequence_blocks(void)
+{
+	size_t size;
+
+	if (pool_config->sequence_prealloc_size <= 0)
+		return 0;
+
+	size = sizeof(POOL_SEQUENCE_BLOCK) * MAX_SEQUENCE_BLOCKS;
+	sequence_blocks = pool_shared_memory_create(size);
+	if (sequence_blocks == NULL)
+	{
+		pool_error("pool_init_sequence_blocks: failed to allocate sequence blocks");
+		return -1;
+	}
+	memset(sequence_blocks, 0, size);
+	return 0;
+}
+
+static void *
+serial_register_func(POOL_SELECT_RESULT *res)
+{
+/* Number of result columns included in res */
+#define NUM_COLS		6
+
+	SerialRel	*rel;
+	char		*seqname;
+	int			 i;
+
+	if (res->numrows == 0)
+		return NULL;
+
+	rel = (SerialRel *) malloc(sizeof(SerialRel) + sizeof(SerialAttr) * (res->numrows - 1));
+	if (rel == NULL)
+	{
+		pool_error("serial_register_func: malloc failed");
+		return NULL;
+	}
+
+	for (i = 0; i < res->numrows; i++)
+	{
+		rel->attr[i].attrname = strdup(res->data[i * NUM_COLS]);
+		rel->attr[i].attpos = atoi(res->data[i * NUM_COLS + 1]);
+		rel->attr[i].seqname = NULL;
+		rel->attr[i].seqident = NULL;
+
+		/* NULL means the sequence is unknown and we cannot handle it. */
+		seqname = res->data[i * NUM_COLS + 3];
+		if (seqname && strlen(seqname) < MAX_SEQUENCE_NAME_LEN &&
+			res->data[i * NUM_COLS + 4])
+		{
+			rel->attr[i].seqname = strdup(seqname);
+			rel->attr[i].seqident = strdup(res->data[i * NUM_COLS + 4]);
+		}
+
+		pool_debug("serial_register_func: attrname %s attpos %d seqname %s",
+				   rel->attr[i].attrname, rel->attr[i].attpos,
+				   rel->attr[i].seqname ? rel->attr[i].seqname : "NULL");
+	}
+
+	rel->natts = res->numrows;
+	rel->other_nextval = res->data[5] == NULL || atoi(res->data[5]) > 0;
+	return (void *) rel;
+}
+
+static void *
+serial_unregister_func(void *data)
+{
+	SerialRel	*rel = (SerialRel *) data;
+	int			 i;
+
+	if (rel == NULL)
+		return NULL;
+
+	for (i = 0; i < rel->natts; i++)
+	{
+		free(rel->attr[i].attrname);
+		free(rel->attr[i].seqname);
+		free(rel->attr[i].seqident);
+	}
+	free(rel);
+	return rel;
+}
+
+/*
+ * Look up SERIAL columns of the table. Columns whose default is not
+ * nextval() are not included. The sequence is taken from the
+ * dependency of the default expression, and is schema qualified and
+ * quoted as a literal so that it can be used both as the key of the
+ * block and as the argument of setval(), and as an identifier to read
+ * the sequence itself. The last column counts rules and triggers
+ * other than foreign key ones on the table, since they may call
+ * nextval() by themselves.
+ */
+static SerialRel *
+serial_relcache_lookup(POOL_CONNECTION_POOL *backend, char *table)
+{
+#define SERIALSEQ(name) "(SELECT " name \
+	" FROM pg_catalog.pg_depend dep, pg_catalog.pg_class s, pg_catalog.pg_namespace n" \
+	" WHERE dep.classid = 'pg_catalog.pg_attrdef'::pg_catalog.regclass AND dep.objid = d.oid" \
+	" AND dep.refclassid = 'pg_catalog.pg_class'::pg_catalog.regclass AND dep.refobjid = s.oid" \
+	" AND s.relkind = 'S' AND s.relnamespace = n.oid LIMIT 1)"
+
+#define SERIALSEQNAME SERIALSEQ("pg_catalog.quote_literal(pg_catalog.quote_ident(n.nspname) || '.' || pg_catalog.quote_ident(s.relname))") \
+	", " SERIALSEQ("pg_catalog.quote_ident(n.nspname) || '.' || pg_catalog.quote_ident(s.relname)") \
+	", (SELECT count(*) FROM pg_catalog.pg_trigger t, pg_catalog.pg_proc p" \
+	" WHERE t.tgrelid = c.oid AND t.tgfoid = p.oid AND p.proname !~ '^RI_FKey_')" \
+	" + CASE WHEN c.relhasrules THEN 1 ELSE 0 END"
+
+#define SERIALQUERY "SELECT a.attname, (SELECT count(*) FROM pg_catalog.pg_attribute a2" \
+	" WHERE a2.attrelid = a.attrelid AND a2.attnum >= 1 AND a2.attnum <= a.attnum AND a2.attisdropped = 'f')," \
+	" d.adsrc, " SERIALSEQNAME " FROM pg_catalog.pg_class c, pg_catalog.pg_attribute a, pg_catalog.pg_attrdef d" \
+	" WHERE c.oid = a.attrelid AND a.attrelid = d.adrelid AND a.attnum = d.adnum" \
+	" AND a.attnum >= 1 AND a.attisdropped = 'f' AND d.adsrc ~ 'nextval' AND c.relname = '%s'" \
+	" ORDER BY a.attnum"
+
+#define SERIALQUERY2 "SELECT a.attname, (SELECT count(*) FROM pg_catalog.pg_attribute a2" \
+	" WHERE a2.attrelid = a.attrelid AND a2.attnum >= 1 AND a2.attnum <= a.attnum AND a2.attisdropped = 'f')," \
+	" d.adsrc, " SERIALSEQNAME " FROM pg_catalog.pg_class c, pg_catalog.pg_attribute a, pg_catalog.pg_attrdef d" \
+	" WHERE c.oid = a.attrelid AND a.attrelid = d.adrelid AND a.attnum = d.adnum" \
+	" AND a.attnum >= 1 AND a.attisdropped = 'f' AND d.adsrc ~ 'nextval' AND c.oid = pgpool_regclass('%s')" \
+	" ORDER BY a.attnum"
+
+	static POOL_RELCACHE *relcache;
+
+	if (!relcache)
+	{
+		char *query;
+
+		if (pool_has_pgpool_regclass())
+			query = SERIALQUERY2;
+		else
+			query = SERIALQUERY;
+
+		relcache = pool_create_relcache(32, query,
+										serial_register_func, serial_unregister_func,
+										false);
+		if (relcache == NULL)
+		{
+			pool_error("serial_relcache_lookup: pool_create_relcache error");
+			return NULL;
+		}
+	}
+
+	return (SerialRel *) pool_search_relcache(relcache, backend, table);
+}
+
+/*
+ * Find the block of the sequence. Caller must hold SEQUENCE_BLOCK_SEM.
+ */
+static POOL_SEQUENCE_BLOCK *
+find_sequence_block(char *dbname, char *seqname)
+{
+	int i;
+
+	for (i = 0; i < MAX_SEQUENCE_BLOCKS; i++)
+	{
+		if (sequence_blocks[i].seqname[0] == '\0')
+			break;
+
+		if (!strcmp(sequence_blocks[i].seqname, seqname) &&
+			!strcmp(sequence_blocks[i].dbname, dbname))
+			return &sequence_blocks[i];
+	}
+	return NULL;
+}
+
+/*
+ * Take n consecutive values from the block of the sequence. Returns
+ * false if the block does not have enough values.
+ */
+static bool
+take_sequence_values(char *dbname, char *seqname, int n, long long *first)
+{
+	POOL_SEQUENCE_BLOCK *block;
+	bool found = false;
+
+	pool_semaphore_lock(SEQUENCE_BLOCK_SEM);
+
+	block = find_sequence_block(dbname, seqname);
+	if (block && block->last - block->next + 1 >= n)
+	{
+		*first = block->next;
+		block->next += n;
+		found = true;
+	}
+
+	pool_semaphore_unlock(SEQUENCE_BLOCK_SEM);
+
+	return found;
+}
+
+/*
+ * Replace the block of the sequence with a new one from first to last
+ * and take n values from it. Values left in the old block are just
+ * thrown away. If there's no room for a new sequence, the slot with
+ * the fewest values left is reused.
+ */
+static void
+put_sequence_block(char *dbname, char *seqname, long long first, long long last,
+				   int n, long long *result)
+{
+	POOL_SEQUENCE_BLOCK *block;
+	int i;
+
+	pool_semaphore_lock(SEQUENCE_BLOCK_SEM);
+
+	block = find_sequence_block(dbname, seqname);
+	if (block == NULL)
+	{
+		for (i = 0; i < MAX_SEQUENCE_BLOCKS; i++)
+		{
+			if (sequence_blocks[i].seqname[0] == '\0')
+			{
+				block = &sequence_blocks[i];
+				break;
+			}
+
+			if (block == NULL ||
+				sequence_blocks[i].last - sequence_blocks[i].next < block->last - block->next)
+				block = &sequence_blocks[i];
+		}
+		strlcpy(block->dbname, dbname, sizeof(block->dbname));
+		strlcpy(block->seqname, seqname, sizeof(block->seqname));
+	}
+
+	*result = first;
+	block->next = first + n;
+	block->last = last;
+
+	pool_semaphore_unlock(SEQUENCE_BLOCK_SEM);
+}
+
+/*
+ * Get n consecutive values of the sequence. If the block is exhausted,
+ * reserve a new block by advancing the sequence on the master and
+ * setting the same value on other nodes. This is done while holding
+ * the same lock as insert_lock so that INSERTs falling back to
+ * insert_lock see the same sequence value on all nodes. *locked tells
+ * whether the lock has been already taken for the statement.
+ *
+ * Since a block is a range of consecutive values, sequences whose
+ * increment is not 1 are not handled. *found is set to false if values
+ * could not be taken, and caller should fall back to insert_lock.
+ */
+static POOL_STATUS
+get_sequence_values(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend,
+					char *query, InsertStmt *node, int lock_kind, bool *locked,
+					SerialAttr *attr, int n, long long *first, bool *found)
+{
+	char *dbname = MASTER_CONNECTION(backend)->sp->database;
+	char *seqname = attr->seqname;
+	POOL_SELECT_RESULT *res;
+	POOL_STATUS status;
+	char qbuf[1024];
+	long long last;
+	int size;
+	int i;
+
+	*found = true;
+
+	if (take_sequence_values(dbname, seqname, n, first))
+		return POOL_CONTINUE;
+
+	if (!*locked)
+	{
+		status = insert_lock(frontend, backend, query, node, lock_kind);
+		if (status != POOL_CONTINUE)
+			return status;
+		*locked = true;
+	}
+
+	/* somebody may have refilled the block while we were waiting for the lock */
+	if (take_sequence_values(dbname, seqname, n, first))
+		return POOL_CONTINUE;
+
+	size = Max(pool_config->sequence_prealloc_size, n);
+
+	/* NULL is returned without calling nextval() unless increment is 1 */
+	snprintf(qbuf, sizeof(qbuf),
+			 "SELECT CASE WHEN increment_by = 1 THEN setval(%s, nextval(%s) + %d) END FROM %s",
+			 seqname, seqname, size - 1, attr->seqident);
+	per_node_statement_log(backend, MASTER_NODE_ID, qbuf);
+	status = do_query(MASTER(backend), qbuf, &res, MAJOR(backend));
+	if (status != POOL_CONTINUE)
+	{
+		if (res)
+			free_select_result(res);
+		return status;
+	}
+	if (res == NULL || res->numrows != 1 || res->data[0] == NULL)
+	{
+		pool_log("get_sequence_values: could not reserve values of sequence %s. use insert_lock instead", seqname);
+		if (res)
+			free_select_result(res);
+		*found = false;
+		return POOL_CONTINUE;
+	}
+	last = strtoll(res->data[0], NULL, 10);
+	free_select_result(res);
+
+	snprintf(qbuf, sizeof(qbuf), "SELECT setval(%s, %lld)", seqname, last);
+	for (i = 0; i < NUM_BACKENDS; i++)
+	{
+		bool ok;
+
+		if (!VALID_BACKEND(i) || IS_MASTER_NODE_ID(i))
+			continue;
+
+		per_node_statement_log(backend, i, qbuf);
+		status = do_query(CONNECTION(backend, i), qbuf, &res, MAJOR(backend));
+		ok = res && res->numrows == 1;
+		if (res)
+			free_select_result(res);
+		if (status != POOL_CONTINUE)
+			return status;
+		if (!ok)
+		{
+			pool_error("get_sequence_values: failed to set sequence %s on node %d. use insert_lock instead", seqname, i);
+			*found = false;
+			return POOL_CONTINUE;
+		}
+	}
+
+	pool_debug("get_sequence_values: reserved %s from %lld to %lld", seqname, last - size + 1, last);
+	put_sequence_block(dbname, seqname, last - size + 1, last, n, first);
+	return POOL_CONTINUE;
+}
+
+/*
+ * Returns true if the query may call currval() or lastval(). This is
+ * a plain text search, so a false positive just stops preassigning.
+ */
+static bool
+has_sequence_functions(char *query)
+{
+	char *p;
+
+	if (query == NULL)
+		return false;
+
+	for (p = query; *p; p++)
+	{
+		if (!strncasecmp(p, "currval", 7) || !strncasecmp(p, "lastval", 7))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Returns true if the query may call nextval() or setval() by itself.
+ * Values taken from blocks would not agree with them on every node, so
+ * such a query needs insert_lock.
+ */
+static bool
+has_nextval_calls(char *query)
+{
+	char *p;
+
+	if (query == NULL)
+		return false;
+
+	for (p = query; *p; p++)
+	{
+		if (!strncasecmp(p, "nextval", 7) || !strncasecmp(p, "setval", 6))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * Remember that currval() or lastval() is used in the session. Since
+ * preassigned values do not go through nextval(), they would return
+ * stale values or raise an error. So we stop preassigning for the
+ * rest of the session.
+ */
+void pool_check_sequence_functions(char *query)
+{
+	POOL_SESSION_CONTEXT *session_context;
+
+	if (sequence_blocks == NULL)
+		return;
+
+	session_context = pool_get_session_context();
+	if (!session_context || session_context->sequence_functions_used)
+		return;
+
+	if (has_sequence_functions(query))
+	{
+		pool_debug("pool_check_sequence_functions: currval() or lastval() is used. stop preassigning SERIAL values");
+		session_context->sequence_functions_used = true;
+	}
+}
+
+static Node *
+makeSerialConst(long long value)
+{
+	A_Const	*n = makeNode(A_Const);
+	char	 buf[32];
+
+	/* T_Float keeps values not fit in long on 32bit platforms */
+	snprintf(buf, sizeof(buf), "%lld", value);
+	n->val.type = T_Float;
+	n->val.val.str = pstrdup(buf);
+	return (Node *) n;
+}
+
+/*
+ * Rewrite INSERT ... VALUES so that every SERIAL column gets an
+ * explicit value from the preallocated blocks instead of calling
+ * nextval() on each node.
+ *
+ * INSERT INTO t1(c1) VALUES ('a'), ('b')
+ * rewrite to:
+ * INSERT INTO t1(c1, id) VALUES ('a', 101), ('b', 102)
+ *
+ * *assigned is set to true only if every SERIAL column left to its
+ * default got a value and nothing else may call nextval(): neither
+ * nextval() nor setval() in the statement, nor rules or triggers on
+ * the table. Then caller does not need insert_lock and needs to
+ * regenerate the query string from the rewritten node. Otherwise the
+ * node is left untouched and caller must take insert_lock. The lock
+ * may have been taken already to reserve a block, and taking it again
+ * in the same transaction is harmless.
+ */
+POOL_STATUS pool_assign_serial_values(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend,
+									  char *query, InsertStmt *node, int lock_kind, bool *assigned)
+{
+	POOL_SESSION_CONTEXT *session_context;
+	POOL_MEMORY_POOL *old_context;
+	POOL_STATUS status = POOL_CONTINUE;
+	SelectStmt *selectStmt;
+	SerialRel *rel;
+	ListCell *lc_row, *lc_val, *lc_col;
+	int *colpos = NULL;
+	long long *values = NULL;
+	bool locked = false;
+	char *table;
+	int total = 0;
+	int i, k;
+
+	*assigned = false;
+
+	if (sequence_blocks == NULL || MAJOR(backend) != PROTO_MAJOR_V3)
+		return POOL_CONTINUE;
+
+	/* INSERT ... SELECT and INSERT ... DEFAULT VALUES are not handled */
+	selectStmt = (SelectStmt *) node->selectStmt;
+	if (selectStmt == NULL || !IsA(selectStmt, SelectStmt) || selectStmt->valuesLists == NIL)
+		return POOL_CONTINUE;
+
+	session_context = pool_get_session_context();
+	if (!session_context)
+		return POOL_CONTINUE;
+
+	pool_check_sequence_functions(query);
+	if (session_context->sequence_functions_used || has_nextval_calls(query))
+		return POOL_CONTINUE;
+
+	old_context = pool_memory;
+	if (session_context->query_context)
+		pool_memory = session_context->query_context->memory_context;
+	else
+		pool_memory = session_context->memory_context;
+
+	table = nodeToString(node->relation);
+	rel = serial_relcache_lookup(backend, table);
+	if (rel == NULL || rel->other_nextval)
+		goto done;
+
+	colpos = palloc(sizeof(int) * rel->natts);
+	values = palloc(sizeof(long long) * rel->natts);
+
+	/* all SERIAL columns must be known before taking any values */
+	for (i = 0; i < rel->natts; i++)
+	{
+		if (rel->attr[i].seqname == NULL)
+			goto done;
+	}
+
+	for (i = 0; i < rel->natts; i++)
+	{
+		int need = 0;
+		bool found;
+
+		/*
+		 * colpos is the position of the column in each values list.
+		 * -1 means the column is not in the column list.
+		 */
+		if (node->cols != NIL)
+		{
+			colpos[i] = -1;
+			k = 0;
+			foreach (lc_col, node->cols)
+			{
+				ResTarget *col = lfirst(lc_col);
+
+				if (strcmp(rel->attr[i].attrname, col->name) == 0)
+				{
+					colpos[i] = k;
+					break;
+				}
+				k++;
+			}
+		}
+		else
+			colpos[i] = rel->attr[i].attpos - 1;
+
+		foreach (lc_row, selectStmt->valuesLists)
+		{
+			List *row = lfirst(lc_row);
+
+			if (colpos[i] < 0 || colpos[i] >= list_length(row) ||
+				IsA(list_nth(row, colpos[i]), SetToDefault))
+				need++;
+		}
+
+		if (need == 0)
+			continue;
+
+		status = get_sequence_values(frontend, backend, query, node, lock_kind, &locked,
+									 &rel->attr[i], need, &values[i], &found);
+		if (status != POOL_CONTINUE || !found)
+			goto done;
+		total += need;
+	}
+
+	/* every SERIAL column is given explicitly. nothing to assign. */
+	if (total == 0)
+		goto done;
+
+	/* now we have all values. rewrite the statement. */
+	for (i = 0; i < rel->natts; i++)
+	{
+		if (node->cols != NIL && colpos[i] < 0)
+		{
+			ResTarget *col = makeNode(ResTarget);
+
+			col->name = pstrdup(rel->attr[i].attrname);
+			col->indirection = NIL;
+			col->val = NULL;
+			node->cols = lappend(node->cols, col);
+		}
+
+		foreach (lc_row, selectStmt->valuesLists)
+		{
+			List *row = lfirst(lc_row);
+
+			if (colpos[i] < 0)
+				row = lappend(row, makeSerialConst(values[i]++));
+			else if (colpos[i] >= list_length(row))
+			{
+				/* fill columns before the SERIAL column with DEFAULT */
+				while (list_length(row) < colpos[i])
+					row = lappend(row, makeNode(SetToDefault));
+				row = lappend(row, makeSerialConst(values[i]++));
+			}
+			else
+			{
+				k = 0;
+				foreach (lc_val, row)
+				{
+					if (k++ == colpos[i])
+					{
+						if (IsA(lfirst(lc_val), SetToDefault))
+							lfirst(lc_val) = makeSerialConst(values[i]++);
+						break;
+					}
+				}
+			}
+			lfirst(lc_row) = row;
+		}
+	}
+	*assigned = true;
+
+done:
+	pool_memory = old_context;
+	return status;
+}
@@ -0,0 +1,54 @@
+/* -*-pgsql-c-*- */
+/*
+ *
+ * $Header$
+ *
+ * pgpool: a language independent connection pool server for PostgreSQL
+ * written by Tatsuo Ishii
+ *
+ * Copyright (c) 2003-2011	PgPool Global Development Group
+ *
+ * Permission to use, copy, modify, and distribute this software and
+ * its documentation for any purpose and without fee is hereby
+ * granted, provided that the above copyright notice appear in all
+ * copies and that both that copyright notice and this permission
+ * notice appear in supporting documentation, and that the name of the
+ * author not be used in advertising or publicity pertaining to
+ * distribution of the software without specific, written prior
+ * permission. The author makes no representations about the
+ * suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * pool_sequence.h.: pool_sequence.c related header file
+ *
+ */
+
+#ifndef POOL_SEQUENCE_H
+#define POOL_SEQUENCE_H
+#include "pool.h"
+#include "parser/parsenodes.h"
+
+/* max number of sequences whose preallocated blocks are kept */
+#define MAX_SEQUENCE_BLOCKS 128
+
+/* max length of sequence name including schema name and quotes */
+#define MAX_SEQUENCE_NAME_LEN 256
+
+/*
+ * A block of sequence values reserved on all DB nodes. Values from
+ * next to last are not handed out yet. The block is empty if next >
+ * last. Placed on shared memory and protected by SEQUENCE_BLOCK_SEM.
+ */
+typedef struct {
+	char dbname[SM_DATABASE];	/* database name */
+	char seqname[MAX_SEQUENCE_NAME_LEN];	/* sequence name */
+	long long next;		/* next value to be assigned */
+	long long last;		/* last value of the block */
+} POOL_SEQUENCE_BLOCK;
+
+extern int pool_init_sequence_blocks(void);
+extern POOL_STATUS pool_assign_serial_values(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend,
+											 char *query, InsertStmt *node, int lock_kind, bool *assigned);
+extern void pool_check_sequence_functions(char *query);
+
+#endif /* POOL_SEQUENCE_H */
@@ -112,6 +112,17 @@ void pool_init_session_context(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *
 	 * in UPDATE/DELETE.
 	 */
 	session_context->mismatch_ntuples = false;
+
+	/* No timestamp has been calculated for rewriting now() yet */
+	session_context->transaction_timestamp = 0;
+	session_context->clock_calibrated = false;
+
+	/* SERIAL values can be preassigned */
+	session_context->sequence_functions_used = false;
+	session_context->ignore_parse_complete = 0;
+
+	/* Frontend has not changed session state yet */
+	session_context->session_state = 0;
 }
 
 /*
@@ -510,6 +521,9 @@ POOL_SENT_MESSAGE *pool_create_sent_message(char kind, int len, char *contents,
 	msg->num_tsparams = num_tsparams;
 	msg->name = pool_memory_strdup(session_context->memory_context, name);
 	msg->query_context = query_context;
+	msg->serial_lock_kind = 0;
+	msg->serial_query = NULL;
+	msg->serial_bound = false;
 
 	return msg;
 }
@@ -804,6 +818,35 @@ void pool_copy_prep_where(bool *src, bool *dest)
 {
 	memcpy(dest, src, sizeof(bool)*MAX_NUM_BACKENDS);
 }
+
+/*
+ * Remember that the session state has been changed by the frontend.
+ * state is a bitmask of POOL_SESSION_STATE_* flags.
+ */
+void pool_set_session_state(int state)
+{
+	if (!session_context)
+	{
+		pool_error("pool_set_session_state: session context is not initialized");
+		return;
+	}
+	session_context->session_state |= state;
+}
+
+/*
+ * Return the session state changed by the frontend. If session
+ * context is not initialized, we don't know anything about the
+ * session.
+ */
+int pool_get_session_state(void)
+{
+	if (!session_context)
+	{
+		pool_error("pool_get_session_state: session context is not initialized");
+		return POOL_SESSION_STATE_UNKNOWN;
+	}
+	return session_context->session_state;
+}
 #ifdef NOT_USED
 /*
  * Add to send map a PREPARED statement
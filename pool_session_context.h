@@ -61,6 +61,12 @@ typedef struct {
 	int num_tsparams;
 	char *name;		/* object name of prepared statement or portal */
 	POOL_QUERY_CONTEXT *query_context;
+	int serial_lock_kind;	/* insert lock kind if SERIAL values were
+							 * preassigned in the statement, else 0 */
+	char *serial_query;		/* the statement before SERIAL values were
+							 * preassigned */
+	bool serial_bound;		/* statement with preassigned SERIAL values
+							 * has been bound */
 } POOL_SENT_MESSAGE;
 
 typedef struct {
@@ -72,6 +78,17 @@ typedef struct {
 /*
  * Per session context:
  */
+/*
+ * Session state changed by the frontend. Used to decide which queries
+ * in reset_query_list are needed if lazy_reset is enabled.
+ */
+#define POOL_SESSION_STATE_GUC		0x0001	/* SET, RESET or set_config() */
+#define POOL_SESSION_STATE_TEMP		0x0002	/* temporary tables, sequences or views */
+#define POOL_SESSION_STATE_LISTEN	0x0004	/* LISTEN */
+#define POOL_SESSION_STATE_CURSOR	0x0008	/* cursors WITH HOLD */
+#define POOL_SESSION_STATE_LOCK		0x0010	/* session level advisory locks */
+#define POOL_SESSION_STATE_UNKNOWN	0x0020	/* could not tell what was changed */
+
 typedef struct {
 	POOL_PROCESS_CONTEXT *process_context;		/* belonging process */
 	POOL_CONNECTION *frontend;	/* connection to frontend */
@@ -142,6 +159,38 @@ typedef struct {
 	 * If true, we are executing reset query list.
 	 */
 	bool reset_context;
+
+	/*
+	 * Locally calculated timestamp used to rewrite now() in current
+	 * transaction, in microseconds since the epoch. 0 if not
+	 * calculated yet.
+	 */
+	long long transaction_timestamp;
+
+	/*
+	 * True if the clock offset against the master node has been
+	 * measured in this session.
+	 */
+	bool clock_calibrated;
+
+	/*
+	 * True if currval() or lastval() has appeared in this session.
+	 * SERIAL values are not preassigned any more since they would
+	 * return values not assigned by nextval().
+	 */
+	bool sequence_functions_used;
+
+	/*
+	 * Number of ParseComplete messages to be discarded, which are
+	 * responses to Parse messages pgpool sent by itself.
+	 */
+	int ignore_parse_complete;
+
+	/*
+	 * Bitmask of POOL_SESSION_STATE_* flags. Session state changed
+	 * by the frontend which has to be undone by reset_query_list.
+	 */
+	int session_state;
 } POOL_SESSION_CONTEXT;
 
 extern void pool_init_session_context(POOL_CONNECTION *frontend, POOL_CONNECTION_POOL *backend);
@@ -182,6 +231,8 @@ extern void pool_unset_command_success(void);
 extern void pool_set_command_success(void);
 extern bool pool_is_command_success(void);
 extern void pool_copy_prep_where(bool *src, bool *dest);
+extern void pool_set_session_state(int state);
+extern int pool_get_session_state(void);
 #ifdef NOT_USED
 extern void pool_add_prep_where(char *name, bool *map);
 extern bool *pool_get_prep_where(char *name);
@@ -48,6 +48,7 @@
 	} while (0);
 
 #include <arpa/inet.h> /* for htonl() */
+#include <sys/socket.h>
 
 /* Major/minor codes to negotiate SSL prior to startup packet */
 #define NEGOTIATE_SSL_CODE ( 1234<<16 | 5679 )
@@ -55,9 +56,40 @@
 /* enum flag for differentiating server->client vs client->server SSL */
 enum ssl_conn_type { ssl_conn_clientserver, ssl_conn_serverclient };
 
+/*
+ * SSL session of a backend kept for resumption. Looked up by the
+ * address of the backend, since persistent connections to the system
+ * DB do not have a node id.
+ */
+typedef struct {
+	struct sockaddr_storage addr;	/* address of the backend */
+	socklen_t addrlen;				/* 0 if this slot is unused */
+	SSL_SESSION *session;
+} backend_ssl_session;
+
+/*
+ * SSL contexts shared by all connections of this process. Created by
+ * pgpool main before forking children, so that children share the
+ * session ticket keys and a client can resume its session with any
+ * child.
+ */
+static SSL_CTX *serverclient_ctx = NULL;
+static SSL_CTX *clientserver_ctx = NULL;
+static backend_ssl_session backend_sessions[MAX_NUM_BACKENDS];
+static int next_backend_session = 0;
+
+/* create the shared ssl context if not yet.  returns nonzero on error */
+static int create_ssl_ctx(enum ssl_conn_type conntype);
+
 /* perform per-connection ssl initialization.  returns nonzero on error */
 static int init_ssl_ctx(POOL_CONNECTION *cp, enum ssl_conn_type conntype);
 
+/* find or allocate the session slot of the backend */
+static backend_ssl_session *lookup_backend_session(POOL_CONNECTION *cp, bool create);
+
+/* remember the session of the backend connection for resumption */
+static void save_backend_session(POOL_CONNECTION *cp);
+
 /* OpenSSL error message */
 static void perror_ssl(const char *context);
 
@@ -82,6 +114,10 @@ void pool_ssl_negotiate_clientserver(POOL_CONNECTION *cp) {
 			SSL_RETURN_VOID_IF( (SSL_connect(cp->ssl) < 0),
 			                    "SSL_connect");
 			cp->ssl_active = 1;
+			if (SSL_session_reused(cp->ssl))
+				pool_debug("pool_ssl: client->server SSL session resumed");
+			else
+				save_backend_session(cp);
 			break;
 		case 'N':
 			/*
@@ -112,17 +148,31 @@ void pool_ssl_negotiate_serverclient(POOL_CONNECTION *cp) {
 		SSL_set_fd(cp->ssl, cp->fd);
 		SSL_RETURN_VOID_IF( (SSL_accept(cp->ssl) < 0), "SSL_accept");
 		cp->ssl_active = 1;
+		if (SSL_session_reused(cp->ssl))
+			pool_debug("pool_ssl: server->client SSL session resumed");
 	}
 }
 
+/*
+ * Create the SSL contexts shared by connections. Called by pgpool main
+ * before forking children. If it fails here, contexts are created at
+ * the first connection of each child instead.
+ */
+void pool_ssl_init_ctx(void) {
+	if (!pool_config->ssl)
+		return;
+
+	create_ssl_ctx(ssl_conn_serverclient);
+	create_ssl_ctx(ssl_conn_clientserver);
+}
+
 void pool_ssl_close(POOL_CONNECTION *cp) {
 	if (cp->ssl) { 
 		SSL_shutdown(cp->ssl); 
 		SSL_free(cp->ssl); 
 	} 
 
-	if (cp->ssl_ctx) 
-		SSL_CTX_free(cp->ssl_ctx);
+	/* cp->ssl_ctx is shared. Do not free it */
 }
 
 int pool_ssl_read(POOL_CONNECTION *cp, void *buf, int size) {
@@ -181,24 +231,51 @@ int pool_ssl_write(POOL_CONNECTION *cp, const void *buf, int size) {
 	return SSL_write(cp->ssl, buf, size);
 }
 
-static int init_ssl_ctx(POOL_CONNECTION *cp, enum ssl_conn_type conntype) {
+static int create_ssl_ctx(enum ssl_conn_type conntype) {
 	int error = 0;
 	char *cacert = NULL, *cacert_dir = NULL;
+	SSL_CTX *ctx;
+	static const unsigned char sid_ctx[] = "pgpool";
 
-	/* initialize SSL members */
-	cp->ssl_ctx = SSL_CTX_new(TLSv1_method());
-	SSL_RETURN_ERROR_IF( (! cp->ssl_ctx), "SSL_CTX_new" );
+	if ( conntype == ssl_conn_serverclient ) {
+		if (serverclient_ctx)
+			return 0;
+	} else {
+		if (clientserver_ctx)
+			return 0;
+	}
+
+	ctx = SSL_CTX_new(TLSv1_method());
+	SSL_RETURN_ERROR_IF( (! ctx), "SSL_CTX_new" );
 
 	if ( conntype == ssl_conn_serverclient) {
-		error = SSL_CTX_use_certificate_file(cp->ssl_ctx,
+		error = SSL_CTX_use_certificate_file(ctx,
 		                                     pool_config->ssl_cert,
 		                                     SSL_FILETYPE_PEM);
-		SSL_RETURN_ERROR_IF( (error <= 0), "Loading SSL certificate");
+		if (error <= 0) {
+			perror_ssl("Loading SSL certificate");
+			SSL_CTX_free(ctx);
+			return -1;
+		}
 
-		error = SSL_CTX_use_PrivateKey_file(cp->ssl_ctx,
+		error = SSL_CTX_use_PrivateKey_file(ctx,
 		                                    pool_config->ssl_key,
 		                                    SSL_FILETYPE_PEM);
-		SSL_RETURN_ERROR_IF( (error <= 0), "Loading SSL private key");
+		if (error <= 0) {
+			perror_ssl("Loading SSL private key");
+			SSL_CTX_free(ctx);
+			return -1;
+		}
+
+		/*
+		 * Enable the session cache of this process. Session tickets are
+		 * enabled by default and work across children because they share
+		 * the ticket keys of this context.
+		 */
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+		SSL_CTX_set_session_id_context(ctx, sid_ctx, sizeof(sid_ctx) - 1);
+
+		serverclient_ctx = ctx;
 	} else {
 		/* set extra verification if ssl_ca_cert or ssl_ca_cert_dir are set */
 		if (strlen(pool_config->ssl_ca_cert))
@@ -207,20 +284,101 @@ static int init_ssl_ctx(POOL_CONNECTION *cp, enum ssl_conn_type conntype) {
 			cacert_dir = pool_config->ssl_ca_cert_dir;
     
 		if ( cacert || cacert_dir ) {
-			error = (!SSL_CTX_load_verify_locations(cp->ssl_ctx,
+			error = (!SSL_CTX_load_verify_locations(ctx,
 			                                        cacert,
 			                                        cacert_dir));
-			SSL_RETURN_ERROR_IF(error, "SSL verification setup");
-			SSL_CTX_set_verify(cp->ssl_ctx, SSL_VERIFY_PEER, NULL);
+			if (error) {
+				perror_ssl("SSL verification setup");
+				SSL_CTX_free(ctx);
+				return -1;
+			}
+			SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, NULL);
 		}
+
+		/* we keep backend sessions by ourselves. see save_backend_session() */
+		SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_CLIENT|SSL_SESS_CACHE_NO_INTERNAL_STORE);
+
+		clientserver_ctx = ctx;
 	}
 
+	return 0;
+}
+
+static int init_ssl_ctx(POOL_CONNECTION *cp, enum ssl_conn_type conntype) {
+	backend_ssl_session *bs;
+
+	/* initialize SSL members */
+	if (create_ssl_ctx(conntype))
+		return -1;
+
+	if ( conntype == ssl_conn_serverclient )
+		cp->ssl_ctx = serverclient_ctx;
+	else
+		cp->ssl_ctx = clientserver_ctx;
+
 	cp->ssl = SSL_new(cp->ssl_ctx);
 	SSL_RETURN_ERROR_IF( (! cp->ssl), "SSL_new");
 
+	/* try to resume the last session with the backend */
+	if ( conntype == ssl_conn_clientserver ) {
+		bs = lookup_backend_session(cp, false);
+		if (bs && bs->session)
+			SSL_set_session(cp->ssl, bs->session);
+	}
+
 	return 0;
 }
 
+static backend_ssl_session *lookup_backend_session(POOL_CONNECTION *cp, bool create) {
+	struct sockaddr_storage addr;
+	socklen_t addrlen = sizeof(addr);
+	backend_ssl_session *bs;
+	int i;
+
+	if (getpeername(cp->fd, (struct sockaddr *)&addr, &addrlen) < 0)
+		return NULL;
+
+	for (i = 0; i < MAX_NUM_BACKENDS; i++) {
+		bs = &backend_sessions[i];
+		if (bs->addrlen == addrlen && memcmp(&bs->addr, &addr, addrlen) == 0)
+			return bs;
+	}
+
+	if (!create)
+		return NULL;
+
+	/* reuse slots in turn */
+	bs = &backend_sessions[next_backend_session];
+	next_backend_session = (next_backend_session + 1) % MAX_NUM_BACKENDS;
+
+	if (bs->session) {
+		SSL_SESSION_free(bs->session);
+		bs->session = NULL;
+	}
+	memcpy(&bs->addr, &addr, addrlen);
+	bs->addrlen = addrlen;
+	return bs;
+}
+
+static void save_backend_session(POOL_CONNECTION *cp) {
+	backend_ssl_session *bs;
+	SSL_SESSION *session;
+
+	session = SSL_get1_session(cp->ssl);
+	if (!session)
+		return;
+
+	bs = lookup_backend_session(cp, true);
+	if (!bs) {
+		SSL_SESSION_free(session);
+		return;
+	}
+
+	if (bs->session)
+		SSL_SESSION_free(bs->session);
+	bs->session = session;
+}
+
 static void perror_ssl(const char *context) {
 	unsigned long err;
 	static const char *no_err_reason = "no SSL error reported";
@@ -263,6 +421,8 @@ void pool_ssl_negotiate_clientserver(POOL_CONNECTION *cp) {
 	cp->ssl_active = -1;
 }
 
+void pool_ssl_init_ctx(void) { return; }
+
 void pool_ssl_close(POOL_CONNECTION *cp) { return; }
 
 int pool_ssl_read(POOL_CONNECTION *cp, void *buf, int size) {
@@ -124,7 +124,7 @@ void pool_close(POOL_CONNECTION *cp)
 */
 int pool_read(POOL_CONNECTION *cp, void *buf, int len)
 {
-	static char readbuf[READBUFSZ];
+	static char readbuf[SSL_READBUFSZ];
 
 	int consume_size;
 	int readlen;
@@ -137,7 +137,7 @@ int pool_read(POOL_CONNECTION *cp, void *buf, int len)
 	{
 		if (pool_check_fd(cp))
 		{
-			if (!IS_MASTER_NODE_ID(cp->db_node_id))
+			if (!IS_MASTER_NODE_ID(cp->db_node_id) && !health_check_timed_out())
 			{
 				pool_log("pool_read: data is not ready in DB node: %d. abort this session",
 						 cp->db_node_id);
@@ -151,7 +151,8 @@ int pool_read(POOL_CONNECTION *cp, void *buf, int len)
 		}
 
 		if (cp->ssl_active > 0) {
-		  readlen = pool_ssl_read(cp, readbuf, READBUFSZ);
+		  /* read a whole SSL record at once */
+		  readlen = pool_ssl_read(cp, readbuf, SSL_READBUFSZ);
 		} else {
 		  readlen = read(cp->fd, readbuf, READBUFSZ);
 		}
@@ -252,7 +253,7 @@ char *pool_read2(POOL_CONNECTION *cp, int len)
 	{
 		if (pool_check_fd(cp))
 		{
-			if (!IS_MASTER_NODE_ID(cp->db_node_id))
+			if (!IS_MASTER_NODE_ID(cp->db_node_id) && !health_check_timed_out())
 			{
 				pool_log("pool_read2: data is not ready in DB node:%d. abort this session",
 						 cp->db_node_id);
@@ -600,7 +601,7 @@ char *pool_read_string(POOL_CONNECTION *cp, int *len, int line)
 	{
 		if (pool_check_fd(cp))
 		{
-			if (!IS_MASTER_NODE_ID(cp->db_node_id))
+			if (!IS_MASTER_NODE_ID(cp->db_node_id) && !health_check_timed_out())
 			{
 				pool_log("pool_read_string: data is not ready in DB node:%d. abort this session",
 						 cp->db_node_id);
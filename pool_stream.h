@@ -27,6 +27,7 @@
 #define POOL_STREAM_H
 
 #define READBUFSZ 1024
+#define SSL_READBUFSZ 16384	/* max size of SSL record */
 #define WRITEBUFSZ 8192
 
 /*
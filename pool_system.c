@@ -28,9 +28,29 @@
 #include "pool.h"
 #include "pool_config.h"
 
+/*
+ * Hash index over dist_def_slot/repli_def_slot keyed by (dbname,
+ * schema_name, table_name). Each bucket holds the slot index of the
+ * first entry, and next[] chains entries sharing a bucket. -1
+ * terminates a chain.
+ */
+typedef struct {
+	int size;		/* number of buckets (power of 2). 0 if not built */
+	int *bucket;	/* head slot index of each bucket */
+	int *next;		/* next slot index in the same bucket */
+} DefHashIndex;
+
+static DefHashIndex dist_def_index;
+static DefHashIndex repli_def_index;
+
 static int create_prepared_statement(DistDefInfo *dist_info);
 static int  get_col_list(DistDefInfo *info);
 static int  get_col_list2(RepliDefInfo *info);
+static unsigned int def_hash(const char *dbname, const char *schema_name, const char *table_name);
+static int build_def_index(DefHashIndex *index, int num, void *slot, size_t slot_size);
+static void free_def_index(DefHashIndex *index);
+static void free_dist_def_info(SystemDBInfo *info);
+static void free_repli_def_info(SystemDBInfo *info);
 
 static
 int  get_col_list(DistDefInfo *info)
@@ -199,6 +219,10 @@ int pool_memset_system_db_info (SystemDBInfo *info)
 			return -1;
 	}
 
+	/* discard rules loaded previously (reload case) */
+	free_dist_def_info(info);
+	free_repli_def_info(info);
+
   /* get distribution rules */
 	snprintf(sql,
 			 sizeof(sql),
@@ -216,7 +240,7 @@ int pool_memset_system_db_info (SystemDBInfo *info)
 		info->dist_def_num = PQntuples(result);
 		if (info->dist_def_num != 0)
 		{
-			dist_info = malloc(sizeof(DistDefInfo) * info->dist_def_num);
+			dist_info = calloc(info->dist_def_num, sizeof(DistDefInfo));
 		}
 
 		if (dist_info == NULL && info->dist_def_num != 0)
@@ -342,6 +366,13 @@ int pool_memset_system_db_info (SystemDBInfo *info)
 
 	PQclear(result);
 
+	if (build_def_index(&dist_def_index, info->dist_def_num,
+						info->dist_def_slot, sizeof(DistDefInfo)) < 0)
+	{
+		pool_close_libpq_connection();
+		return -1;
+	}
+
   /* get replication rules */
 	snprintf(sql2,
 			 sizeof(sql2),
@@ -365,7 +396,7 @@ int pool_memset_system_db_info (SystemDBInfo *info)
 		info->repli_def_num = PQntuples(result);
 		if (info->repli_def_num != 0)
 		{
-			repli_info = malloc(sizeof(RepliDefInfo) * info->repli_def_num);
+			repli_info = calloc(info->repli_def_num, sizeof(RepliDefInfo));
 		}
 
 		if (repli_info == NULL && info->repli_def_num != 0)
@@ -465,10 +496,188 @@ int pool_memset_system_db_info (SystemDBInfo *info)
 
 	PQclear(result);
 
+	if (build_def_index(&repli_def_index, info->repli_def_num,
+						info->repli_def_slot, sizeof(RepliDefInfo)) < 0)
+	{
+		pool_close_libpq_connection();
+		return -1;
+	}
+
 	pool_close_libpq_connection();
 	return i;
 }
 
+/*
+ * def_hash:
+ *    Computes hash value of (dbname, schema_name, table_name) using
+ *    FNV-1a. A separator is mixed in between the names so that
+ *    ("ab", "c") and ("a", "bc") hash differently.
+ */
+static unsigned int def_hash(const char *dbname, const char *schema_name, const char *table_name)
+{
+	const char *names[3];
+	const unsigned char *p;
+	unsigned int h = 2166136261U;
+	int i;
+
+	names[0] = dbname;
+	names[1] = schema_name;
+	names[2] = table_name;
+
+	for (i = 0; i < 3; i++)
+	{
+		for (p = (const unsigned char *)names[i]; *p; p++)
+		{
+			h ^= *p;
+			h *= 16777619U;
+		}
+		h ^= '.';
+		h *= 16777619U;
+	}
+	return h;
+}
+
+/*
+ * build_def_index:
+ *    Builds hash index for the rule array "slot" which has "num"
+ *    entries of "slot_size" bytes each. DistDefInfo and RepliDefInfo
+ *    both start with dbname, schema_name and table_name, so the
+ *    entries are accessed through DistDefInfo.
+ *    Returns 0 on success, -1 on error.
+ */
+static int build_def_index(DefHashIndex *index, int num, void *slot, size_t slot_size)
+{
+	int size;
+	int i;
+
+	free_def_index(index);
+
+	if (num <= 0)
+		return 0;
+
+	/* keep load factor under 0.5 */
+	for (size = 16; size < num * 2; size <<= 1)
+		;
+
+	index->bucket = malloc(sizeof(int) * size);
+	index->next = malloc(sizeof(int) * num);
+	if (index->bucket == NULL || index->next == NULL)
+	{
+		pool_error("build_def_index: malloc failed: %s", strerror(errno));
+		free_def_index(index);
+		return -1;
+	}
+
+	for (i = 0; i < size; i++)
+		index->bucket[i] = -1;
+
+	/* insert in reverse order so that the first entry wins on duplicates */
+	for (i = num - 1; i >= 0; i--)
+	{
+		DistDefInfo *d = (DistDefInfo *)((char *)slot + slot_size * i);
+		unsigned int h = def_hash(d->dbname, d->schema_name, d->table_name) & (size - 1);
+
+		index->next[i] = index->bucket[h];
+		index->bucket[h] = i;
+	}
+
+	index->size = size;
+	return 0;
+}
+
+/*
+ * free_def_index:
+ *    Discards hash index.
+ */
+static void free_def_index(DefHashIndex *index)
+{
+	free(index->bucket);
+	free(index->next);
+	index->bucket = NULL;
+	index->next = NULL;
+	index->size = 0;
+}
+
+/*
+ * free_dist_def_info:
+ *    Discards distribution rules and its index.
+ */
+static void free_dist_def_info(SystemDBInfo *info)
+{
+	int i, j;
+
+	free_def_index(&dist_def_index);
+
+	if (info->dist_def_slot == NULL)
+		return;
+
+	for (i = 0; i < info->dist_def_num; i++)
+	{
+		DistDefInfo *d = &info->dist_def_slot[i];
+
+		free(d->dbname);
+		free(d->schema_name);
+		free(d->table_name);
+		free(d->dist_key_col_name);
+		free(d->dist_def_func);
+		free(d->prepare_name);
+		if (d->col_list)
+		{
+			for (j = 0; j < d->col_num; j++)
+				free(d->col_list[j]);
+			free(d->col_list);
+		}
+		if (d->type_list)
+		{
+			for (j = 0; j < d->col_num; j++)
+				free(d->type_list[j]);
+			free(d->type_list);
+		}
+	}
+	free(info->dist_def_slot);
+	info->dist_def_slot = NULL;
+	info->dist_def_num = 0;
+}
+
+/*
+ * free_repli_def_info:
+ *    Discards replication rules and its index.
+ */
+static void free_repli_def_info(SystemDBInfo *info)
+{
+	int i, j;
+
+	free_def_index(&repli_def_index);
+
+	if (info->repli_def_slot == NULL)
+		return;
+
+	for (i = 0; i < info->repli_def_num; i++)
+	{
+		RepliDefInfo *r = &info->repli_def_slot[i];
+
+		free(r->dbname);
+		free(r->schema_name);
+		free(r->table_name);
+		free(r->prepare_name);
+		if (r->col_list)
+		{
+			for (j = 0; j < r->col_num; j++)
+				free(r->col_list[j]);
+			free(r->col_list);
+		}
+		if (r->type_list)
+		{
+			for (j = 0; j < r->col_num; j++)
+				free(r->type_list[j]);
+			free(r->type_list);
+		}
+	}
+	free(info->repli_def_slot);
+	info->repli_def_slot = NULL;
+	info->repli_def_num = 0;
+}
+
 /*
  * pool_get_dist_def_info:
  *    Looks up distribution rule with dbname, schema_name and table_name.
@@ -476,7 +685,6 @@ int pool_memset_system_db_info (SystemDBInfo *info)
 DistDefInfo *pool_get_dist_def_info (char *dbname, char *schema_name, char *table_name)
 {
 	int i;
-	int dist_def_num = system_db_info->info->dist_def_num;
 	char *public ="public";
 
 	if (!dbname || !table_name)
@@ -489,21 +697,19 @@ DistDefInfo *pool_get_dist_def_info (char *dbname, char *schema_name, char *tabl
 		schema_name = public;
 	}
 
-	for (i = 0; i < dist_def_num; i++)
-	{
-		char *mem_dbname;
-		char *mem_schema_name;
-		char *mem_table_name;
+	if (dist_def_index.size == 0)
+		return NULL;
 
-		mem_dbname = system_db_info->info->dist_def_slot[i].dbname;
-		mem_schema_name = system_db_info->info->dist_def_slot[i].schema_name;
-		mem_table_name  = system_db_info->info->dist_def_slot[i].table_name;
+	i = dist_def_index.bucket[def_hash(dbname, schema_name, table_name) & (dist_def_index.size - 1)];
+	for (; i >= 0; i = dist_def_index.next[i])
+	{
+		DistDefInfo *d = &system_db_info->info->dist_def_slot[i];
 
-		if ((strcmp(mem_dbname, dbname) == 0) &&
-			(strcmp(mem_schema_name, schema_name) == 0) &&
-			(strcmp(mem_table_name, table_name) ==0))
+		if ((strcmp(d->table_name, table_name) == 0) &&
+			(strcmp(d->schema_name, schema_name) == 0) &&
+			(strcmp(d->dbname, dbname) == 0))
 		{
-			return &system_db_info->info->dist_def_slot[i];
+			return d;
 		}
 	}
 	return NULL;
@@ -516,7 +722,6 @@ DistDefInfo *pool_get_dist_def_info (char *dbname, char *schema_name, char *tabl
 RepliDefInfo *pool_get_repli_def_info (char *dbname, char *schema_name, char *table_name)
 {
 	int i;
-	int repli_def_num = system_db_info->info->repli_def_num;
 	char *public ="public";
 
 	if (!dbname || !table_name)
@@ -529,21 +734,19 @@ RepliDefInfo *pool_get_repli_def_info (char *dbname, char *schema_name, char *ta
 		schema_name = public;
 	}
 
-	for (i = 0; i < repli_def_num; i++)
-	{
-		char *mem_dbname;
-		char *mem_schema_name;
-		char *mem_table_name;
+	if (repli_def_index.size == 0)
+		return NULL;
 
-		mem_dbname = system_db_info->info->repli_def_slot[i].dbname;
-		mem_schema_name = system_db_info->info->repli_def_slot[i].schema_name;
-		mem_table_name  = system_db_info->info->repli_def_slot[i].table_name;
+	i = repli_def_index.bucket[def_hash(dbname, schema_name, table_name) & (repli_def_index.size - 1)];
+	for (; i >= 0; i = repli_def_index.next[i])
+	{
+		RepliDefInfo *r = &system_db_info->info->repli_def_slot[i];
 
-		if ((strcmp(mem_dbname, dbname) == 0) &&
-			(strcmp(mem_schema_name, schema_name) == 0) &&
-			(strcmp(mem_table_name, table_name) ==0))
+		if ((strcmp(r->table_name, table_name) == 0) &&
+			(strcmp(r->schema_name, schema_name) == 0) &&
+			(strcmp(r->dbname, dbname) == 0))
 		{
-			return &system_db_info->info->repli_def_slot[i];
+			return r;
 		}
 	}
 	return NULL;
@@ -617,10 +820,22 @@ void pool_close_libpq_connection(void)
 
 /*
  * pool_system_db_connection:
- *     Returns persistent connection to the system DB
+ *     Returns persistent connection to the system DB. The connection
+ *     is made on first use so that a new child does not connect to
+ *     the system DB until it needs to. Returns NULL on failure.
  */
 POOL_CONNECTION_POOL_SLOT *pool_system_db_connection(void)
 {
+	if (system_db_info->connection == NULL)
+	{
+		system_db_info->connection = make_persistent_db_connection(-1, pool_config->system_db_hostname,
+																   pool_config->system_db_port,
+																   pool_config->system_db_dbname,
+																   pool_config->system_db_user,
+																   pool_config->system_db_password);
+		if (system_db_info->connection == NULL)
+			pool_error("Could not make persistent system DB connection");
+	}
 	return system_db_info->connection;
 }
 
@@ -20,6 +20,7 @@
  *
  */
 #include <arpa/inet.h>
+#include <sys/time.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -51,6 +52,8 @@ typedef struct {
 	int						 num_params;	/* num of original params (for Parse) */
 	bool		 			 rewrite_to_params;
 	bool		 			 rewrite;		/* has rewritten? */
+	bool					 local_timestamp;	/* timestamp is calculated locally */
+	bool					 in_default;	/* walking DEFAULT expression */
 	List					*params;		/* list of additional params */
 } TSRewriteContext;
 
@@ -63,13 +66,28 @@ static bool rewrite_timestamp_walker(Node *node, void *context);
 static bool rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext *ctx);
 static bool rewrite_timestamp_update(UpdateStmt *u_stmt, TSRewriteContext *ctx);
 static char *get_current_timestamp(POOL_CONNECTION_POOL *backend);
+static bool use_local_timestamp(POOL_CONNECTION_POOL *backend);
+static bool calibrate_clock(POOL_CONNECTION_POOL *backend);
+static char *get_local_timestamp(POOL_CONNECTION_POOL *backend);
 static Node *makeTsExpr(TSRewriteContext *ctx);
+static Node *makeTsCastExpr(TSRewriteContext *ctx);
+static Node *makeDefaultExpr(TSRewriteContext *ctx, char *expression);
 static A_Const *makeStringConstFromQuery(POOL_CONNECTION_POOL *backend, char *expression);
 bool raw_expression_tree_walker(Node *node, bool (*walker) (), void *context);
 
 #define		MAX_RELCACHE 32
 POOL_RELCACHE	*ts_relcache;
 
+/*
+ * Local timestamp calculation (timestamp_calibration_interval > 0).
+ * The master's clock is estimated from the local clock plus
+ * clock_offset, which is calibrated against the master periodically.
+ */
+static bool		 clock_offset_valid = false;
+static long long clock_offset;		/* master clock - local clock in usec */
+static time_t	 clock_calibrated;	/* last time calibration was tried */
+static long long last_timestamp;	/* last timestamp calculated in usec */
+
 
 static void *
 ts_register_func(POOL_SELECT_RESULT *res)
@@ -190,6 +208,60 @@ makeTsExpr(TSRewriteContext *ctx)
 	return (Node *) param;
 }
 
+/*
+ * Same as makeTsExpr() but the result is used as a value of timestamp,
+ * date or time, either as an argument of cast or as a column value.
+ * Locally calculated timestamps are in UTC, so cast them to
+ * timestamptz first to get the value in the session time zone.
+ * Otherwise a timestamp without time zone or date column would get
+ * the UTC wall-clock time.
+ */
+static Node *
+makeTsCastExpr(TSRewriteContext *ctx)
+{
+	TypeCast	*tc;
+
+	if (!ctx->local_timestamp)
+		return makeTsExpr(ctx);
+
+	tc = makeNode(TypeCast);
+	tc->arg = makeTsExpr(ctx);
+	tc->typeName = SystemTypeName("timestamptz");
+	return (Node *) tc;
+}
+
+/*
+ * Make an expression for default value of a timestamp column. If the
+ * timestamp is calculated locally, the default expression is parsed
+ * and now() in it is rewritten. Otherwise the master evaluates it.
+ */
+static Node *
+makeDefaultExpr(TSRewriteContext *ctx, char *expression)
+{
+	char		 query[1024];
+	List		*tree;
+	SelectStmt	*select;
+	ResTarget	*target;
+
+	if (!ctx->local_timestamp)
+		return (Node *) makeStringConstFromQuery(ctx->backend, expression);
+
+	snprintf(query, sizeof(query), "SELECT %s", expression);
+	tree = raw_parser(query);
+
+	if (tree == NIL || !IsA(linitial(tree), SelectStmt))
+		return (Node *) makeStringConstFromQuery(ctx->backend, expression);
+
+	select = (SelectStmt *) linitial(tree);
+	target = (ResTarget *) linitial(select->targetList);
+
+	/* adsrc has "now()" without schema for DEFAULT now() or CURRENT_TIMESTAMP */
+	ctx->in_default = true;
+	rewrite_timestamp_walker(target->val, (void *) ctx);
+	ctx->in_default = false;
+	return target->val;
+}
+
 
 static bool
 isStringConst(Node *node, const char *str)
@@ -256,9 +328,11 @@ rewrite_timestamp_walker(Node *node, void *context)
 		/* `now()' FuncCall */
 		FuncCall	*fcall = (FuncCall *) node;
 
-		if (list_length(fcall->funcname) == 2 &&
-			strcmp("pg_catalog", strVal(linitial(fcall->funcname))) == 0 &&
-			strcmp("now", strVal(lsecond(fcall->funcname))) == 0)
+		if ((list_length(fcall->funcname) == 2 &&
+			 strcmp("pg_catalog", strVal(linitial(fcall->funcname))) == 0 &&
+			 strcmp("now", strVal(lsecond(fcall->funcname))) == 0) ||
+			(ctx->in_default && list_length(fcall->funcname) == 1 &&
+			 strcmp("now", strVal(linitial(fcall->funcname))) == 0))
 		{
 			TypeCast	*tc = makeNode(TypeCast);
 			tc->arg = makeTsExpr(ctx);
@@ -286,7 +360,7 @@ rewrite_timestamp_walker(Node *node, void *context)
 
 			if (isStringConst(tc->arg, "now"))
 			{
-				tc->arg = (Node *) makeTsExpr(ctx);
+				tc->arg = makeTsCastExpr(ctx);
 				ctx->rewrite = true;
 			}
 		}
@@ -314,6 +388,15 @@ get_current_timestamp(POOL_CONNECTION_POOL *backend)
 	POOL_STATUS		 status;
 	static char		timestamp[32];
 
+	if (use_local_timestamp(backend))
+	{
+		char *ts = get_local_timestamp(backend);
+
+		if (ts)
+			return ts;
+		/* fall back to asking the master */
+	}
+
 	status = do_query(MASTER(backend), "SELECT now()", &res, MAJOR(backend));
 	if (status != POOL_CONTINUE)
 	{
@@ -334,6 +417,122 @@ get_current_timestamp(POOL_CONNECTION_POOL *backend)
 }
 
 
+/*
+ * Returns true if timestamp is calculated locally. This requires V3
+ * protocol since the transaction state is needed to use the same
+ * timestamp in a transaction.
+ */
+static bool
+use_local_timestamp(POOL_CONNECTION_POOL *backend)
+{
+	return pool_config->timestamp_calibration_interval > 0 &&
+		MAJOR(backend) == PROTO_MAJOR_V3;
+}
+
+/*
+ * Calibrate clock offset against MASTER node. The master's clock is
+ * assumed to be read at the middle of the round trip.
+ */
+static bool
+calibrate_clock(POOL_CONNECTION_POOL *backend)
+{
+	POOL_SELECT_RESULT *res;
+	POOL_STATUS		 status;
+	struct timeval	 before, after;
+	long long		 master_clock;
+	long long		 local_clock;
+
+	gettimeofday(&before, NULL);
+	status = do_query(MASTER(backend), "SELECT extract(epoch FROM clock_timestamp())",
+					  &res, MAJOR(backend));
+	gettimeofday(&after, NULL);
+
+	if (status != POOL_CONTINUE)
+	{
+		pool_error("calibrate_clock: do_query failed");
+		return false;
+	}
+
+	if (res->numrows != 1 || res->data[0] == NULL)
+	{
+		free_select_result(res);
+		return false;
+	}
+
+	master_clock = (long long) (strtod(res->data[0], NULL) * 1000000);
+	free_select_result(res);
+
+	local_clock = ((long long) before.tv_sec * 1000000 + before.tv_usec +
+				   (long long) after.tv_sec * 1000000 + after.tv_usec) / 2;
+
+	clock_offset = master_clock - local_clock;
+	clock_offset_valid = true;
+
+	pool_debug("calibrate_clock: offset %lld usec round trip %lld usec", clock_offset,
+			   ((long long) (after.tv_sec - before.tv_sec)) * 1000000 +
+			   after.tv_usec - before.tv_usec);
+	return true;
+}
+
+/*
+ * Calculate current timestamp of MASTER node locally. The clock
+ * offset is measured at the first call in each session and every
+ * timestamp_calibration_interval seconds. The same timestamp is
+ * returned until the transaction ends, and timestamps calculated by
+ * this process never go backward even if the clock offset is
+ * re-calibrated. Timestamps of other processes are calibrated
+ * separately, so they may be out of order with ours by the error of
+ * the calibration. Returns NULL if the clock has never been calibrated
+ * successfully.
+ */
+static char *
+get_local_timestamp(POOL_CONNECTION_POOL *backend)
+{
+	static char		 timestamp[64];
+	POOL_SESSION_CONTEXT *session_context;
+	struct timeval	 now;
+	struct tm		 tm;
+	long long		 ts = 0;
+	time_t			 sec;
+	size_t			 len;
+
+	session_context = pool_get_session_context();
+	if (session_context)
+		ts = session_context->transaction_timestamp;
+
+	if (ts == 0)
+	{
+		gettimeofday(&now, NULL);
+
+		if (!clock_offset_valid ||
+			(session_context && !session_context->clock_calibrated) ||
+			now.tv_sec - clock_calibrated >= pool_config->timestamp_calibration_interval)
+		{
+			clock_calibrated = now.tv_sec;
+			if (session_context)
+				session_context->clock_calibrated = true;
+			if (!calibrate_clock(backend) && !clock_offset_valid)
+				return NULL;
+			gettimeofday(&now, NULL);
+		}
+
+		ts = (long long) now.tv_sec * 1000000 + now.tv_usec + clock_offset;
+		if (ts <= last_timestamp)
+			ts = last_timestamp + 1;
+		last_timestamp = ts;
+
+		if (session_context)
+			session_context->transaction_timestamp = ts;
+	}
+
+	sec = ts / 1000000;
+	gmtime_r(&sec, &tm);
+	len = strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &tm);
+	snprintf(timestamp + len, sizeof(timestamp) - len, ".%06d+00", (int) (ts % 1000000));
+
+	return timestamp;
+}
+
 /*
  * rewrite InsertStmt
  */
@@ -366,10 +565,10 @@ rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext *ctx)
 			{
 				rewrite = true;
 				if (ctx->rewrite_to_params)
-					values = lappend(values, makeTsExpr(ctx));
+					values = lappend(values, makeTsCastExpr(ctx));
 				else
 					values = lappend(values,
-									 makeStringConstFromQuery(ctx->backend, relcache->attr[i].adsrc));
+									 makeDefaultExpr(ctx, relcache->attr[i].adsrc));
 			}
 			else
 				values = lappend(values, makeNode(SetToDefault));
@@ -433,9 +632,9 @@ rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext *ctx)
 					{
 						rewrite = true;
 						if (ctx->rewrite_to_params)
-							lfirst(lc_val) = makeTsExpr(ctx);
+							lfirst(lc_val) = makeTsCastExpr(ctx);
 						else
-							lfirst(lc_val) = makeStringConstFromQuery(ctx->backend, relcache->attr[i].adsrc);
+							lfirst(lc_val) = makeDefaultExpr(ctx, relcache->attr[i].adsrc);
 					}
 					i++;
 				}
@@ -447,10 +646,10 @@ rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext *ctx)
 					{
 						rewrite = true;
 						if (ctx->rewrite_to_params)
-							values = lappend(values, makeTsExpr(ctx));
+							values = lappend(values, makeTsCastExpr(ctx));
 						else
 							values = lappend(values,
-											 makeStringConstFromQuery(ctx->backend, relcache->attr[i].adsrc));
+											 makeDefaultExpr(ctx, relcache->attr[i].adsrc));
 					}
 					else
 						values = lappend(values, makeNode(SetToDefault));
@@ -515,9 +714,9 @@ rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext *ctx)
 					{
 						rewrite = true;
 						if (ctx->rewrite_to_params)
-							lfirst(lc_val) = makeTsExpr(ctx);
+							lfirst(lc_val) = makeTsCastExpr(ctx);
 						else
-							lfirst(lc_val) = makeStringConstFromQuery(ctx->backend, relcache->attr[i].adsrc);
+							lfirst(lc_val) = makeDefaultExpr(ctx, relcache->attr[i].adsrc);
 					}
 				}
 
@@ -525,10 +724,10 @@ rewrite_timestamp_insert(InsertStmt *i_stmt, TSRewriteContext *ctx)
 				for (i = 0; i < append_columns; i++)
 				{
 					if (ctx->rewrite_to_params)
-						values = lappend(values, makeTsExpr(ctx));
+						values = lappend(values, makeTsCastExpr(ctx));
 					else
 						values = lappend(values,
-										 makeStringConstFromQuery(ctx->backend, relcache->attr[append_columns_list[i]].adsrc));
+										 makeDefaultExpr(ctx, relcache->attr[append_columns_list[i]].adsrc));
 				}
 				free(append_columns_list);
 			}
@@ -583,9 +782,9 @@ rewrite_timestamp_update(UpdateStmt *u_stmt, TSRewriteContext *ctx)
 					if (relcache->attr[i].use_timestamp)
 					{
 						if (ctx->rewrite_to_params)
-							res->val = (Node *) makeTsExpr(ctx);
+							res->val = (Node *) makeTsCastExpr(ctx);
 						else
-							res->val = (Node *)makeStringConstFromQuery(ctx->backend, relcache->attr[i].adsrc);
+							res->val = (Node *)makeDefaultExpr(ctx, relcache->attr[i].adsrc);
 						rewrite = true;
 					}
 					break;
@@ -624,6 +823,8 @@ rewrite_timestamp(POOL_CONNECTION_POOL *backend, Node *node,
 	ctx.num_params = 0;
 	ctx.rewrite = false;
 	ctx.params = NIL;
+	ctx.local_timestamp = use_local_timestamp(backend);
+	ctx.in_default = false;
 
 	/*
 	 * Prepare?
@@ -110,6 +110,9 @@ void do_worker_child(void)
 	{
 		CHECK_REQUEST;
 
+		/* take nodes attached or detached since the last check */
+		pool_refresh_backend_status();
+
 		if (pool_config->health_check_period <= 0)
 		{
 			sleep(30);
@@ -152,7 +155,7 @@ static void establish_persistent_connection(void)
 		if (slots[i] == NULL)
 		{
 			bkinfo = pool_get_node_info(i);
-			s = make_persistent_db_connection(bkinfo->backend_hostname, 
+			s = make_persistent_db_connection(i, bkinfo->backend_hostname, 
 											  bkinfo->backend_port,
 											  "postgres",
 											  pool_config->health_check_user,
@@ -26,13 +26,20 @@
 
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
+#include <sys/time.h>
 
 #include "pool.h"
 #include "pool_config.h"
 
 #include "libpq-fe.h"
 
-#define WAIT_RETRY_COUNT (pool_config->recovery_timeout / 3)
+/* time in seconds to try connecting to "postgres" database of started postmaster */
+#define POSTGRES_DB_TIMEOUT 9
+
+/* first and max interval in milliseconds to retry connecting to started postmaster */
+#define CONNECT_RETRY_INTERVAL_MIN 100
+#define CONNECT_RETRY_INTERVAL_MAX 3000
 
 #define FIRST_STAGE 0
 #define SECOND_STAGE 1
@@ -42,6 +49,8 @@ static int exec_recovery(PGconn *conn, BackendInfo *backend, char stage);
 static int exec_remote_start(PGconn *conn, BackendInfo *backend);
 static PGconn *connect_backend_libpq(BackendInfo *backend);
 static int check_postmaster_started(BackendInfo *backend);
+static int connect_postmaster_repeatedly(BackendInfo *backend, char *dbname, int timeout);
+static int elapsed_msec(struct timeval *start);
 
 static char recovery_command[1024];
 
@@ -56,6 +65,9 @@ int start_recovery(int recovery_node)
 
 	pool_log("starting recovering node %d", recovery_node);
 
+	/* the node may have been detached or attached since I was forked */
+	pool_refresh_backend_status();
+
 	if (VALID_BACKEND(recovery_node))
 	{
 		pool_error("start_recovery: backend node %d is alive", recovery_node);
@@ -76,28 +88,48 @@ int start_recovery(int recovery_node)
 	}
 
 	/* 1st stage */
-	if (REPLICATION)
+	if (pool_config->recovery_base_backup)
 	{
-		if (exec_checkpoint(conn) != 0)
+		/*
+		 * Take a base backup by ourselves instead of
+		 * recovery_1st_stage_command. BASE_BACKUP does a checkpoint
+		 * by itself.
+		 */
+		if (pool_base_backup(backend, recovery_backend,
+							 MASTER_SLAVE && !strcmp(pool_config->master_slave_sub_mode, MODE_STREAMREP)) != 0)
 		{
 			PQfinish(conn);
-			pool_error("start_recovery: CHECKPOINT failed");
+			pool_error("start_recovery: base backup failed");
 			return 1;
 		}
-		pool_log("CHECKPOINT in the 1st stage done");
 	}
-
-	if (exec_recovery(conn, recovery_backend, FIRST_STAGE) != 0)
+	else
 	{
-		PQfinish(conn);
-		return 1;
+		if (REPLICATION)
+		{
+			if (exec_checkpoint(conn) != 0)
+			{
+				PQfinish(conn);
+				pool_error("start_recovery: CHECKPOINT failed");
+				return 1;
+			}
+			pool_log("CHECKPOINT in the 1st stage done");
+		}
+
+		if (exec_recovery(conn, recovery_backend, FIRST_STAGE) != 0)
+		{
+			PQfinish(conn);
+			return 1;
+		}
 	}
 
 	pool_log("1st stage is done");
+	pcp_report_progress("1st stage is done");
 
 	if (REPLICATION)
 	{
 		pool_log("starting 2nd stage");
+		pcp_report_progress("starting 2nd stage");
 
 		/* 2nd stage */
 		*InRecovery = 1;
@@ -109,6 +141,7 @@ int start_recovery(int recovery_node)
 		}
 
 		pool_log("all connections from clients have been closed");
+		pcp_report_progress("all connections from clients have been closed");
 
 		if (exec_checkpoint(conn) != 0)
 		{
@@ -141,6 +174,7 @@ int start_recovery(int recovery_node)
 	}
 
 	pool_log("%d node restarted", recovery_node);
+	pcp_report_progress("node restarted");
 
 	/*
 	 * reset failover completion flag.  this is necessary since
@@ -273,54 +307,48 @@ static int exec_remote_start(PGconn *conn, BackendInfo *backend)
  */
 static int check_postmaster_started(BackendInfo *backend)
 {
-	int i = 0;
-	char port_str[16];
-	PGconn *conn;
-	char *dbname;
-
-	snprintf(port_str, sizeof(port_str),"%d", backend->backend_port);
-
 	/*
 	 * First we try with "postgres" database.
 	 */
-	dbname = "postgres";
-
-	do {
-		ConnStatusType r;
-
-		pool_log("check_postmaster_started: try to connect to postmaster on hostname:%s database:%s user:%s (retry %d times)",
-				 backend->backend_hostname, dbname, pool_config->recovery_user, i);
-
-		conn = PQsetdbLogin(backend->backend_hostname,
-							port_str,
-							NULL,
-							NULL,
-							dbname,
-							pool_config->recovery_user,
-							pool_config->recovery_password);
-
-		r = PQstatus(conn);
-		PQfinish(conn);
-		if (r == CONNECTION_OK)
-			return 0;
-
-		pool_log("check_postmaster_started: failed to connect to postmaster on hostname:%s database:%s user:%s",
-			 backend->backend_hostname, dbname, pool_config->recovery_user);
-		
-		sleep(3);
-	} while (i++ < 3);	/* XXX Hard coded retry (9 seconds) */
+	if (connect_postmaster_repeatedly(backend, "postgres", POSTGRES_DB_TIMEOUT) == 0)
+		return 0;
 
 	/*
 	 * Retry with "template1" database.
 	 */
-	dbname = "template1";
-	i = 0;
+	if (connect_postmaster_repeatedly(backend, "template1", pool_config->recovery_timeout) == 0)
+		return 0;
 
-	do {
+	pool_error("check_postmaster_started: remote host start up did not finish in %d sec.", pool_config->recovery_timeout);
+	return 1;
+}
+
+/*
+ * Try to connect to postmaster until it succeeds or "timeout"
+ * seconds have passed. The retry interval starts from
+ * CONNECT_RETRY_INTERVAL_MIN milliseconds and is doubled up to
+ * CONNECT_RETRY_INTERVAL_MAX, so that a postmaster which starts
+ * quickly is found quickly. Returns 0 if connected.
+ */
+static int connect_postmaster_repeatedly(BackendInfo *backend, char *dbname, int timeout)
+{
+	struct timeval start;
+	char port_str[16];
+	PGconn *conn;
+	int interval = CONNECT_RETRY_INTERVAL_MIN;
+	int remaining;
+	int i = 0;
+
+	snprintf(port_str, sizeof(port_str),"%d", backend->backend_port);
+	gettimeofday(&start, NULL);
+
+	for (;;)
+	{
 		ConnStatusType r;
+		struct timeval t;
 
 		pool_log("check_postmaster_started: try to connect to postmaster on hostname:%s database:%s user:%s (retry %d times)",
-				 backend->backend_hostname, dbname, pool_config->recovery_user, i);
+				 backend->backend_hostname, dbname, pool_config->recovery_user, i++);
 
 		conn = PQsetdbLogin(backend->backend_hostname,
 							port_str,
@@ -338,14 +366,34 @@ static int check_postmaster_started(BackendInfo *backend)
 		pool_log("check_postmaster_started: failed to connect to postmaster on hostname:%s database:%s user:%s",
 			 backend->backend_hostname, dbname, pool_config->recovery_user);
 
-		if (WAIT_RETRY_COUNT != 0)
-			sleep(3);
-	} while (i++ < WAIT_RETRY_COUNT);
+		remaining = timeout * 1000 - elapsed_msec(&start);
+		if (remaining <= 0)
+			break;
 
-	pool_error("check_postmaster_started: remote host start up did not finish in %d sec.", pool_config->recovery_timeout);
+		if (interval > remaining)
+			interval = remaining;
+		t.tv_sec = interval / 1000;
+		t.tv_usec = (interval % 1000) * 1000;
+		select(0, NULL, NULL, NULL, &t);
+
+		interval *= 2;
+		if (interval > CONNECT_RETRY_INTERVAL_MAX)
+			interval = CONNECT_RETRY_INTERVAL_MAX;
+	}
 	return 1;
 }
 
+/*
+ * Return milliseconds passed since "start".
+ */
+static int elapsed_msec(struct timeval *start)
+{
+	struct timeval now;
+
+	gettimeofday(&now, NULL);
+	return (now.tv_sec - start->tv_sec) * 1000 + (now.tv_usec - start->tv_usec) / 1000;
+}
+
 static PGconn *connect_backend_libpq(BackendInfo *backend)
 {
 	char port_str[16];
@@ -370,20 +418,47 @@ static PGconn *connect_backend_libpq(BackendInfo *backend)
 }
 
 /*
- * Wait all connections are closed.
+ * Wait all connections are closed. Children write to conn_closed_fds
+ * when the connection counter goes down to 0 during recovery, so we
+ * return as soon as the last frontend has gone.
  */
 int wait_connection_closed(void)
 {
-	int i = 0;
+	struct timeval start;
+	char buf[64];
+	int remaining;
+
+	gettimeofday(&start, NULL);
 
-	do {
+	for (;;)
+	{
+		fd_set rmask;
+		struct timeval t;
+
+		/*
+		 * Consume old notifications before checking the counter so
+		 * that a notification sent after the check is not missed.
+		 */
+		while (read(conn_closed_fds[0], buf, sizeof(buf)) > 0)
+			;
 
 		if (Req_info->conn_counter == 0)
 			return 0;
 
-		if (WAIT_RETRY_COUNT != 0)
-			sleep(3);
-	} while (i++ < WAIT_RETRY_COUNT);
+		remaining = pool_config->recovery_timeout * 1000 - elapsed_msec(&start);
+		if (remaining <= 0)
+			break;
+
+		FD_ZERO(&rmask);
+		FD_SET(conn_closed_fds[0], &rmask);
+		t.tv_sec = remaining / 1000;
+		t.tv_usec = (remaining % 1000) * 1000;
+		if (select(conn_closed_fds[0] + 1, &rmask, NULL, NULL, &t) < 0 && errno != EINTR)
+		{
+			pool_error("wait_connection_closed: select() failed: %s", strerror(errno));
+			return 1;
+		}
+	}
 
 	pool_error("wait_connection_closed: existing connections did not close in %d sec.", pool_config->recovery_timeout);
 	return 1;